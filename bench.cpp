@@ -0,0 +1,375 @@
+// MagicWound 基准测试：微基准（编解码、校验、查询）与宏基准（整局模拟），结果以 JSON 输出
+//   用法: MagicWoundBench [--filter 子串] [--min-time 秒]
+#include "magicwound.h"
+#include <chrono>
+#include <cstring>
+#include <locale>
+
+using namespace std;
+
+namespace {
+
+// 防止编译器把被测代码当作无用计算优化掉
+volatile uint64_t benchSink = 0;
+
+template <typename T>
+inline void keep(const T& value) {
+    benchSink = benchSink + static_cast<uint64_t>(value);
+}
+
+struct BenchResult {
+    string name;
+    uint64_t iterations;
+    double seconds;
+    double bytesPerOp;   // 0 表示不统计吞吐
+};
+
+class BenchRunner {
+public:
+    BenchRunner(const string& filter, double minSeconds) : filter(filter), minSeconds(minSeconds) {}
+
+    // body(n) 执行 n 次被测操作；迭代次数倍增直到总耗时不少于 minSeconds
+    template <typename Body>
+    void run(const string& name, Body body, double bytesPerOp = 0) {
+        if (!filter.empty() && name.find(filter) == string::npos) return;
+        body(1); // 预热
+        uint64_t iterations = 1;
+        double seconds = 0;
+        while (true) {
+            auto start = chrono::steady_clock::now();
+            body(iterations);
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (seconds >= minSeconds || iterations >= (uint64_t(1) << 40)) break;
+            // 按已测耗时估算，最多放大 10 倍，至少翻倍
+            double scale = seconds > 0 ? minSeconds * 1.2 / seconds : 10.0;
+            iterations = static_cast<uint64_t>(iterations * min(10.0, max(2.0, scale)));
+        }
+        results.push_back({name, iterations, seconds, bytesPerOp});
+        cerr << name << ": " << seconds * 1e9 / iterations << " ns/op" << endl;
+    }
+
+    void writeJson(ostream& out) const {
+        out << "{\n  \"build\": {\"compiler\": \"" << compilerName() << "\", \"ssse3\": " << flag(SSSE3)
+            << ", \"pclmul\": " << flag(PCLMUL) << ", \"threads\": " << thread::hardware_concurrency() << "},\n";
+        out << "  \"benchmarks\": [\n";
+        out << fixed;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchResult& r = results[i];
+            double nsPerOp = r.seconds * 1e9 / r.iterations;
+            out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                << ", \"ns_per_op\": " << setprecision(2) << nsPerOp
+                << ", \"ops_per_sec\": " << setprecision(1) << r.iterations / r.seconds;
+            if (r.bytesPerOp > 0) {
+                out << ", \"mb_per_sec\": " << setprecision(1) << r.bytesPerOp * r.iterations / r.seconds / 1e6;
+            }
+            out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}" << endl;
+    }
+
+private:
+#if defined(__SSSE3__)
+    static const bool SSSE3 = true;
+#else
+    static const bool SSSE3 = false;
+#endif
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+    static const bool PCLMUL = true;
+#else
+    static const bool PCLMUL = false;
+#endif
+
+    string filter;
+    double minSeconds;
+    vector<BenchResult> results;
+
+    static const char* flag(bool value) { return value ? "true" : "false"; }
+    static string compilerName() {
+#if defined(__clang__)
+        return string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+        return string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+        return "msvc " + to_string(_MSC_VER);
+#else
+        return "unknown";
+#endif
+    }
+};
+
+// 20 张卡牌、3 个角色的标准牌组
+Deck makeBenchDeck(const string& name) {
+    const CardDatabase& cardDB = CardDatabase::instance();
+    const CharacterDatabase& characterDB = CharacterDatabase::instance();
+    Deck deck(name);
+    for (const auto& character : characterDB.getAllCharacters()) deck.addCharacter(character);
+    for (size_t i = 0; deck.getCardCount() < 20; ++i) {
+        const Card& card = cardDB.getCard(static_cast<CardHandle>((i * 7) % cardDB.getCardCount()));
+        if (card.getRarity() == +Rarity::Funny) continue;
+        deck.addCard(card.getHandle());
+    }
+    return deck;
+}
+
+// 旧版文本格式的牌组代码（name;type;charIds;cardIds;maxLimit;|crc）
+string makeLegacyCode(const Deck& deck) {
+    const CardDatabase& cardDB = CardDatabase::instance();
+    string data = deck.getName() + ";" + deck.getDeckType()._to_string() + ";";
+    for (size_t i = 0; i < deck.getCharacters().size(); ++i) {
+        if (i) data += ",";
+        data += deck.getCharacters()[i]->getId();
+    }
+    data += ";";
+    for (size_t i = 0; i < deck.getCards().size(); ++i) {
+        if (i) data += ",";
+        data += cardDB.getCard(deck.getCards()[i]).getId();
+    }
+    data += ";" + to_string(deck.getMaxCardLimit()) + ";";
+    return base64::encode(data + "|" + crc32::generate_checksum(data));
+}
+
+void runCodecBenchmarks(BenchRunner& runner) {
+    vector<uint8_t> small(30), large(4096);
+    mt19937 rng(1);
+    for (auto& b : small) b = static_cast<uint8_t>(rng());
+    for (auto& b : large) b = static_cast<uint8_t>(rng());
+
+    runner.run("crc32/30B", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(crc32::calculate(small.data(), small.size()));
+    }, small.size());
+    runner.run("crc32/4KB", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(crc32::calculate(large.data(), large.size()));
+    }, large.size());
+    runner.run("crc32/checksum", [&](uint64_t n) {
+        char out[crc32::CHECKSUM_LENGTH];
+        for (uint64_t i = 0; i < n; ++i) {
+            crc32::write_checksum(small.data(), small.size(), out);
+            keep(out[0]);
+        }
+    }, small.size());
+
+    string encodedSmall(base64::encodedLength(small.size()), '\0');
+    string encodedLarge(base64::encodedLength(large.size()), '\0');
+    base64::encode(small.data(), small.size(), &encodedSmall[0]);
+    base64::encode(large.data(), large.size(), &encodedLarge[0]);
+    vector<uint8_t> decoded(large.size());
+
+    runner.run("base64/encode/30B", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(base64::encode(small.data(), small.size(), &encodedSmall[0]));
+    }, small.size());
+    runner.run("base64/encode/4KB", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(base64::encode(large.data(), large.size(), &encodedLarge[0]));
+    }, large.size());
+    runner.run("base64/decode/30B", [&](uint64_t n) {
+        size_t written;
+        for (uint64_t i = 0; i < n; ++i) {
+            keep(base64::decode(encodedSmall.data(), encodedSmall.size(), decoded.data(), decoded.size(), written));
+        }
+    }, small.size());
+    runner.run("base64/decode/4KB", [&](uint64_t n) {
+        size_t written;
+        for (uint64_t i = 0; i < n; ++i) {
+            keep(base64::decode(encodedLarge.data(), encodedLarge.size(), decoded.data(), decoded.size(), written));
+        }
+    }, large.size());
+}
+
+void runDeckCodeBenchmarks(BenchRunner& runner) {
+    const CardDatabase& cardDB = CardDatabase::instance();
+    const CharacterDatabase& characterDB = CharacterDatabase::instance();
+    Deck deck = makeBenchDeck("基准牌组");
+    string code = deck.getDeckCode();
+    string legacy = makeLegacyCode(deck);
+
+    runner.run("deckcode/encode", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            deck.setMaxCardLimit(20); // 置脏，强制重新编码
+            keep(deck.getDeckCode().size());
+        }
+    });
+
+    DeckCodeParser parser(cardDB, characterDB);
+    DecodedDeck decoded;
+    runner.run("deckcode/parse/v2", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(parser.parse(code, decoded));
+    });
+    runner.run("deckcode/parse/legacy", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(parser.parse(legacy, decoded));
+    });
+    Deck imported("");
+    runner.run("deckcode/import", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(imported.importFromDeckCode(code, cardDB, characterDB));
+    });
+}
+
+void runCatalogBenchmarks(BenchRunner& runner) {
+    const CardDatabase& cardDB = CardDatabase::instance();
+    vector<string> ids, names;
+    for (const auto& card : cardDB.getAllCards()) {
+        ids.push_back(card->getId());
+        names.push_back(card->getName());
+    }
+
+    runner.run("catalog/findById", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(cardDB.findHandleById(ids[i % ids.size()]));
+    });
+    runner.run("catalog/findByName", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(cardDB.findCard(names[i % names.size()]) != nullptr);
+    });
+
+    CardQuery query;
+    query.type = +CardType::Spell;
+    query.anyElements = ElementSet{+Element::Fire, +Element::Water, +Element::Dark};
+    query.maxCost = 5;
+    CardSelection selection;
+    runner.run("catalog/select", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            cardDB.select(query, selection);
+            keep(selection.count());
+        }
+    });
+}
+
+void runDeckBenchmarks(BenchRunner& runner) {
+    const CardDatabase& cardDB = CardDatabase::instance();
+    vector<CardHandle> handles;
+    for (size_t i = 0; handles.size() < 20; ++i) {
+        const Card& card = cardDB.getCard(static_cast<CardHandle>(i % cardDB.getCardCount()));
+        if (card.getRarity() != +Rarity::Funny) handles.push_back(card.getHandle());
+    }
+
+    runner.run("deck/build20", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            Deck deck("基准牌组");
+            for (CardHandle handle : handles) deck.addCard(handle);
+            keep(deck.getCardCount());
+        }
+    });
+    runner.run("deck/build20+code", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            Deck deck("基准牌组");
+            for (CardHandle handle : handles) deck.addCard(handle);
+            keep(deck.getDeckCode().size());
+        }
+    });
+
+    Deck deck = makeBenchDeck("基准牌组");
+    Rng rng(1);
+    runner.run("deck/shuffle", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            deck.shuffle(rng);
+            keep(deck.getCards()[0]);
+        }
+    });
+}
+
+void runMatchBenchmarks(BenchRunner& runner) {
+    Deck a = makeBenchDeck("A");
+    Deck b = makeBenchDeck("B");
+    PlayerSetup first{"A", a.getCards(), a.getCharacters()};
+    PlayerSetup second{"B", b.getCards(), b.getCharacters()};
+
+    unsigned int seed = 0;
+    runner.run("match/random", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i, ++seed) {
+            MatchEngine engine(first, second, seed);
+            RandomPlayer p1(seed * 2 + 1), p2(seed * 2 + 2);
+            keep(engine.play(p1, p2, 200));
+        }
+    });
+
+    Simulator simulator(0);
+    runner.run("match/simulate1000", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(simulator.run(first, second, 1000, 7 + i).games);
+    });
+
+    // 预先记录 64 局，衡量序列化、解析与确定性重放。回放按牌组代码还原牌库，
+    // 记录时的牌库也须取自解析结果，否则洗牌前的顺序不同
+    DeckCodeParser parser(CardDatabase::instance(), CharacterDatabase::instance());
+    DecodedDeck decodedA, decodedB;
+    parser.parse(a.getDeckCode(), decodedA);
+    parser.parse(b.getDeckCode(), decodedB);
+    PlayerSetup replayFirst{"A", decodedA.cards, a.getCharacters()};
+    PlayerSetup replaySecond{"B", decodedB.cards, b.getCharacters()};
+    vector<Replay> replays(64);
+    for (size_t i = 0; i < replays.size(); ++i) {
+        Replay& r = replays[i];
+        r.seed = (uint32_t)i;
+        r.sides[0].name = "A";
+        r.sides[1].name = "B";
+        r.sides[0].deckCode = a.getDeckCode();
+        r.sides[1].deckCode = b.getDeckCode();
+        for (const auto& ch : a.getCharacters()) r.sides[0].characters.push_back(ch->getIndex());
+        for (const auto& ch : b.getCharacters()) r.sides[1].characters.push_back(ch->getIndex());
+        MatchEngine engine(replayFirst, replaySecond, r.seed);
+        engine.setActionLog(&r.actions);
+        RandomPlayer p1((unsigned int)i * 2 + 1), p2((unsigned int)i * 2 + 2);
+        r.winner = engine.play(p1, p2, 200);
+        r.turns = engine.getTurn();
+    }
+    string archive;
+    for (const auto& r : replays) r.appendTo(archive);
+
+    runner.run("replay/write", [&](uint64_t n) {
+        string out;
+        for (uint64_t i = 0; i < n; ++i) {
+            out.clear();
+            replays[i % replays.size()].appendTo(out);
+            keep(out.size());
+        }
+    });
+
+    ReplayRunner replayRunner;
+    Replay parsed;
+    ReplayOutcome outcome;
+    runner.run("replay/read+run", [&](uint64_t n) {
+        const uint8_t* begin = (const uint8_t*)archive.data();
+        const uint8_t* end = begin + archive.size();
+        const uint8_t* p = begin;
+        for (uint64_t i = 0; i < n; ++i) {
+            if (p >= end) p = begin;
+            Replay::read(p, end, parsed);
+            replayRunner.run(parsed, outcome);
+            keep(outcome.actions);
+        }
+    });
+
+    // 固定的开局局面，每次清空置换表后求解 3 个回合，衡量求解器的节点速度
+    MatchEngine opening(first, second, 11);
+    const GameState position = opening.snapshot();
+    EndgameSolver solver(16, 1);
+    runner.run("match/solve3", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            solver.clear();
+            keep(solver.solve(position, 3).nodes);
+        }
+    });
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    string filter;
+    double minSeconds = 0.3;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minSeconds = atof(argv[++i]);
+        } else {
+            cerr << "用法: " << argv[0] << " [--filter 子串] [--min-time 秒]" << endl;
+            return 1;
+        }
+    }
+    // JSON 中的数字不能受本地化千位分隔符影响
+    cout.imbue(locale::classic());
+
+    BenchRunner runner(filter, minSeconds);
+    runCodecBenchmarks(runner);
+    runDeckCodeBenchmarks(runner);
+    runCatalogBenchmarks(runner);
+    runDeckBenchmarks(runner);
+    runMatchBenchmarks(runner);
+    runner.writeJson(cout);
+    return 0;
+}
@@ -10,4 +10,7 @@ windres resource.rc resource.o
 REM 编译并链接，注意把 resource.o 加入链接输入
 g++ -std=c++17 -I"C:\path\to\better-enums" -I"C:\path\to\boost" main.cpp magicwound.cpp resource.o -lws2_32 -mconsole -pthread -Wl,-Bstatic "C:\\Program Files (x86)\\Dev-Cpp\\MinGW32\\lib\\libmcfgthread-1.dll" -o MagicWound.exe
 
+REM 基准测试（可选），结果以 JSON 输出到标准输出
+g++ -std=c++17 -O2 -I"C:\path\to\better-enums" -I"C:\path\to\boost" bench.cpp magicwound.cpp -lws2_32 -mconsole -pthread -o MagicWoundBench.exe
+
 pause
\ No newline at end of file
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Linux/macOS 编译脚本：生成 MagicWound 与基准测试 MagicWoundBench
+#   BETTER_ENUMS_DIR  better-enums 的 enum.h 所在目录（默认 ./better-enums）
+#   CXXFLAGS          额外编译选项，例如 CXXFLAGS="-march=native" 启用 SSSE3/PCLMUL 路径
+set -e
+cd "$(dirname "$0")"
+
+CXX=${CXX:-g++}
+BETTER_ENUMS_DIR=${BETTER_ENUMS_DIR:-./better-enums}
+FLAGS="-std=c++17 -O2 -I$BETTER_ENUMS_DIR $CXXFLAGS"
+
+$CXX $FLAGS main.cpp magicwound.cpp -pthread -o MagicWound
+$CXX $FLAGS bench.cpp magicwound.cpp -pthread -o MagicWoundBench
+echo "编译完成: MagicWound, MagicWoundBench"
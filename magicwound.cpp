@@ -4,83 +4,469 @@
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #ifdef _WIN32
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600 // WSAPoll
+#endif
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#define MW_NET_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <climits>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define MW_NET_KQUEUE
+#include <sys/event.h>
 #endif
 
 using namespace std;
 
-// CRC32 实现 - 使用 Boost
+// CRC32 实现
 namespace crc32 {
+    // TABLES[k][b]：字节 b 之后再经过 k 个零字节的 CRC 余数，用于一次处理 8 字节
+    struct SliceTables {
+        uint32_t value[8][256];
+        constexpr SliceTables() : value() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+                value[0][i] = crc;
+            }
+            for (int k = 1; k < 8; ++k) {
+                for (int i = 0; i < 256; ++i) {
+                    uint32_t prev = value[k - 1][i];
+                    value[k][i] = (prev >> 8) ^ value[0][prev & 0xFF];
+                }
+            }
+        }
+    };
+    static constexpr SliceTables TABLES;
+
+    // 对未取反的内部状态逐段更新
+    static uint32_t updateSlicing(uint32_t crc, const uint8_t* p, size_t length) {
+        const auto& t = TABLES.value;
+        while (length >= 8) {
+            uint32_t lo = (uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24)) ^ crc;
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+                  t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+            p += 8;
+            length -= 8;
+        }
+        while (length--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+        return crc;
+    }
+
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+    // 每次折叠 64 字节（4 路 128 位），length 须 >= 64 且为 16 的倍数。
+    // 常数为多项式 0x04C11DB7 反射形式下 x^(k) mod P 的预计算值及 Barrett 约减参数
+    static uint32_t updateFolding(uint32_t crc, const uint8_t* p, size_t length) {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+        __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+        __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+        __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+        p += 64;
+        length -= 64;
+
+        while (length >= 64) {
+            __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+            __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+            __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+            __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30)));
+            p += 64;
+            length -= 64;
+        }
+
+        // 4 路合并为 1 路，再逐块折叠剩余的 16 字节
+        auto fold = [&](__m128i acc, __m128i next) {
+            __m128i lo = _mm_clmulepi64_si128(acc, k3k4, 0x00);
+            __m128i hi = _mm_clmulepi64_si128(acc, k3k4, 0x11);
+            return _mm_xor_si128(_mm_xor_si128(hi, next), lo);
+        };
+        x1 = fold(x1, x2);
+        x1 = fold(x1, x3);
+        x1 = fold(x1, x4);
+        while (length >= 16) {
+            x1 = fold(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+            p += 16;
+            length -= 16;
+        }
+
+        // 128 位 -> 64 位
+        x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, low32);
+        x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett 约减到 32 位
+        x2 = _mm_and_si128(x1, low32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+        x2 = _mm_and_si128(x2, low32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+        return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+    }
+#endif
+
     uint32_t calculate(const std::string& input) {
-        boost::crc_32_type result;
-        result.process_bytes(input.data(), input.length());
-        return result.checksum();
+        return calculate(input.data(), input.length());
+    }
+
+    uint32_t calculate(const void* data, size_t length) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        uint32_t crc = 0xFFFFFFFFu;
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+        if (length >= 64) {
+            size_t folded = length & ~static_cast<size_t>(15);
+            crc = updateFolding(crc, p, folded);
+            p += folded;
+            length -= folded;
+        }
+#endif
+        return ~updateSlicing(crc, p, length);
+    }
+
+    void write_checksum(const void* data, size_t length, char out[CHECKSUM_LENGTH]) {
+        static const char HEX[] = "0123456789abcdef";
+        uint32_t crc = calculate(data, length);
+        for (size_t i = 0; i < CHECKSUM_LENGTH; ++i) {
+            out[i] = HEX[(crc >> (28 - 4 * i)) & 0xF];
+        }
+    }
+
+    bool verify_checksum(const void* data, size_t length, std::string_view checksum) {
+        if (checksum.size() != CHECKSUM_LENGTH) return false;
+        char expected[CHECKSUM_LENGTH];
+        write_checksum(data, length, expected);
+        return memcmp(expected, checksum.data(), CHECKSUM_LENGTH) == 0;
     }
 
     std::string generate_checksum(const std::string& input) {
-        uint32_t crc = calculate(input);
-        stringstream ss;
-        ss << hex << setw(8) << setfill('0') << crc;
-        return ss.str().substr(0, 4);
+        char out[CHECKSUM_LENGTH];
+        write_checksum(input.data(), input.size(), out);
+        return std::string(out, CHECKSUM_LENGTH);
     }
 }
 
-// Base64 实现 - 使用 Boost
+// Base64 实现
 namespace base64 {
-    using namespace boost::archive::iterators;
-    
-    // Base64 编码器
-    typedef base64_from_binary<transform_width<string::const_iterator, 6, 8>> base64_enc;
-    // Base64 解码器  
-    typedef transform_width<binary_from_base64<string::const_iterator>, 8, 6> base64_dec;
+    static const char ENCODE_TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // 字符 -> 6 位值，非法字符为 0xFF
+    struct DecodeTable {
+        uint8_t value[256];
+        constexpr DecodeTable() : value() {
+            for (int i = 0; i < 256; ++i) value[i] = 0xFF;
+            for (int i = 0; i < 64; ++i) value[static_cast<uint8_t>(ENCODE_TABLE[i])] = static_cast<uint8_t>(i);
+        }
+    };
+    static constexpr DecodeTable DECODE_TABLE;
+
+#if defined(__SSSE3__)
+    // 12 字节 -> 16 个字符（Muła 的 pshufb 方法）
+    static inline __m128i encodeBlock(__m128i in) {
+        in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+        __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+        __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+        __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+        __m128i indices = _mm_or_si128(t1, t3);
+
+        // 按区间查偏移：A-Z / a-z / 0-9 / '+' / '/'
+        __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+        const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0);
+        return _mm_add_epi8(_mm_shuffle_epi8(shift, range), indices);
+    }
+
+    // 16 个字符 -> 12 字节（写入 16 字节，末 4 字节为 0）；含非法字符时返回 false
+    static inline bool decodeBlock(__m128i in, uint8_t* out) {
+        const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask2F = _mm_set1_epi8(0x2F);
+
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask2F);
+        __m128i loNibbles = _mm_and_si128(in, mask2F);
+        __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) return false;
+
+        __m128i eq2F = _mm_cmpeq_epi8(in, mask2F);
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+        __m128i values = _mm_add_epi8(in, roll);
+
+        // 每 4 个 6 位值合并为 3 字节
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), merged);
+        return true;
+    }
+#endif
+
+    size_t encode(const void* data, size_t length, char* out) {
+        const uint8_t* in = static_cast<const uint8_t*>(data);
+        const uint8_t* end = in + length;
+        char* o = out;
+#if defined(__SSSE3__)
+        // 每次读 16 字节、消耗 12 字节，保证不越界读取
+        while (end - in >= 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o), encodeBlock(block));
+            in += 12;
+            o += 16;
+        }
+#endif
+        while (end - in >= 3) {
+            uint32_t triple = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8) | in[2];
+            o[0] = ENCODE_TABLE[triple >> 18];
+            o[1] = ENCODE_TABLE[(triple >> 12) & 0x3F];
+            o[2] = ENCODE_TABLE[(triple >> 6) & 0x3F];
+            o[3] = ENCODE_TABLE[triple & 0x3F];
+            in += 3;
+            o += 4;
+        }
+        if (end - in == 1) {
+            uint32_t triple = uint32_t(in[0]) << 16;
+            o[0] = ENCODE_TABLE[triple >> 18];
+            o[1] = ENCODE_TABLE[(triple >> 12) & 0x3F];
+            o[2] = '=';
+            o[3] = '=';
+            o += 4;
+        } else if (end - in == 2) {
+            uint32_t triple = (uint32_t(in[0]) << 16) | (uint32_t(in[1]) << 8);
+            o[0] = ENCODE_TABLE[triple >> 18];
+            o[1] = ENCODE_TABLE[(triple >> 12) & 0x3F];
+            o[2] = ENCODE_TABLE[(triple >> 6) & 0x3F];
+            o[3] = '=';
+            o += 4;
+        }
+        return static_cast<size_t>(o - out);
+    }
+
+    bool decode(const char* input, size_t length, uint8_t* out, size_t capacity, size_t& written) {
+        written = 0;
+        if (length == 0) return true;
+        if (length % 4 != 0) return false;
+
+        size_t padding = input[length - 1] == '=' ? (input[length - 2] == '=' ? 2 : 1) : 0;
+        size_t outLength = length / 4 * 3 - padding;
+        if (outLength > capacity) return false;
+
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+        // 带填充的最后一组单独处理
+        const uint8_t* fullEnd = in + length - (padding ? 4 : 0);
+        uint8_t* o = out;
+#if defined(__SSSE3__)
+        // 每块写 16 字节，需给输出留出余量；遇到非法字符交给标量路径报错
+        while (fullEnd - in >= 16 && static_cast<size_t>(out + capacity - o) >= 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+            if (!decodeBlock(block, o)) break;
+            in += 16;
+            o += 12;
+        }
+#endif
+        const uint8_t* table = DECODE_TABLE.value;
+        while (in < fullEnd) {
+            uint8_t a = table[in[0]], b = table[in[1]], c = table[in[2]], d = table[in[3]];
+            if ((a | b | c | d) & 0x80) return false;
+            uint32_t triple = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+            o[0] = static_cast<uint8_t>(triple >> 16);
+            o[1] = static_cast<uint8_t>(triple >> 8);
+            o[2] = static_cast<uint8_t>(triple);
+            in += 4;
+            o += 3;
+        }
+        if (padding) {
+            uint8_t a = table[in[0]], b = table[in[1]];
+            uint8_t c = padding == 1 ? table[in[2]] : 0;
+            if ((a | b | c) & 0x80) return false;
+            // 被填充截掉的位必须为 0，保证每段数据只有唯一编码
+            if (padding == 2 ? (b & 0x0F) != 0 : (c & 0x03) != 0) return false;
+            *o++ = static_cast<uint8_t>((a << 2) | (b >> 4));
+            if (padding == 1) *o++ = static_cast<uint8_t>((b << 4) | (c >> 2));
+        }
+        written = static_cast<size_t>(o - out);
+        return true;
+    }
 
     string encode(const string &input) {
-        if (input.empty()) return string();
-        
-        string encoded(base64_enc(input.begin()), base64_enc(input.end()));
-        
-        // 添加填充
-        size_t padding = (3 - input.length() % 3) % 3;
-        for (size_t i = 0; i < padding; i++) {
-            encoded.push_back('=');
-        }
-        
+        string encoded(encodedLength(input.size()), '\0');
+        encode(input.data(), input.size(), &encoded[0]);
         return encoded;
     }
 
     string decode(const string &input) {
-        if (input.empty()) return string();
-        
-        // 移除填充
-        size_t padding = count(input.begin(), input.end(), '=');
-        string clean_input = input.substr(0, input.length() - padding);
-        
-        if (clean_input.empty()) return string();
-        
-        try {
-            string decoded(base64_dec(clean_input.begin()), base64_dec(clean_input.end()));
-            
-            // 移除由于填充产生的空字符
-            size_t real_length = (clean_input.length() * 6) / 8;
-            if (real_length < decoded.length()) {
-                decoded.resize(real_length);
-            }
-            
-            return decoded;
-        } catch (...) {
+        string decoded(maxDecodedLength(input.size()), '\0');
+        size_t written = 0;
+        if (!decode(input.data(), input.size(), reinterpret_cast<uint8_t*>(&decoded[0]), decoded.size(), written)) {
             return string();
         }
+        decoded.resize(written);
+        return decoded;
+    }
+}
+
+// 二进制牌组代码工具
+namespace deckcode {
+    size_t writeVarint(uint32_t value, uint8_t* out) {
+        size_t n = 0;
+        while (value >= 0x80) {
+            out[n++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        out[n++] = static_cast<uint8_t>(value);
+        return n;
     }
+
+    bool readVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && p < end; shift += 7) {
+            uint8_t b = *p++;
+            value |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+}
+
+static uint64_t mixSeed(uint64_t x) {
+    // splitmix64 终混，使相邻局号得到互不相关的种子
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// 从主种子派生第 index 个子种子（对局、搜索线程等），主种子的全部 64 位都参与
+static uint64_t streamSeed(uint64_t seed, uint64_t index) {
+    return mixSeed(mixSeed(seed) + index * 0x9E3779B97F4A7C15ULL);
+}
+
+// 对局中第 player 名 AI 的种子，与对局种子及另一名 AI 的种子互不相关
+static uint64_t playerSeed(uint64_t gameSeed, int player) {
+    static const uint64_t keys[2] = { 0xD1B54A32D192ED03ULL, 0xABC98388FB8FAC03ULL };
+    return mixSeed(gameSeed ^ keys[player]);
+}
+
+// Rng 实现
+void Rng::seed(uint64_t seed) {
+    // splitmix64 序列展开种子，保证状态不全为 0
+    for (int i = 0; i < 4; ++i) s[i] = mixSeed(seed + (uint64_t)i * 0x9E3779B97F4A7C15ULL);
+}
+
+void Rng::jump() {
+    static const uint64_t JUMP[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                      0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+    uint64_t t[4] = { 0, 0, 0, 0 };
+    for (uint64_t word : JUMP) {
+        for (int b = 0; b < 64; ++b) {
+            if (word & (1ULL << b)) for (int i = 0; i < 4; ++i) t[i] ^= s[i];
+            next();
+        }
+    }
+    for (int i = 0; i < 4; ++i) s[i] = t[i];
+}
+
+Rng Rng::split() {
+    Rng child = *this;
+    jump();
+    return child;
+}
+
+// FlatStringIndex 实现
+uint32_t FlatStringIndex::hash(string_view key) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void FlatStringIndex::build(const vector<string_view>& source) {
+    keys = source;
+    // 容量取 2 的幂且装载率不超过 50%，保证探测链很短
+    size_t capacity = 8;
+    while (capacity < keys.size() * 2) capacity <<= 1;
+    mask = capacity - 1;
+    slots.assign(capacity, Slot{0, NOT_FOUND});
+    for (size_t i = 0; i < keys.size() && i < NOT_FOUND; ++i) {
+        if (find(keys[i]) != NOT_FOUND) continue;
+        uint32_t h = hash(keys[i]);
+        size_t pos = h & mask;
+        while (slots[pos].value != NOT_FOUND) pos = (pos + 1) & mask;
+        slots[pos].hash = h;
+        slots[pos].value = static_cast<uint16_t>(i);
+    }
+}
+
+uint16_t FlatStringIndex::find(string_view key) const {
+    if (slots.empty()) return NOT_FOUND;
+    uint32_t h = hash(key);
+    for (size_t pos = h & mask; slots[pos].value != NOT_FOUND; pos = (pos + 1) & mask) {
+        if (slots[pos].hash == h && keys[slots[pos].value] == key) return slots[pos].value;
+    }
+    return NOT_FOUND;
 }
 
 // Character 实现
 Character::Character(const string& id, const string& name, 
-                   const vector<Element>& elements, int health, int energy,
+                   ElementSet elements, int health, int energy,
                    const string& ability, const string& description,
                    const string& passive_ability, const string& passive_description)
     : id(id), name(name), elements(elements), health(health), 
@@ -88,7 +474,7 @@ Character::Character(const string& id, const string& name,
       passive_ability(passive_ability), passive_description(passive_description) {}
 
 bool Character::hasElement(Element element) const {
-    return find(elements.begin(), elements.end(), element) != elements.end();
+    return elements.has(element);
 }
 
 void Character::display() const {
@@ -122,7 +508,7 @@ string Character::elementToString(Element element) const {
 }
 
 // Card 实现 - 修改构造函数
-Card::Card(const string& id, const string& name, const vector<Element>& elements, 
+Card::Card(const string& id, const string& name, ElementSet elements, 
      int cost, Rarity rarity, const string& description,
      int attack, int defense, int health)
     : id(id), name(name), 
@@ -131,7 +517,7 @@ Card::Card(const string& id, const string& name, const vector<Element>& elements
       attack(attack), defense(defense), health(health) {}
 
 bool Card::hasElement(Element element) const {
-    return find(elements.begin(), elements.end(), element) != elements.end();
+    return elements.has(element);
 }
 
 string Card::serialize() const {
@@ -184,38 +570,40 @@ string Card::rarityToString(Rarity rarity) const {
 }
 
 // Deck 实现
-Deck::Deck(const string& name, DeckType type) : name(name), deckType(type), maxCardLimit(20) {
-    updateDeckCode();
+Deck::Deck(const string& name, DeckType type)
+    : name(name), deckType(type), elementCounts(), typeCounts(), deckCodeDirty(true), maxCardLimit(20) {
 }
 
-void Deck::addCard(const shared_ptr<Card>& card) {
+void Deck::addCard(CardHandle handle) {
+    const Card& card = CardDatabase::instance().getCard(handle);
     // 检查标准牌组限制
-    if (deckType == +DeckType::Standard && card->getRarity() == +Rarity::Funny) {
-        cout << "标准牌组不能携带趣味稀有度的卡牌: " << card->getName() << endl;
+    if (deckType == +DeckType::Standard && card.getRarity() == +Rarity::Funny) {
+        cout << "标准牌组不能携带趣味稀有度的卡牌: " << card.getName() << endl;
         return;
     }
     
     // 检查最大卡牌数量
-    if (cards.size() >= maxCardLimit) {
+    if ((int)cards.size() >= maxCardLimit) {
         cout << "牌组已达到最大卡牌数量 (" << maxCardLimit << "张)" << endl;
         return;
     }
     
-    cards.push_back(card);
-    updateDeckElements();
-    updateDeckCode();
+    cards.push_back(handle);
+    countCard(handle, 1);
+    deckCodeDirty = true;
 }
 
 bool Deck::removeCard(const string& cardName) {
+    const CardDatabase& catalog = CardDatabase::instance();
     auto it = find_if(cards.begin(), cards.end(),
-        [&cardName](const shared_ptr<Card>& card) {
-            return card->getName() == cardName;
+        [&](CardHandle card) {
+            return catalog.getCard(card).getName() == cardName;
         });
     
     if (it != cards.end()) {
+        countCard(*it, -1);
         cards.erase(it);
-        updateDeckElements();
-        updateDeckCode();
+        deckCodeDirty = true;
         return true;
     }
     return false;
@@ -228,7 +616,7 @@ void Deck::addCharacter(const shared_ptr<Character>& character) {
     }
     
     characters.push_back(character);
-    updateDeckCode();
+    deckCodeDirty = true;
 }
 
 bool Deck::removeCharacter(const string& characterName) {
@@ -239,7 +627,7 @@ bool Deck::removeCharacter(const string& characterName) {
     
     if (it != characters.end()) {
         characters.erase(it);
-        updateDeckCode();
+        deckCodeDirty = true;
         return true;
     }
     return false;
@@ -261,22 +649,12 @@ DeckType Deck::getDeckType() const {
     return deckType;
 }
 
-string Deck::getDeckCode() const {
-    return deckCode;
-}
-
-map<Element, int> Deck::getElementDistribution() const {
-    map<Element, int> distribution;
-    for (const auto& element : deckElements) {
-        distribution[element] = 0;
-    }
-    
-    for (const auto& card : cards) {
-        for (const auto& element : card->getElements()) {
-            distribution[element]++;
-        }
+const string& Deck::getDeckCode() const {
+    if (deckCodeDirty) {
+        updateDeckCode();
+        deckCodeDirty = false;
     }
-    return distribution;
+    return deckCode;
 }
 
 void Deck::display() const {
@@ -285,24 +663,22 @@ void Deck::display() const {
     cout << "牌组类型: " << deckTypeToString() << endl;
     cout << "卡牌数量: " << cards.size() << "/" << maxCardLimit << endl;
     cout << "角色数量: " << characters.size() << "/3" << endl;
-    cout << "牌组代码: " << deckCode << endl;
+    cout << "牌组代码: " << getDeckCode() << endl;
     
-    auto distribution = getElementDistribution();
     cout << "元素分布:" << endl;
-    for (const auto& pair : distribution) {
-        cout << "  " << elementToString(pair.first) << ": " << pair.second << " 张" << endl;
-    }
-    
-    map<CardType, int> typeCount;
-    for (const auto& card : cards) {
-        typeCount[card->getType()]++;
+    for (int i = 0; i < ElementSet::MAX_ELEMENTS; ++i) {
+        if (elementCounts[i] == 0) continue;
+        cout << "  " << elementToString(Element::_from_integral(i + 1)) << ": " << elementCounts[i] << " 张" << endl;
     }
     
     cout << "类型分布:" << endl;
-    for (const auto& pair : typeCount) {
-        cout << "  " << cardTypeToString(pair.first) << ": " << pair.second << " 张" << endl;
+    for (int i = 0; i < 2; ++i) {
+        if (typeCounts[i] == 0) continue;
+        cout << "  " << cardTypeToString(CardType::_from_integral(i + 1)) << ": " << typeCounts[i] << " 张" << endl;
     }
     
+    const CardDatabase& catalog = CardDatabase::instance();
+    
     cout << "角色列表:" << endl;
     for (const auto& character : characters) {
         cout << "- " << character->getName() << " (生命:" << character->getHealth();
@@ -310,190 +686,342 @@ void Deck::display() const {
     }
     
     cout << "卡牌列表:" << endl;
-    for (const auto& card : cards) {
-        cout << "- " << card->getName() << " (费用:" << card->getCost();
+    for (CardHandle handle : cards) {
+        const Card& card = catalog.getCard(handle);
+        cout << "- " << card.getName() << " (费用:" << card.getCost();
         cout << ", 元素:";
-        for (const auto& element : card->getElements()) {
+        for (const auto& element : card.getElements()) {
             cout << elementToString(element) << " ";
         }
         cout << ")" << endl;
     }
 }
 
-// 修改shuffle方法 - 使用 Boost 随机数
-void Deck::shuffle() {
-    static boost::random::mt19937 rng(static_cast<unsigned int>(time(0)));
-    boost::random::uniform_int_distribution<> dist;
-    
-    for (size_t i = cards.size() - 1; i > 0; --i) {
-        size_t j = dist(rng) % (i + 1);
-        swap(cards[i], cards[j]);
-    }
+void Deck::shuffle(Rng& rng) {
+    rng.shuffle(cards.begin(), cards.end());
 }
 
 bool Deck::importFromDeckCode(const string& code, 
-                             const vector<shared_ptr<Card>>& allCards,
-                             const vector<shared_ptr<Character>>& allCharacters) {
-    if (!isValidDeckCode(code)) {
+                             const CardDatabase& cardDB,
+                             const CharacterDatabase& characterDB) {
+    DeckCodeParser parser(cardDB, characterDB);
+    DecodedDeck decoded;
+    if (!parser.parse(code, decoded)) {
         return false;
     }
-    
-    try {
-        string decoded = base64::decode(code);
-        size_t separator = decoded.find('|');
-        if (separator == string::npos) {
-            return false;
-        }
-        
-        string dataPart = decoded.substr(0, separator);
-        string checksum = decoded.substr(separator + 1);
-        
-        if (crc32::generate_checksum(dataPart) != checksum) {
-            return false;
-        }
-        
-        // 解析牌组数据
-        istringstream iss(dataPart);
-        string deckName, deckTypeStr;
-        getline(iss, deckName, ';');
-        getline(iss, deckTypeStr, ';');
-        
-        this->name = deckName;
-        
-        // 修改枚举初始化方式
-        int deckTypeValue = stoi(deckTypeStr);
-        if (deckTypeValue == +DeckType::Standard) {
-            this->deckType = +DeckType::Standard;
-        } else {
-            this->deckType = +DeckType::Casual;
-        }
-        
-        cards.clear();
-        characters.clear();
-        
-        // 读取角色ID
-        string characterIds;
-        getline(iss, characterIds, ';');
-        vector<string> charIdList;
-        boost::split(charIdList, characterIds, boost::is_any_of(","));
-        
-        for (const auto& charId : charIdList) {
-            if (!charId.empty()) {
-                auto character = find_if(allCharacters.begin(), allCharacters.end(),
-                    [&charId](const shared_ptr<Character>& c) {
-                        return c->getId() == charId;
-                    });
-                
-                if (character != allCharacters.end()) {
-                    characters.push_back(*character);
-                }
-            }
-        }
-        
-        // 读取卡牌ID
-        string cardIds;
-        getline(iss, cardIds, ';');
-        vector<string> cardIdList;
-        boost::split(cardIdList, cardIds, boost::is_any_of(","));
-        
-        for (const auto& cardId : cardIdList) {
-            if (!cardId.empty()) {
-                auto card = find_if(allCards.begin(), allCards.end(),
-                    [&cardId](const shared_ptr<Card>& c) {
-                        return c->getId() == cardId;
-                    });
-                
-                if (card != allCards.end()) {
-                    cards.push_back(*card);
-                }
-            }
-        }
-        
-        // 读取卡牌限制
-        string limitStr;
-        if (getline(iss, limitStr, ';')) {
-            maxCardLimit = stoi(limitStr);
-        }
-        
-        updateDeckElements();
-        deckCode = code;
-        return true;
-    } catch (...) {
-        return false;
+    assign(decoded, characterDB);
+    deckCode = code;
+    deckCodeDirty = false;
+    return true;
+}
+
+void Deck::assign(const DecodedDeck& decoded, const CharacterDatabase& characterDB) {
+    const auto& allCharacters = characterDB.getAllCharacters();
+    name = decoded.name;
+    deckType = decoded.deckType;
+    maxCardLimit = decoded.maxCardLimit;
+    characters.clear();
+    for (uint16_t index : decoded.characters) {
+        characters.push_back(allCharacters[index]);
     }
+    cards = decoded.cards;
+    recountCards();
+    deckCodeDirty = true;
 }
 
 bool Deck::isValidDeckCode(const string& code) {
-    try {
-        string decoded = base64::decode(code);
-        size_t separator = decoded.find('|');
-        if (separator == string::npos) {
-            return false;
-        }
-        
-        string dataPart = decoded.substr(0, separator);
-        string checksum = decoded.substr(separator + 1);
-        
-        return crc32::generate_checksum(dataPart) == checksum;
-    } catch (...) {
-        return false;
-    }
+    DeckCodeParser parser(CardDatabase::instance(), CharacterDatabase::instance());
+    DecodedDeck decoded;
+    return parser.parse(code, decoded);
+}
+
+DeckType Deck::parseDeckType(string_view field) {
+    // Better Enums 的流输出写入的是枚举名，旧版本也可能写入数值
+    if (field == (+DeckType::Standard)._to_string()) return +DeckType::Standard;
+    if (field == (+DeckType::Casual)._to_string()) return +DeckType::Casual;
+    while (!field.empty() && isspace(static_cast<unsigned char>(field.front()))) field.remove_prefix(1);
+    int value = 0;
+    auto result = from_chars(field.data(), field.data() + field.size(), value);
+    if (result.ec == errc() && value == +DeckType::Standard) return +DeckType::Standard;
+    return +DeckType::Casual;
 }
 
 bool Deck::isValid() const {
     return cards.size() >= 20 && characters.size() == 3;
 }
 
-void Deck::updateDeckElements() {
-    deckElements.clear();
-    vector<Element> allElements;
-    
-    for (const auto& card : cards) {
-        for (const auto& element : card->getElements()) {
-            allElements.push_back(element);
-        }
+void Deck::countCard(CardHandle handle, int delta) {
+    const Card& card = CardDatabase::instance().getCard(handle);
+    for (Element element : card.getElements()) {
+        elementCounts[element._to_integral() - 1] += delta;
     }
-    
-    sort(allElements.begin(), allElements.end());
-    auto last = unique(allElements.begin(), allElements.end());
-    allElements.erase(last, allElements.end());
-    
-    deckElements = allElements;
+    typeCounts[card.getType()._to_integral() - 1] += delta;
 }
 
-void Deck::updateDeckCode() {
-    // 构建牌组数据字符串
-    stringstream data;
-    data << name << ";";
-    data << +deckType << ";";
-    
-    // 角色ID
-    for (size_t i = 0; i < characters.size(); ++i) {
-        data << characters[i]->getId();
-        if (i < characters.size() - 1) {
-            data << ",";
+void Deck::recountCards() {
+    elementCounts.fill(0);
+    typeCounts.fill(0);
+    for (CardHandle card : cards) {
+        countCard(card, 1);
+    }
+}
+
+void Deck::updateDeckCode() const {
+    // 常见牌组直接在栈上编码，超长名称或超大牌组才退回堆缓冲
+    uint8_t buffer[512];
+    size_t length = encodeBinary(buffer, sizeof(buffer));
+    // deckCode 复用已有容量，直接编码到字符串内
+    if (length > 0) {
+        deckCode.resize(base64::encodedLength(length));
+        base64::encode(buffer, length, &deckCode[0]);
+        return;
+    }
+    vector<uint8_t> large(32 + deckcode::MAX_NAME_BYTES + 3 * 5 + cards.size() * 10);
+    length = encodeBinary(large.data(), large.size());
+    deckCode.resize(base64::encodedLength(length));
+    base64::encode(large.data(), length, &deckCode[0]);
+}
+
+// 截断到不超过 limit 字节，且不拆开 UTF-8 多字节字符
+static size_t utf8PrefixLength(const string& s, size_t limit) {
+    if (s.size() <= limit) return s.size();
+    size_t n = limit;
+    while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80) --n;
+    return n;
+}
+
+// 写入 v2 二进制牌组代码，空间不足时返回 0
+size_t Deck::encodeBinary(uint8_t* out, size_t capacity) const {
+    uint8_t* p = out;
+    uint8_t* end = out + capacity;
+    // 每次写入前预留一个 varint 的最大长度
+    auto fits = [&](size_t n) { return static_cast<size_t>(end - p) >= n; };
+
+    size_t nameLength = utf8PrefixLength(name, deckcode::MAX_NAME_BYTES);
+    if (!fits(2 + 5 * 3 + nameLength + 1)) return 0;
+    *p++ = deckcode::MAGIC_V2;
+    *p++ = static_cast<uint8_t>(deckType._to_integral());
+    p += deckcode::writeVarint(deckcode::CATALOG_VERSION, p);
+    p += deckcode::writeVarint(static_cast<uint32_t>(max(0, maxCardLimit)), p);
+    p += deckcode::writeVarint(static_cast<uint32_t>(nameLength), p);
+    memcpy(p, name.data(), nameLength);
+    p += nameLength;
+
+    *p++ = static_cast<uint8_t>(characters.size());
+    for (const auto& character : characters) {
+        if (!fits(5)) return 0;
+        p += deckcode::writeVarint(character->getIndex(), p);
+    }
+
+    // 卡牌按目录索引升序分段：相同卡牌合并为一段，段首记录与上一段的索引增量。
+    // 句柄复制到栈上排序一次，之后线性扫描出各段；超出可解码上限的牌组才退回堆缓冲
+    CardHandle stackSorted[deckcode::MAX_DECK_CARDS];
+    vector<CardHandle> heapSorted;
+    CardHandle* sorted = stackSorted;
+    if (cards.size() > deckcode::MAX_DECK_CARDS) {
+        heapSorted.resize(cards.size());
+        sorted = heapSorted.data();
+    }
+    const size_t n = cards.size();
+    copy(cards.begin(), cards.end(), sorted);
+    sort(sorted, sorted + n);
+    uint32_t runs = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (i == 0 || sorted[i] != sorted[i - 1]) ++runs;
+    }
+    if (!fits(5)) return 0;
+    p += deckcode::writeVarint(runs, p);
+    int prev = -1;
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && sorted[j] == sorted[i]) ++j;
+        if (!fits(10)) return 0;
+        p += deckcode::writeVarint(static_cast<uint32_t>(sorted[i] - prev - 1), p);
+        p += deckcode::writeVarint(static_cast<uint32_t>(j - i), p);
+        prev = sorted[i];
+        i = j;
+    }
+
+    if (!fits(4)) return 0;
+    uint32_t crc = crc32::calculate(out, static_cast<size_t>(p - out));
+    for (int i = 0; i < 4; ++i) *p++ = static_cast<uint8_t>(crc >> (8 * i));
+    return static_cast<size_t>(p - out);
+}
+
+// DeckCodeParser 实现
+DeckCodeParser::DeckCodeParser(const CardDatabase& cardDB, const CharacterDatabase& characterDB)
+    : cardDB(cardDB), characterDB(characterDB) {
+}
+
+bool DeckCodeParser::parse(string_view code, DecodedDeck& out) {
+    out.legacy = false;
+    out.name.clear();
+    out.deckType = +DeckType::Standard;
+    out.maxCardLimit = 20;
+    out.characters.clear();
+    out.cards.clear();
+
+    if (code.empty()) {
+        out.error = +DeckCodeError::Empty;
+        return false;
+    }
+    // 暂存区只增不减，同一解析器重复使用时不再分配
+    size_t needed = base64::maxDecodedLength(code.size());
+    if (scratch.size() < needed) scratch.resize(needed);
+    size_t length = 0;
+    if (!base64::decode(code.data(), code.size(), scratch.data(), scratch.size(), length)) {
+        out.error = +DeckCodeError::BadBase64;
+        return false;
+    }
+
+    if (scratch[0] == deckcode::MAGIC_V2) {
+        out.error = parseBinary(scratch.data(), length, out);
+    } else {
+        out.error = parseLegacy(string_view(reinterpret_cast<const char*>(scratch.data()), length), out);
+    }
+    return out.ok();
+}
+
+DeckCodeError DeckCodeParser::parseBinary(const uint8_t* data, size_t length, DecodedDeck& out) const {
+    if (length < 2 + 4) return +DeckCodeError::Malformed;
+    const uint8_t* c = data + length - 4;
+    uint32_t stored = c[0] | (c[1] << 8) | (c[2] << 16) | (static_cast<uint32_t>(c[3]) << 24);
+    if (crc32::calculate(data, length - 4) != stored) return +DeckCodeError::BadChecksum;
+
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + length - 4;
+    uint8_t typeValue = *p++;
+    if (typeValue != +DeckType::Standard && typeValue != +DeckType::Casual) return +DeckCodeError::BadDeckType;
+
+    uint32_t catalogVersion, limit, nameLength;
+    if (!deckcode::readVarint(p, end, catalogVersion)) return +DeckCodeError::Malformed;
+    if (catalogVersion > deckcode::CATALOG_VERSION) return +DeckCodeError::UnsupportedVersion;
+    if (!deckcode::readVarint(p, end, limit) || limit > deckcode::MAX_DECK_CARDS) return +DeckCodeError::Malformed;
+    if (!deckcode::readVarint(p, end, nameLength) || nameLength > static_cast<size_t>(end - p)) {
+        return +DeckCodeError::Malformed;
+    }
+    out.name.assign(reinterpret_cast<const char*>(p), nameLength);
+    p += nameLength;
+
+    if (p >= end) return +DeckCodeError::Malformed;
+    uint8_t characterCount = *p++;
+    if (characterCount > 3) return +DeckCodeError::TooManyCards;
+    size_t characterTotal = characterDB.getAllCharacters().size();
+    for (uint8_t i = 0; i < characterCount; ++i) {
+        uint32_t index;
+        if (!deckcode::readVarint(p, end, index)) return +DeckCodeError::Malformed;
+        if (index >= characterTotal) return +DeckCodeError::UnknownCharacter;
+        out.characters.push_back(static_cast<uint16_t>(index));
+    }
+
+    uint32_t runs;
+    if (!deckcode::readVarint(p, end, runs)) return +DeckCodeError::Malformed;
+    uint64_t index = 0;
+    for (uint32_t r = 0; r < runs; ++r) {
+        uint32_t delta, count;
+        if (!deckcode::readVarint(p, end, delta) || !deckcode::readVarint(p, end, count) || count == 0) {
+            return +DeckCodeError::Malformed;
         }
+        index += (r == 0 ? 0 : 1) + delta;
+        if (index >= cardDB.getCardCount()) return +DeckCodeError::UnknownCard;
+        if (out.cards.size() + count > deckcode::MAX_DECK_CARDS) return +DeckCodeError::TooManyCards;
+        out.cards.insert(out.cards.end(), count, static_cast<CardHandle>(index));
     }
-    data << ";";
-    
-    // 卡牌ID
-    for (size_t i = 0; i < cards.size(); ++i) {
-        data << cards[i]->serialize();
-        if (i < cards.size() - 1) {
-            data << ",";
+    if (p != end) return +DeckCodeError::Malformed;
+
+    out.deckType = DeckType::_from_integral(typeValue);
+    out.maxCardLimit = static_cast<int>(limit);
+    return +DeckCodeError::None;
+}
+
+// 与 getline 相同：剩余为空时返回 false，否则取出到下一个分隔符为止的字段
+static bool takeField(string_view& rest, char delimiter, string_view& field) {
+    if (rest.empty()) return false;
+    size_t end = rest.find(delimiter);
+    field = rest.substr(0, end);
+    rest = (end == string_view::npos) ? string_view() : rest.substr(end + 1);
+    return true;
+}
+
+// 遍历逗号分隔的 ID 列表，lookup 返回是否找到。旧版导出没有转义 ID 中的逗号
+// （如 "Lazarus,Arise!"），查不到的片段会依次并入后续片段重试
+template <typename Lookup>
+static void forEachLegacyId(string_view list, Lookup lookup) {
+    const int MAX_PIECES = 3;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == string_view::npos) end = list.size();
+        if (end > pos && !lookup(list.substr(pos, end - pos))) {
+            size_t merged = end;
+            for (int piece = 1; piece < MAX_PIECES && merged < list.size(); ++piece) {
+                merged = list.find(',', merged + 1);
+                if (merged == string_view::npos) merged = list.size();
+                if (lookup(list.substr(pos, merged - pos))) {
+                    end = merged;
+                    break;
+                }
+            }
         }
+        pos = end + 1;
+    }
+}
+
+// 旧版文本格式: name;type;charIds;cardIds;maxLimit;|crc
+DeckCodeError DeckCodeParser::parseLegacy(string_view text, DecodedDeck& out) const {
+    out.legacy = true;
+    size_t separator = text.find('|');
+    if (separator == string_view::npos) return +DeckCodeError::Malformed;
+    if (!crc32::verify_checksum(text.data(), separator, text.substr(separator + 1))) {
+        return +DeckCodeError::BadChecksum;
+    }
+
+    string_view rest = text.substr(0, separator);
+    string_view deckName, deckType, characterIds, cardIds, limit;
+    if (!takeField(rest, ';', deckName) || !takeField(rest, ';', deckType) ||
+        !takeField(rest, ';', characterIds) || !takeField(rest, ';', cardIds)) {
+        return +DeckCodeError::Malformed;
+    }
+    if (takeField(rest, ';', limit)) {
+        auto result = from_chars(limit.data(), limit.data() + limit.size(), out.maxCardLimit);
+        if (result.ec != errc() || out.maxCardLimit < 0) return +DeckCodeError::Malformed;
+    }
+    out.name.assign(deckName.data(), deckName.size());
+    out.deckType = Deck::parseDeckType(deckType);
+
+    // 旧版导入会跳过目录中已不存在的 ID，这里保持一致
+    bool tooMany = false;
+    forEachLegacyId(characterIds, [&](string_view id) {
+        uint16_t index = characterDB.findIndexById(id);
+        if (index == FlatStringIndex::NOT_FOUND) return false;
+        if (out.characters.size() >= 3) tooMany = true;
+        else out.characters.push_back(index);
+        return true;
+    });
+    forEachLegacyId(cardIds, [&](string_view id) {
+        CardHandle handle = cardDB.findHandleById(id);
+        if (handle == FlatStringIndex::NOT_FOUND) return false;
+        if (out.cards.size() >= deckcode::MAX_DECK_CARDS) tooMany = true;
+        else out.cards.push_back(handle);
+        return true;
+    });
+    return tooMany ? +DeckCodeError::TooManyCards : +DeckCodeError::None;
+}
+
+const char* DeckCodeParser::describe(DeckCodeError error) {
+    switch (error) {
+        case +DeckCodeError::None: return "成功";
+        case +DeckCodeError::Empty: return "牌组代码为空";
+        case +DeckCodeError::BadBase64: return "不是合法的牌组代码";
+        case +DeckCodeError::BadChecksum: return "校验和不匹配";
+        case +DeckCodeError::Malformed: return "数据字段不完整或格式错误";
+        case +DeckCodeError::UnsupportedVersion: return "牌组代码来自更新版本的游戏";
+        case +DeckCodeError::BadDeckType: return "未知的牌组类型";
+        case +DeckCodeError::UnknownCharacter: return "包含未知角色";
+        case +DeckCodeError::UnknownCard: return "包含未知卡牌";
+        case +DeckCodeError::TooManyCards: return "角色或卡牌数量超出上限";
+        default: return "未知错误";
     }
-    data << ";";
-    
-    // 卡牌限制
-    data << maxCardLimit << ";";
-    
-    string dataStr = data.str();
-    string checksum = crc32::generate_checksum(dataStr);
-    
-    // 进行Base64编码
-    string combined = dataStr + "|" + checksum;
-    deckCode = base64::encode(combined);
 }
 
 string Deck::elementToString(Element element) const {
@@ -528,50 +1056,62 @@ string Deck::deckTypeToString() const {
 // CharacterDatabase 实现
 CharacterDatabase::CharacterDatabase() {
     initializeCharacters();
+    buildIndexes();
+}
+
+const CharacterDatabase& CharacterDatabase::instance() {
+    static const CharacterDatabase database;
+    return database;
+}
+
+void CharacterDatabase::buildIndexes() {
+    vector<string_view> ids, names;
+    for (const auto& character : allCharacters) {
+        ids.push_back(character->id);
+        names.push_back(character->name);
+    }
+    idIndex.build(ids);
+    nameIndex.build(names);
 }
 
 void CharacterDatabase::initializeCharacters() {
     // 初始化人物
     allCharacters.push_back(make_shared<Character>(
         "xxmlt", "金天", 
-        vector<Element>{+Element::Water}, 25, 15,
+        ElementSet{+Element::Water}, 25, 15,
         "治疗", "消耗5点魔力，指定一个友方目标获得5点生命值。",
         "死生", "\033[1m每局对战限一次\033[0m，当我方人物受到致命伤时，不使其下场,而是使生命值降为1。"
     ));
     allCharacters.push_back(make_shared<Character>(
         "neko", "三金", 
-        vector<Element>{+Element::Wind}, 20, 25,
+        ElementSet{+Element::Wind}, 20, 25,
         "吹飞", "消耗10点魔力，选择一项：指定一个对方目标下场；或令一个效果消失。",
         "",""
     ));
     allCharacters.push_back(make_shared<Character>(
         "soybeanmilk", "江源", 
-        vector<Element>{+Element::Light}, 20, 20,
+        ElementSet{+Element::Light}, 20, 20,
         "恢复", "消耗10点魔力将场上存在的其他人或魔物状态恢复至上回合结束时。（第二回合解锁）",
         "无","\033[3m什么？都能回溯了你还想要被动？\033[0m"
     ));
+
+    for (size_t i = 0; i < allCharacters.size(); ++i) {
+        allCharacters[i]->index = static_cast<uint16_t>(i);
+    }
 }
 
 const vector<shared_ptr<Character>>& CharacterDatabase::getAllCharacters() const {
     return allCharacters;
 }
 
-shared_ptr<Character> CharacterDatabase::findCharacter(const string& name) const {
-    auto it = find_if(allCharacters.begin(), allCharacters.end(),
-        [&name](const shared_ptr<Character>& character) {
-            return character->getName() == name;
-        });
-    
-    return (it != allCharacters.end()) ? *it : nullptr;
+shared_ptr<Character> CharacterDatabase::findCharacter(string_view name) const {
+    uint16_t i = nameIndex.find(name);
+    return (i != FlatStringIndex::NOT_FOUND) ? allCharacters[i] : nullptr;
 }
 
-shared_ptr<Character> CharacterDatabase::findCharacterById(const string& id) const {
-    auto it = find_if(allCharacters.begin(), allCharacters.end(),
-        [&id](const shared_ptr<Character>& character) {
-            return character->getId() == id;
-        });
-    
-    return (it != allCharacters.end()) ? *it : nullptr;
+shared_ptr<Character> CharacterDatabase::findCharacterById(string_view id) const {
+    uint16_t i = idIndex.find(id);
+    return (i != FlatStringIndex::NOT_FOUND) ? allCharacters[i] : nullptr;
 }
 
 vector<shared_ptr<Character>> CharacterDatabase::getCharactersByElement(Element element) const {
@@ -587,6 +1127,23 @@ vector<shared_ptr<Character>> CharacterDatabase::getCharactersByElement(Element
 // CardDatabase 实现
 CardDatabase::CardDatabase() {
     initializeCards();
+    buildIndexes();
+}
+
+const CardDatabase& CardDatabase::instance() {
+    static const CardDatabase database;
+    return database;
+}
+
+void CardDatabase::buildIndexes() {
+    vector<string_view> ids, names;
+    for (const auto& card : allCards) {
+        ids.push_back(card->id);
+        names.push_back(card->name);
+    }
+    idIndex.build(ids);
+    nameIndex.build(names);
+    columns.build(allCards);
 }
 
 void CardDatabase::initializeCards() {
@@ -594,140 +1151,3442 @@ void CardDatabase::initializeCards() {
 
     allCards.push_back(make_shared<Card>(
         "madposion", "狂乱药水", 
-        vector<Element>{+Element::Water}, 15, Rarity::Mythic,
+        ElementSet{+Element::Water}, 15, Rarity::Mythic,
         "本回合中，目标人物卡牌释放三次，在其魔力不足时以三倍于魔力值消耗的生命替代。"
     ));
 	allCards.push_back(make_shared<Card>(
         "organichemistry", "魔药学领城大神！", 
-        vector<Element>{+Element::Water}, 9, Rarity::Mythic,
+        ElementSet{+Element::Water}, 9, Rarity::Mythic,
         "本局对战中，你的药水魔力消耗减少（2）。随机获取3张药水。"
     ));
 	allCards.push_back(make_shared<Card>(
         "slowdown", "缓慢药水", 
-        vector<Element>{+Element::Water}, 5, Rarity::Rare,
+        ElementSet{+Element::Water}, 5, Rarity::Rare,
         "直到你的下个回合，你对手的牌魔力消耗增加（2）。"
     ));
 	allCards.push_back(make_shared<Card>(
         "Timeelder", "时空限速", 
-        vector<Element>{+Element::Dark}, 5, Rarity::Rare,
+        ElementSet{+Element::Dark}, 5, Rarity::Rare,
         "直到你的下个回合，你对手不能使用5张以上的牌。（已使用%d张）"
     ));
 	allCards.push_back(make_shared<Card>(
         "LGBTQ", "多彩药水", 
-        vector<Element>{+Element::Water}, 3, Rarity::Rare,
+        ElementSet{+Element::Water}, 3, Rarity::Rare,
         "本回合中，你的牌是所有属性。"
     ));
 	allCards.push_back(make_shared<Card>(
         "Lazarus,Arise!", "起尸", 
-        vector<Element>{+Element::Dark}, 2, Rarity::Rare,
+        ElementSet{+Element::Dark}, 2, Rarity::Rare,
         "复活一个人物，并具有25%的生命（向下取整），在你的的结束时，将其消灭。如果其已死亡，致为使其无法复活。"
     ));
 	allCards.push_back(make_shared<Card>(
         "DontForgotMe", "瓶装记忆", 
-        vector<Element>{+Element::Water}, 5, Rarity::Rare,
+        ElementSet{+Element::Water}, 5, Rarity::Rare,
         "这张牌是药水。将目标玩家卡组中的8张牌洗入你的牌库，其魔力消耗减少（2）。"
     ));
 	allCards.push_back(make_shared<Card>(
         "TheCardLetMeWin", "记忆屏蔽", 
-        vector<Element>{+Element::Water}, 6, Rarity::Rare,
+        ElementSet{+Element::Water}, 6, Rarity::Rare,
         "摧毁你对手牌库顶和底各2张牌。"
     ));
 	allCards.push_back(make_shared<Card>(
         "TheCardLetYouLose", "记忆摧毁", 
-        vector<Element>{+Element::Water}, 2, Rarity::Rare,
+        ElementSet{+Element::Water}, 2, Rarity::Rare,
         "摧毁\033[3m你\033[0m和对手牌库顶和底各2张牌。然后如果你的牌库为空，你输掉游戏。"
     ));
 	allCards.push_back(make_shared<Card>(
         "whAt", "你说啥？", 
-        vector<Element>{+Element::Water}, 2, Rarity::Rare,
+        ElementSet{+Element::Water}, 2, Rarity::Rare,
         "摧毁对手牌库中的1张牌。然后摧毁所有同名卡（无论其在哪里）。"
     ));
 	allCards.push_back(make_shared<Card>(
         "balance", "平衡", 
-        vector<Element>{+Element::Light, +Element::Dark}, 4, Rarity::Rare,
+        ElementSet{+Element::Light, +Element::Dark}, 4, Rarity::Rare,
         "弃掉你的手牌。抽等量的牌。"
     ));
 	allCards.push_back(make_shared<Card>(
         "TearAll", "遗忘灵药", 
-        vector<Element>{+Element::Water, +Element::Dark}, 18, Rarity::Rare,
+        ElementSet{+Element::Water, +Element::Dark}, 18, Rarity::Rare,
         "摧毁你对手的牌库。将你对手弃牌堆中的10张牌洗入其牌库，它们的魔力消耗增加（2）。"
     ));
 	allCards.push_back(make_shared<Card>(
         "Wordle", "Wordle", 
-        vector<Element>{+Element::Physical}, 4, Rarity::Funny,
+        ElementSet{+Element::Physical}, 4, Rarity::Funny,
         "使你对手下回合造成的伤害额外乘上今日Wordle的通关率。"
     ));
 	allCards.push_back(make_shared<Card>(
         "IDontcar", "窝不载乎", 
-        vector<Element>{+Element::Physical}, 2, Rarity::Funny,
+        ElementSet{+Element::Physical}, 2, Rarity::Funny,
         "你的对手发送的表情改为汽车鸣笛声。\033[3m呜呜呜！\033[0m"
     ));
+
+    // 目录索引即加入顺序：新卡牌只能追加到末尾，否则旧牌组代码会指向错误的卡牌
+    for (size_t i = 0; i < allCards.size(); ++i) {
+        allCards[i]->handle = static_cast<CardHandle>(i);
+    }
 }
 
 const vector<shared_ptr<Card>>& CardDatabase::getAllCards() const {
     return allCards;
 }
 
-shared_ptr<Card> CardDatabase::findCard(const string& name) const {
-    auto it = find_if(allCards.begin(), allCards.end(),
-        [&name](const shared_ptr<Card>& card) {
-            return card->getName() == name;
-        });
-    
-    return (it != allCards.end()) ? *it : nullptr;
+shared_ptr<Card> CardDatabase::findCard(string_view name) const {
+    uint16_t i = nameIndex.find(name);
+    return (i != FlatStringIndex::NOT_FOUND) ? allCards[i] : nullptr;
 }
 
-shared_ptr<Card> CardDatabase::findCardById(const string& id) const {
-    auto it = find_if(allCards.begin(), allCards.end(),
-        [&id](const shared_ptr<Card>& card) {
-            return card->getId() == id;
-        });
-    
-    return (it != allCards.end()) ? *it : nullptr;
+shared_ptr<Card> CardDatabase::findCardById(string_view id) const {
+    uint16_t i = idIndex.find(id);
+    return (i != FlatStringIndex::NOT_FOUND) ? allCards[i] : nullptr;
+}
+
+CardSelection CardDatabase::select(const CardQuery& query) const {
+    CardSelection selection;
+    columns.select(query, selection);
+    return selection;
 }
 
 vector<shared_ptr<Card>> CardDatabase::getCardsByType(CardType type) const {
+    CardQuery query;
+    query.type = type;
     vector<shared_ptr<Card>> result;
-    for (const auto& card : allCards) {
-        if (card->getType() == type) {
-            result.push_back(card);
-        }
-    }
+    for (CardHandle handle : select(query)) result.push_back(allCards[handle]);
     return result;
 }
 
 vector<shared_ptr<Card>> CardDatabase::getCardsByElement(Element element) const {
+    CardQuery query;
+    query.anyElements = ElementSet{element};
     vector<shared_ptr<Card>> result;
-    for (const auto& card : allCards) {
-        if (card->hasElement(element)) {
-            result.push_back(card);
-        }
-    }
+    for (CardHandle handle : select(query)) result.push_back(allCards[handle]);
     return result;
 }
 
 vector<shared_ptr<Card>> CardDatabase::getCardsByRarity(Rarity rarity) const {
+    CardQuery query;
+    query.rarity = rarity;
     vector<shared_ptr<Card>> result;
-    for (const auto& card : allCards) {
-        if (card->getRarity() == rarity) {
-            result.push_back(card);
-        }
-    }
+    for (CardHandle handle : select(query)) result.push_back(allCards[handle]);
     return result;
 }
 
-// GameManager 实现
-void GameManager::displayAllCards() const {
-    cout << "=== 所有卡牌 ===" << endl;
-    for (const auto& card : cardDB.getAllCards()) {
-        card->display();
+// CardSelection 实现
+size_t CardSelection::count() const {
+    size_t n = 0;
+    for (uint64_t w : words) n += __builtin_popcountll(w);
+    return n;
+}
+
+// CardColumns 实现
+void CardColumns::build(const vector<shared_ptr<Card>>& cards) {
+    count = cards.size();
+    size_t padded = (count + LANES - 1) / LANES * LANES;
+    // 补齐部分的类型与稀有度为 0，不会匹配任何限定类型/稀有度的查询，其余情况由位图尾部掩码剔除
+    cost.assign(padded, 0);
+    rarity.assign(padded, 0);
+    type.assign(padded, 0);
+    elements.assign(padded, 0);
+    attack.assign(padded, 0);
+    defense.assign(padded, 0);
+    health.assign(padded, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const Card& card = *cards[i];
+        cost[i] = static_cast<uint8_t>(min(255, max(0, card.getCost())));
+        rarity[i] = static_cast<uint8_t>(card.getRarity()._to_integral());
+        type[i] = static_cast<uint8_t>(card.getType()._to_integral());
+        elements[i] = card.getElements().mask();
+        attack[i] = static_cast<int16_t>(card.getAttack());
+        defense[i] = static_cast<int16_t>(card.getDefense());
+        health[i] = static_cast<int16_t>(card.getHealth());
     }
 }
 
-void GameManager::displayAllCharacters() const {
-    cout << "=== 所有角色 ===" << endl;
-    for (const auto& character : characterDB.getAllCharacters()) {
-        character->display();
+void CardColumns::select(const CardQuery& query, CardSelection& out) const {
+    size_t wordCount = (count + 63) / 64;
+    out.words.assign(wordCount, 0);
+    out.limit = count;
+    if (count == 0) return;
+
+    uint8_t minCost = static_cast<uint8_t>(min(255, max(0, query.minCost)));
+    uint8_t maxCost = static_cast<uint8_t>(min(255, max(0, query.maxCost)));
+    uint8_t anyMask = query.anyElements.mask();
+    uint8_t allMask = query.allElements.mask();
+    size_t padded = cost.size();
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_cmpeq_epi8(zero, zero);
+    const __m128i vType = _mm_set1_epi8(static_cast<char>(query.type));
+    const __m128i vRarity = _mm_set1_epi8(static_cast<char>(query.rarity));
+    const __m128i vMinCost = _mm_set1_epi8(static_cast<char>(minCost));
+    const __m128i vMaxCost = _mm_set1_epi8(static_cast<char>(maxCost));
+    const __m128i vAny = _mm_set1_epi8(static_cast<char>(anyMask));
+    const __m128i vAll = _mm_set1_epi8(static_cast<char>(allMask));
+    const __m128i vAttack = _mm_set1_epi16(static_cast<short>(query.minAttack - 1));
+    const __m128i vDefense = _mm_set1_epi16(static_cast<short>(query.minDefense - 1));
+    const __m128i vHealth = _mm_set1_epi16(static_cast<short>(query.minHealth - 1));
+    // 16 位列比较得到两组 8 道结果，饱和打包成 16 道字节掩码
+    auto atLeast16 = [](const int16_t* column, __m128i threshold) {
+        __m128i lo = _mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(column)), threshold);
+        __m128i hi = _mm_cmpgt_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(column + 8)), threshold);
+        return _mm_packs_epi16(lo, hi);
+    };
+
+    for (size_t i = 0; i < padded; i += LANES) {
+        __m128i m = ones;
+        if (query.type != 0)
+            m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&type[i])), vType));
+        if (query.rarity != 0)
+            m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&rarity[i])), vRarity));
+        if (minCost > 0 || maxCost < 255) {
+            // 无符号范围比较：x >= lo 等价于 max(x, lo) == x
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&cost[i]));
+            m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(c, vMinCost), c));
+            m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(c, vMaxCost), c));
+        }
+        if (anyMask != 0 || allMask != 0) {
+            __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&elements[i]));
+            if (anyMask != 0) m = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_and_si128(e, vAny), zero), m);
+            if (allMask != 0) m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_and_si128(e, vAll), vAll));
+        }
+        if (query.minAttack > 0) m = _mm_and_si128(m, atLeast16(&attack[i], vAttack));
+        if (query.minDefense > 0) m = _mm_and_si128(m, atLeast16(&defense[i], vDefense));
+        if (query.minHealth > 0) m = _mm_and_si128(m, atLeast16(&health[i], vHealth));
+
+        uint64_t bits = static_cast<uint16_t>(_mm_movemask_epi8(m));
+        out.words[i / 64] |= bits << (i % 64);
+    }
+#else
+    (void)padded;
+    for (size_t i = 0; i < count; ++i) {
+        bool match = (query.type == 0 || type[i] == query.type)
+            && (query.rarity == 0 || rarity[i] == query.rarity)
+            && cost[i] >= minCost && cost[i] <= maxCost
+            && (anyMask == 0 || (elements[i] & anyMask) != 0)
+            && (elements[i] & allMask) == allMask
+            && (query.minAttack <= 0 || attack[i] >= query.minAttack)
+            && (query.minDefense <= 0 || defense[i] >= query.minDefense)
+            && (query.minHealth <= 0 || health[i] >= query.minHealth);
+        if (match) out.words[i / 64] |= uint64_t(1) << (i % 64);
+    }
+#endif
+
+    // 剔除补齐部分
+    if (count % 64 != 0) out.words[wordCount - 1] &= (uint64_t(1) << (count % 64)) - 1;
+}
+
+// Action 实现
+Action Action::playCard(int handIndex, int actorIndex, bool targetIsBase, int targetIndex) {
+    Action a;
+    a.type = +ActionType::PlayCard;
+    a.handIndex = handIndex;
+    a.actorIndex = actorIndex;
+    a.targetIsBase = targetIsBase;
+    a.targetIndex = targetIsBase ? -1 : targetIndex;
+    return a;
+}
+
+Action Action::endTurn() {
+    return Action();
+}
+
+Action Action::quit() {
+    Action a;
+    a.type = +ActionType::Quit;
+    return a;
+}
+
+// 卡牌效果实现
+static void drawFromDeck(PlayerState& p, int n) {
+    // 手牌已满时停止抽牌，剩余的牌留在牌库
+    for (int i = 0; i < n && !p.deck.empty(); ++i) {
+        if (!p.hand.push_back(p.deck.back())) break;
+        p.deck.pop_back();
+    }
+}
+
+void EffectContext::draw(PlayerState& player, int n) const {
+    drawFromDeck(player, n);
+}
+
+bool EffectContext::linger() const {
+    CardHandle handle = card.getHandle();
+    if (find(owner.lasting.begin(), owner.lasting.end(), handle) != owner.lasting.end()) return true;
+    return owner.lasting.push_back(handle);
+}
+
+// 药水牌：名称带“药水”或描述注明“这张牌是药水”，卡牌库不可变，只需统计一次
+static const vector<CardHandle>& potionCards() {
+    static const vector<CardHandle> potions = [] {
+        vector<CardHandle> out;
+        for (const auto& card : CardDatabase::instance().getAllCards()) {
+            if (card->getName().find("药水") != string::npos ||
+                card->getDescription().find("这张牌是药水") != string::npos) out.push_back(card->getHandle());
+        }
+        return out;
+    }();
+    return potions;
+}
+
+namespace {
+    void wordle(EffectContext& ctx) {
+        ctx.damage *= 2; ctx.logLine("[效果] Wordle: 伤害翻倍！");
+    }
+    void iDontCare(EffectContext& ctx) {
+        ctx.logLine("[效果] 窝不载乎：对手似乎被汽车鸣笛分散了注意力。");
+    }
+    void madPotion(EffectContext& ctx) {
+        ctx.damage *= 3; ctx.logLine("[效果] 狂乱药水：伤害×3（简化）。");
+    }
+    void organicChemistry(EffectContext& ctx) {
+        const auto& potions = potionCards();
+        if (potions.empty()) return;
+        for (int i = 0; i < 3; ++i) {
+            if (ctx.owner.hand.full()) { ctx.logLine("[效果] 魔药学：手牌已满，无法再获得药水。"); break; }
+            CardHandle potion = potions[ctx.state.rng.below((uint32_t)potions.size())];
+            ctx.owner.hand.push_back(potion);
+            ctx.logLine("[效果] 魔药学：获得药水 ", CardDatabase::instance().getCard(potion).getName(), "。");
+        }
+    }
+    void slowdown(EffectContext& ctx) {
+        int dec = 2; ctx.opponent.baseMana = max(0, ctx.opponent.baseMana - dec); ctx.logLine("[效果] 缓慢药水：对手基地魔力 -", dec, "。");
+    }
+    const int TIME_ELDER_PLAYS = 5;
+
+    void timeElder(EffectContext& ctx) {
+        if (!ctx.linger()) { ctx.logLine("[效果] 时空限速：持续效果已满，未生效。"); return; }
+        PlayerState& opp = ctx.opponent;
+        if (opp.playsLeft < 0 || opp.playsLeft > TIME_ELDER_PLAYS) opp.playsLeft = TIME_ELDER_PLAYS;
+        ctx.logLine("[效果] 时空限速：直到你的下个回合，对手最多再打出 ", opp.playsLeft, " 张牌。");
+    }
+    void timeElderExpire(EffectContext& ctx) {
+        ctx.opponent.playsLeft = -1;
+        ctx.logLine("[效果] 时空限速结束：对手不再受出牌数量限制。");
+    }
+    void rainbowPotion(EffectContext& ctx) {
+        ctx.owner.baseMana += 1000; ctx.logLine("[效果] 多彩药水：本回合获得属性适配（简化）。");
+    }
+    void lazarus(EffectContext& ctx) {
+        ctx.owner.baseHP += 5; ctx.logLine("[效果] 起尸：基地回复5生命（简化）。");
+    }
+    void dontForgetMe(EffectContext& ctx) {
+        PlayerState& owner = ctx.owner;
+        PlayerState& opp = ctx.opponent;
+        // 移入的张数受我方牌库剩余容量限制
+        int room = (int)(owner.deck.capacity() - owner.deck.size());
+        int move = min({ 8, (int)opp.deck.size(), room });
+        int discounted = 0;
+        for (int i = 0; i < move; ++i) {
+            if (owner.discounted.push_back(opp.deck.back())) ++discounted;
+            owner.deck.push_back(opp.deck.back());
+            opp.deck.pop_back();
+        }
+        ctx.logLine("[效果] 瓶装记忆：将对手牌库顶最多 ", move, " 张牌移入我的牌库（简化），其中 ", discounted, " 张魔力消耗减少（2）。");
+        if (discounted < move)
+            ctx.logLine("[效果] 瓶装记忆：减费记录已满（", MAX_DISCOUNTED_CARDS, " 项），其余 ", move - discounted, " 张不减费。");
+    }
+    void memoryShield(EffectContext& ctx) {
+        PlayerState& opp = ctx.opponent;
+        for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.pop_back();
+        for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.erase(opp.deck.begin());
+        ctx.logLine("[效果] 记忆屏蔽：摧毁对手牌库顶/底各2张（简化）。");
+    }
+    void memoryWipe(EffectContext& ctx) {
+        PlayerState& owner = ctx.owner;
+        PlayerState& opp = ctx.opponent;
+        for (int i = 0; i < 2 && !owner.deck.empty(); ++i) owner.deck.pop_back();
+        for (int i = 0; i < 2 && !owner.deck.empty(); ++i) owner.deck.erase(owner.deck.begin());
+        for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.pop_back();
+        for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.erase(opp.deck.begin());
+        if (owner.deck.empty()) owner.baseHP = 0;
+        ctx.logLine("[效果] 记忆摧毁：双方顶底各2张，被激活后若你的牌库为空你输（简化）。");
+    }
+    void what(EffectContext& ctx) {
+        PlayerState& opp = ctx.opponent;
+        if (!opp.deck.empty()) { ctx.logLine("[效果] 你说啥？：摧毁对手一张牌 ", CardDatabase::instance().getCard(opp.deck.back()).getName(), "（顶）。"); opp.deck.pop_back(); }
+    }
+    void balance(EffectContext& ctx) {
+        int n = ctx.owner.hand.size(); ctx.owner.hand.clear(); ctx.draw(ctx.owner, n); ctx.logLine("[效果] 平衡：弃手并抽等量的牌（简化）。");
+    }
+    void tearAll(EffectContext& ctx) {
+        ctx.opponent.deck.clear(); ctx.logLine("[效果] 遗忘灵药：摧毁对手牌库（简化）。");
+    }
+
+    struct EffectEntry {
+        const char* cardId;
+        EffectTrigger trigger;
+        CardEffect effect;
+    };
+
+    const EffectEntry EFFECT_ENTRIES[] = {
+        { "Wordle",            +EffectTrigger::OnPlay, wordle },
+        { "IDontcar",          +EffectTrigger::OnPlay, iDontCare },
+        { "madposion",         +EffectTrigger::OnPlay, madPotion },
+        { "organichemistry",   +EffectTrigger::OnPlay, organicChemistry },
+        { "slowdown",          +EffectTrigger::OnPlay, slowdown },
+        { "Timeelder",         +EffectTrigger::OnPlay, timeElder },
+        { "Timeelder",         +EffectTrigger::TurnStart, timeElderExpire },
+        { "LGBTQ",             +EffectTrigger::OnPlay, rainbowPotion },
+        { "Lazarus,Arise!",    +EffectTrigger::OnPlay, lazarus },
+        { "DontForgotMe",      +EffectTrigger::OnPlay, dontForgetMe },
+        { "TheCardLetMeWin",   +EffectTrigger::OnPlay, memoryShield },
+        { "TheCardLetYouLose", +EffectTrigger::OnPlay, memoryWipe },
+        { "whAt",              +EffectTrigger::OnPlay, what },
+        { "balance",           +EffectTrigger::OnPlay, balance },
+        { "TearAll",           +EffectTrigger::OnPlay, tearAll },
+    };
+}
+
+CardEffects::CardEffects() {
+    const CardDatabase& catalog = CardDatabase::instance();
+    table.assign(catalog.getCardCount(), {});
+    for (const EffectEntry& entry : EFFECT_ENTRIES) {
+        CardHandle handle = catalog.findHandleById(entry.cardId);
+        if (handle == FlatStringIndex::NOT_FOUND) continue;
+        table[handle][entry.trigger._to_integral()] = entry.effect;
+    }
+}
+
+const CardEffects& CardEffects::instance() {
+    static const CardEffects effects;
+    return effects;
+}
+
+// MatchEngine 实现
+MatchEngine::MatchEngine(const PlayerSetup& first, const PlayerSetup& second,
+                         uint64_t seed, std::ostream* log)
+    : catalog(CardDatabase::instance()), effects(CardEffects::instance()), log(log) {
+    history.reserve(64);
+    start(first, second, seed);
+}
+
+void MatchEngine::start(const PlayerSetup& first, const PlayerSetup& second, uint64_t seed) {
+    state = GameState();
+    state.rng.seed(seed);
+    history.clear();
+
+    const PlayerSetup* setups[2] = { &first, &second };
+    for (int i = 0; i < 2; ++i) {
+        PlayerState& p = state.players[i];
+        names[i] = setups[i]->name;
+        for (const auto& ch : setups[i]->characters) {
+            if (!ch || p.chars.size() >= 3) continue;
+            PlayerCharState pcs;
+            pcs.ch = ch.get();
+            pcs.curHP = ch->getHealth();
+            pcs.curEnergy = (ch->getEnergy() + 1) / 2;
+            p.chars.push_back(pcs);
+        }
+        p.deck.assign(setups[i]->deck.begin(), setups[i]->deck.end());
+        state.rng.shuffle(p.deck.begin(), p.deck.end());
+        drawCards(p, 3);
+    }
+
+    beginTurn();
+}
+
+bool MatchEngine::restoreTurn(int turn) {
+    if (turn < 1 || turn > (int)history.size()) return false;
+    state = history[turn - 1];
+    history.resize(turn);
+    return true;
+}
+
+void MatchEngine::reset(const GameState& s, uint64_t seed) {
+    state = s;
+    state.rng.seed(seed);
+    history.clear();
+}
+
+bool MatchEngine::isMage(const Character& character) {
+    // 拥有除物理外的元素即为法师
+    return character.getElements().hasOtherThan(+Element::Physical);
+}
+
+void MatchEngine::drawCards(PlayerState& p, int n) {
+    drawFromDeck(p, n);
+}
+
+void MatchEngine::beginTurn() {
+    PlayerState& cur = state.players[state.active];
+    logLine("\n=== 回合 ", state.turn, " - ", nameOf(cur), " 的回合开始 ===");
+    if (!cur.deck.empty()) { drawCards(cur, 1); logLine(nameOf(cur), " 抽了1张牌。"); }
+    else logLine(nameOf(cur), " 的牌库已空，无法抽牌。");
+
+    cur.baseMana = min(30, cur.baseMana + 5);
+    for (auto& pcs : cur.chars) { int maxE = pcs.ch->getEnergy(); pcs.curEnergy = min(maxE, pcs.curEnergy + 5); }
+    // 上回合登记的持续效果在此结束
+    triggerLasting(cur, EffectTrigger::TurnStart, -1, 0);
+    cur.lasting.clear();
+    if (recordHistory) history.push_back(state);
+}
+
+// 对 owner 登记的持续效果派发一个触发时机
+void MatchEngine::triggerLasting(PlayerState& owner, EffectTrigger trigger, int target, int damage) {
+    if (owner.lasting.empty()) return;
+    PlayerState& opp = state.players[&owner == &state.players[0] ? 1 : 0];
+    for (CardHandle handle : owner.lasting) {
+        if (CardEffect effect = effects.find(handle, trigger)) {
+            EffectContext ctx(state, owner, opp, catalog.getCard(handle), log);
+            ctx.target = target;
+            ctx.damage = damage;
+            effect(ctx);
+        }
+    }
+}
+
+// 替补上阵（前场 deadIndex 位置死亡，用后场替补到该位置）
+void MatchEngine::tryReplaceDead(PlayerState& p, int deadIndex) {
+    if (deadIndex < 0 || deadIndex > 1) return;
+    if (p.chars.size() == 3) {
+        p.chars[deadIndex] = p.chars[2];
+        p.chars.pop_back();
+        logLine(nameOf(p), " 的后场角色已替补到前场位置 ", deadIndex + 1, "。");
+    }
+}
+
+// 应用伤害到目标角色，并处理溢出到基地与替补上阵
+void MatchEngine::applyDamageToChar(PlayerState& owner, int idx, int dmg, bool isMagic) {
+    if (idx < 0 || idx > 1) return;
+    if (idx >= (int)owner.chars.size()) return;
+    PlayerCharState& t = owner.chars[idx];
+    if (isMagic && isMage(*t.ch)) {
+        int energyTaken = min(t.curEnergy, dmg);
+        t.curEnergy -= energyTaken;
+        dmg -= energyTaken;
+    }
+    if (dmg > 0) {
+        t.curHP -= dmg;
+        triggerLasting(owner, EffectTrigger::OnDamage, idx, dmg);
+    }
+    if (t.curHP <= 0) {
+        int overflow = -t.curHP;
+        logLine(nameOf(owner), " 的角色 ", t.ch->getName(), " 被击败！");
+        triggerLasting(owner, EffectTrigger::OnDeath, idx, dmg);
+        bool hasReserve = owner.chars.size() == 3;
+        if (hasReserve) {
+            tryReplaceDead(owner, idx);
+        } else {
+            owner.chars[idx].curHP = 0;
+        }
+        if (overflow > 0) { owner.baseHP -= overflow; logLine(nameOf(owner), " 的基地受到溢出伤害 ", overflow, " 点！"); }
+    }
+}
+
+void MatchEngine::applyDamageToBase(PlayerState& owner, int dmg) {
+    owner.baseHP -= dmg;
+}
+
+int MatchEngine::checkWinner() const {
+    if (state.players[0].baseHP <= 0) return 2;
+    if (state.players[1].baseHP <= 0) return 1;
+    return 0;
+}
+
+void MatchEngine::finish(int winner) {
+    state.finished = true;
+    state.winner = winner;
+}
+
+ActionResult MatchEngine::applyAction(const Action& action) {
+    if (state.finished) return +ActionResult::GameOver;
+
+    ActionResult result = +ActionResult::Ok;
+    switch (action.type) {
+        case +ActionType::Quit:
+            logLine("对局提前结束。");
+            finish(0);
+            break;
+        case +ActionType::EndTurn:
+            logLine("结束回合。");
+            state.active = 1 - state.active;
+            ++state.turn;
+            beginTurn();
+            break;
+        case +ActionType::PlayCard:
+            result = playCard(action);
+            break;
+        default:
+            result = +ActionResult::InvalidTarget;
+            break;
+    }
+    if (actionLog && result == +ActionResult::Ok) replay::encodeAction(action, *actionLog);
+    return result;
+}
+
+ActionResult MatchEngine::playCard(const Action& action) {
+    PlayerState& cur = state.players[state.active];
+    PlayerState& opp = state.players[1 - state.active];
+
+    if (cur.hand.empty()) return +ActionResult::EmptyHand;
+    if (cur.playsLeft == 0) return +ActionResult::PlayLimit;
+    int hidx = action.handIndex;
+    if (hidx < 0 || hidx >= (int)cur.hand.size()) return +ActionResult::InvalidHandIndex;
+    const Card& card = catalog.getCard(cur.hand[hidx]);
+    bool isPhysical = card.hasElement(+Element::Physical);
+
+    int charIdx = action.actorIndex;
+    if (charIdx < 0 || charIdx > 1 || charIdx >= (int)cur.chars.size()) return +ActionResult::InvalidActor;
+    auto& actor = cur.chars[charIdx];
+    bool actorIsMage = isMage(*actor.ch);
+    if (!actorIsMage && !isPhysical) return +ActionResult::PhysicalOnly;
+
+    bool targetIsBase = action.targetIsBase;
+    int targetIdx = targetIsBase ? -1 : action.targetIndex;
+    if (!targetIsBase) {
+        if (targetIdx != 0 && targetIdx != 1) return +ActionResult::InvalidTarget;
+        if (targetIdx >= (int)opp.chars.size()) return +ActionResult::EmptyTargetSlot;
+    }
+
+    int cost = card.getCost(); if (isPhysical) cost = 0;
+    // 减费按卡牌句柄记录而非具体哪一张：打出任意同名牌都会消耗一项。
+    // 免费打出（物理牌或消耗为0）时不消耗，留给之后真正需要付费的那张
+    auto discount = cost > 0 ? find(cur.discounted.begin(), cur.discounted.end(), card.getHandle()) : cur.discounted.end();
+    if (discount != cur.discounted.end()) {
+        cur.discounted.erase(discount);
+        cost = max(0, cost - 2);
+        logLine("[效果] 瓶装记忆：", card.getName(), " 的魔力消耗减少2。");
+    }
+    if (cur.playsLeft > 0) --cur.playsLeft;
+    int remainingCost = cost;
+    if (actorIsMage && cost > 0) {
+        int fromChar = min(actor.curEnergy, remainingCost); actor.curEnergy -= fromChar; remainingCost -= fromChar;
+        int fromBase = min(cur.baseMana, remainingCost); cur.baseMana -= fromBase; remainingCost -= fromBase;
+        if (remainingCost > 0) { logLine("魔力不足，使用生命支付剩余费用: ", remainingCost, " 点（直接扣角色生命）。"); actor.curHP -= remainingCost; remainingCost = 0; }
+    }
+
+    int baseDmg = max(1, card.getCost());
+    bool elementMatch = card.getElements().intersects(actor.ch->getElements());
+    int finalDmg = baseDmg * (elementMatch ? 2 : 1);
+    bool dmgIsMagic = !isPhysical;
+
+    // 打出的牌先离开手牌，再结算效果
+    cur.hand.erase(cur.hand.begin() + hidx);
+
+    // 先执行卡牌效果（若注册），效果可改写伤害
+    EffectContext ctx(state, cur, opp, card, log);
+    ctx.actor = charIdx;
+    ctx.targetIsBase = targetIsBase;
+    ctx.target = targetIdx;
+    ctx.damage = finalDmg;
+    ctx.magic = dmgIsMagic;
+    if (CardEffect onPlay = effects.find(card.getHandle(), +EffectTrigger::OnPlay)) {
+        onPlay(ctx);
+        finalDmg = ctx.damage;
+        dmgIsMagic = ctx.magic;
+    }
+
+    if (log) {
+        *log << actor.ch->getName() << " 使用 " << card.getName() << " 对 ";
+        if (targetIsBase) *log << nameOf(opp) << " 的基地"; else *log << opp.chars[targetIdx].ch->getName();
+        *log << " 造成 " << finalDmg << (dmgIsMagic ? " 魔法伤害" : " 物理伤害") << "（已支付消耗）。" << endl;
+    }
+
+    if (targetIsBase) {
+        applyDamageToBase(opp, finalDmg);
+        logLine(nameOf(opp), " 的基地剩余生命: ", opp.baseHP);
+    } else {
+        applyDamageToChar(opp, targetIdx, finalDmg, dmgIsMagic);
+    }
+
+    int win = checkWinner();
+    if (win != 0) {
+        logLine(names[win - 1], " 获胜！");
+        finish(win);
+    }
+    return +ActionResult::Ok;
+}
+
+void MatchEngine::legalActions(vector<Action>& out) const {
+    out.clear();
+    if (state.finished) return;
+    const PlayerState& cur = state.players[state.active];
+    const PlayerState& opp = state.players[1 - state.active];
+    int actors = min(2, (int)cur.chars.size());
+    int targets = min(2, (int)opp.chars.size());
+    int hand = cur.playsLeft == 0 ? 0 : (int)cur.hand.size();
+    for (int h = 0; h < hand; ++h) {
+        bool isPhysical = catalog.getCard(cur.hand[h]).hasElement(+Element::Physical);
+        for (int a = 0; a < actors; ++a) {
+            if (!isPhysical && !isMage(*cur.chars[a].ch)) continue;
+            out.push_back(Action::playCard(h, a, true, -1));
+            for (int t = 0; t < targets; ++t) out.push_back(Action::playCard(h, a, false, t));
+        }
+    }
+    out.push_back(Action::endTurn());
+}
+
+int MatchEngine::play(Player& first, Player& second, int maxTurns) {
+    Player* players[2] = { &first, &second };
+    while (!state.finished) {
+        if (maxTurns > 0 && state.turn > maxTurns) { finish(0); break; }
+        Player& p = *players[state.active];
+        Action action = p.chooseAction(*this, state.active);
+        ActionResult result = applyAction(action);
+        if (result != +ActionResult::Ok) p.onRejected(action, result);
+    }
+    return state.winner;
+}
+
+// RandomPlayer 实现
+Action RandomPlayer::chooseAction(const MatchEngine& engine, int) {
+    engine.legalActions(actions);
+    // legalActions 的最后一项总是结束回合
+    if (actions.size() <= 1) return Action::endTurn();
+    return actions[rng.below((uint32_t)actions.size() - 1)];
+}
+
+// 回放实现
+namespace replay {
+    const char MAGIC[4] = { 'M', 'W', 'R', '2' };
+    const uint8_t OP_END_TURN = 0x00;
+    const uint8_t OP_QUIT = 0x01;
+    const uint8_t OP_PLAY = 0x80;
+
+    void encodeAction(const Action& action, vector<uint8_t>& out) {
+        switch (action.type) {
+            case +ActionType::EndTurn: out.push_back(OP_END_TURN); break;
+            case +ActionType::Quit: out.push_back(OP_QUIT); break;
+            default: {
+                int target = action.targetIsBase ? 0 : action.targetIndex + 1;
+                out.push_back((uint8_t)(OP_PLAY | (action.actorIndex << 2) | target));
+                out.push_back((uint8_t)action.handIndex);
+                break;
+            }
+        }
+    }
+
+    bool decodeAction(const uint8_t*& p, const uint8_t* end, Action& out) {
+        if (p >= end) return false;
+        uint8_t op = *p++;
+        if (op == OP_END_TURN) { out = Action::endTurn(); return true; }
+        if (op == OP_QUIT) { out = Action::quit(); return true; }
+        if ((op & 0xF8) != OP_PLAY || (op & 3) == 3 || p >= end) return false;
+        int target = op & 3;
+        out = Action::playCard(*p++, (op >> 2) & 1, target == 0, target - 1);
+        return true;
+    }
+
+    void writeString(const string& value, string& out) {
+        uint8_t buf[5];
+        out.append((const char*)buf, deckcode::writeVarint((uint32_t)value.size(), buf));
+        out += value;
+    }
+
+    bool readString(const uint8_t*& p, const uint8_t* end, string& value) {
+        uint32_t length;
+        if (!deckcode::readVarint(p, end, length) || length > (size_t)(end - p)) return false;
+        value.assign((const char*)p, length);
+        p += length;
+        return true;
+    }
+}
+
+void Replay::appendTo(string& out) const {
+    string body;
+    uint8_t buf[5];
+    for (int i = 0; i < 4; ++i) body += (char)((seed >> (8 * i)) & 0xFF);
+    for (const auto& side : sides) {
+        replay::writeString(side.name, body);
+        replay::writeString(side.deckCode, body);
+        body += (char)min<size_t>(side.characters.size(), 255);
+        for (size_t i = 0; i < side.characters.size() && i < 255; ++i)
+            body.append((const char*)buf, deckcode::writeVarint(side.characters[i], buf));
+    }
+    body += (char)winner;
+    body.append((const char*)buf, deckcode::writeVarint((uint32_t)max(0, turns), buf));
+    body.append((const char*)buf, deckcode::writeVarint((uint32_t)actions.size(), buf));
+    body.append(actions.begin(), actions.end());
+
+    out.append(replay::MAGIC, 4);
+    out.append((const char*)buf, deckcode::writeVarint((uint32_t)body.size(), buf));
+    out += body;
+    uint32_t crc = crc32::calculate(body.data(), body.size());
+    for (int i = 0; i < 4; ++i) out += (char)((crc >> (8 * i)) & 0xFF);
+}
+
+bool Replay::appendToFile(const string& path) const {
+    string record;
+    appendTo(record);
+    ofstream out(path, ios::binary | ios::app);
+    if (!out) return false;
+    out.write(record.data(), record.size());
+    return (bool)out;
+}
+
+bool Replay::read(const uint8_t*& p, const uint8_t* end, Replay& out) {
+    uint32_t bodyLength;
+    if (end - p < 4 || memcmp(p, replay::MAGIC, 4) != 0) return false;
+    p += 4;
+    if (!deckcode::readVarint(p, end, bodyLength) || (size_t)(end - p) < (size_t)bodyLength + 4) return false;
+    const uint8_t* body = p;
+    const uint8_t* bodyEnd = p + bodyLength;
+    uint32_t crc = 0;
+    for (int i = 0; i < 4; ++i) crc |= (uint32_t)bodyEnd[i] << (8 * i);
+    if (crc32::calculate(body, bodyLength) != crc) return false;
+
+    const uint8_t* q = body;
+    if (bodyEnd - q < 4) return false;
+    out.seed = 0;
+    for (int i = 0; i < 4; ++i) out.seed |= (uint32_t)*q++ << (8 * i);
+    for (auto& side : out.sides) {
+        if (!replay::readString(q, bodyEnd, side.name) || !replay::readString(q, bodyEnd, side.deckCode) || q >= bodyEnd)
+            return false;
+        uint8_t count = *q++;
+        side.characters.clear();
+        for (uint8_t i = 0; i < count; ++i) {
+            uint32_t index;
+            if (!deckcode::readVarint(q, bodyEnd, index) || index > 0xFFFF) return false;
+            side.characters.push_back((uint16_t)index);
+        }
+    }
+    uint32_t turns, actionLength;
+    if (q >= bodyEnd) return false;
+    out.winner = *q++;
+    if (!deckcode::readVarint(q, bodyEnd, turns) || !deckcode::readVarint(q, bodyEnd, actionLength) ||
+        actionLength != (size_t)(bodyEnd - q)) return false;
+    out.turns = (int)turns;
+    out.actions.assign(q, bodyEnd);
+    p = bodyEnd + 4;
+    return true;
+}
+
+ReplayRunner::ReplayRunner() : parser(CardDatabase::instance(), CharacterDatabase::instance()) {}
+
+bool ReplayRunner::run(const Replay& replay, ReplayOutcome& out, std::ostream* log) {
+    const auto& allCharacters = CharacterDatabase::instance().getAllCharacters();
+    out = ReplayOutcome();
+    for (int i = 0; i < 2; ++i) {
+        const ReplaySide& side = replay.sides[i];
+        if (!parser.parse(side.deckCode, decoded)) return false;
+        setups[i].name = side.name;
+        setups[i].deck.swap(decoded.cards);
+        setups[i].characters.clear();
+        for (uint16_t index : side.characters) {
+            if (index >= allCharacters.size()) return false;
+            setups[i].characters.push_back(allCharacters[index]);
+        }
+    }
+
+    MatchEngine engine(setups[0], setups[1], replay.seed, log);
+    const uint8_t* p = replay.actions.data();
+    const uint8_t* end = p + replay.actions.size();
+    Action action;
+    while (p < end) {
+        if (!replay::decodeAction(p, end, action) || engine.applyAction(action) != +ActionResult::Ok) return false;
+        ++out.actions;
+    }
+    out.winner = engine.getWinner();
+    out.turns = engine.getTurn();
+    out.matchesRecord = out.winner == replay.winner && out.turns == replay.turns;
+    return true;
+}
+
+// MctsPlayer 实现
+namespace {
+    const size_t MCTS_MAX_NODES = 1 << 16;  // 每个线程的节点上限，用满后只选择不扩展
+    const int MCTS_ROLLOUT_TURNS = 40;      // 推演最多前进的回合数，超出后按基地生命差估值
+    const double MCTS_EXPLORATION = 0.7;
+    const uint32_t MCTS_END_TURN_KEY = 0;
+
+    // 行动键只依赖牌本身而不依赖手牌位置：MCTS 中不同确定化下的同一行动落在同一节点，
+    // 求解器置换表中的最佳行动在同一局面的不同走法次序下仍然有效
+    uint32_t actionKey(const Action& a, const PlayerState& cur) {
+        if (a.type != +ActionType::PlayCard) return MCTS_END_TURN_KEY;
+        return 1u | ((uint32_t)cur.hand[a.handIndex] << 1) | ((uint32_t)a.actorIndex << 17)
+             | ((a.targetIsBase ? 1u : 0u) << 19) | ((uint32_t)(a.targetIndex & 1) << 20);
+    }
+
+    // 确定化：self 看不到对手手牌和双方牌库顺序，对其重新采样
+    void determinize(GameState& s, int self, Rng& rng) {
+        PlayerState& opp = s.players[1 - self];
+        CardHandle unseen[2 * MAX_PILE_CARDS];
+        size_t n = 0;
+        for (CardHandle h : opp.hand) unseen[n++] = h;
+        for (CardHandle h : opp.deck) unseen[n++] = h;
+        rng.shuffle(unseen, unseen + n);
+        size_t handSize = opp.hand.size();
+        opp.hand.assign(unseen, unseen + handSize);
+        opp.deck.assign(unseen + handSize, unseen + n);
+        PlayerState& me = s.players[self];
+        rng.shuffle(me.deck.begin(), me.deck.end());
+    }
+}
+
+struct MctsPlayer::Node {
+    uint32_t key = MCTS_END_TURN_KEY;
+    int firstChild = -1;
+    int nextSibling = -1;
+    uint32_t visits = 0;
+    uint32_t available = 0;  // 该行动合法的次数（UCB 的“父访问数”）
+    uint32_t stamp = 0;      // 最近一次被计入 available 的迭代号，避免同名手牌重复计数
+    float wins = 0;          // 以做出该行动的玩家视角累计
+    int mover = 0;
+};
+
+struct MctsPlayer::Arena {
+    MatchEngine engine;  // 推演专用，不记录历史、不输出日志
+    GameState scratch;
+    vector<Node> nodes;
+    vector<int> path;
+    vector<Action> actions;
+    vector<uint32_t> keys;
+    vector<size_t> untried;
+    Rng rng;
+    uint32_t iteration = 0;
+
+    explicit Arena(uint64_t seed) : engine(PlayerSetup(), PlayerSetup(), seed), rng(seed) {
+        engine.setRecordHistory(false);
+        nodes.reserve(MCTS_MAX_NODES);
+        path.reserve(256);
+        actions.reserve(256);
+        keys.reserve(256);
+        untried.reserve(256);
+    }
+};
+
+MctsPlayer::MctsPlayer(int budgetMs, unsigned int threads, uint64_t seed)
+    : budgetMs(max(1, budgetMs)), pool(threads) {
+    for (unsigned int i = 0; i < pool.size(); ++i)
+        arenas.push_back(unique_ptr<Arena>(new Arena(streamSeed(seed, i))));
+    rootActions.reserve(256);
+    rootVisits.reserve(256);
+}
+
+MctsPlayer::~MctsPlayer() = default;
+
+Action MctsPlayer::chooseAction(const MatchEngine& engine, int self) {
+    engine.legalActions(rootActions);
+    lastIterations = 0;
+    if (rootActions.size() <= 1) return Action::endTurn();
+
+    const GameState root = engine.snapshot();
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(budgetMs);
+    for (size_t i = 0; i < arenas.size(); ++i) {
+        Arena* arena = arenas[i].get();
+        pool.submit([arena, &root, self, deadline](unsigned int) { search(*arena, root, self, deadline); });
+    }
+    pool.wait();
+
+    // 合并各线程根节点的子节点访问次数，选访问最多的行动
+    rootVisits.clear();
+    for (const auto& arena : arenas) {
+        lastIterations += arena->nodes[0].visits;
+        for (int c = arena->nodes[0].firstChild; c >= 0; c = arena->nodes[c].nextSibling) {
+            const Node& child = arena->nodes[c];
+            auto it = find_if(rootVisits.begin(), rootVisits.end(),
+                              [&](const pair<uint32_t, unsigned long long>& v) { return v.first == child.key; });
+            if (it == rootVisits.end()) rootVisits.emplace_back(child.key, child.visits);
+            else it->second += child.visits;
+        }
+    }
+    if (rootVisits.empty()) return Action::endTurn();
+    uint32_t bestKey = max_element(rootVisits.begin(), rootVisits.end(),
+        [](const pair<uint32_t, unsigned long long>& a, const pair<uint32_t, unsigned long long>& b) {
+            return a.second < b.second;
+        })->first;
+    for (const Action& a : rootActions)
+        if (actionKey(a, root.players[self]) == bestKey) return a;
+    return Action::endTurn();
+}
+
+void MctsPlayer::search(Arena& arena, const GameState& root, int self,
+                        chrono::steady_clock::time_point deadline) {
+    arena.nodes.clear();
+    arena.nodes.emplace_back();
+    arena.nodes[0].mover = 1 - self;
+    do {
+        for (int i = 0; i < 16; ++i) iterate(arena, root, self);
+    } while (chrono::steady_clock::now() < deadline);
+}
+
+void MctsPlayer::iterate(Arena& arena, const GameState& root, int self) {
+    vector<Node>& nodes = arena.nodes;
+    MatchEngine& engine = arena.engine;
+    uint32_t iteration = ++arena.iteration;
+
+    arena.scratch = root;
+    determinize(arena.scratch, self, arena.rng);
+    engine.reset(arena.scratch, arena.rng.next());
+
+    // 选择与扩展：每次迭代最多新建一个节点
+    int node = 0;
+    arena.path.clear();
+    arena.path.push_back(0);
+    bool expanded = false;
+    while (!engine.isFinished() && !expanded) {
+        const GameState& st = engine.getState();
+        int mover = st.active;
+        engine.legalActions(arena.actions);
+        arena.keys.clear();
+        arena.untried.clear();
+        for (size_t i = 0; i < arena.actions.size(); ++i) {
+            uint32_t key = actionKey(arena.actions[i], st.players[mover]);
+            arena.keys.push_back(key);
+            int c = nodes[node].firstChild;
+            while (c >= 0 && nodes[c].key != key) c = nodes[c].nextSibling;
+            if (c < 0) arena.untried.push_back(i);
+            else if (nodes[c].stamp != iteration) { nodes[c].stamp = iteration; ++nodes[c].available; }
+        }
+
+        size_t chosen = 0;
+        if (!arena.untried.empty() && nodes.size() < MCTS_MAX_NODES) {
+            chosen = arena.untried[arena.rng.below((uint32_t)arena.untried.size())];
+            Node child;
+            child.key = arena.keys[chosen];
+            child.mover = mover;
+            child.available = 1;
+            child.stamp = iteration;
+            child.nextSibling = nodes[node].firstChild;
+            nodes.push_back(child);
+            nodes[node].firstChild = (int)nodes.size() - 1;
+            node = nodes[node].firstChild;
+            expanded = true;
+        } else {
+            int best = -1;
+            double bestScore = -1;
+            for (int c = nodes[node].firstChild; c >= 0; c = nodes[c].nextSibling) {
+                const Node& n = nodes[c];
+                if (n.stamp != iteration || n.visits == 0) continue;
+                double score = n.wins / n.visits + MCTS_EXPLORATION * sqrt(log((double)n.available) / n.visits);
+                if (score > bestScore) { bestScore = score; best = c; }
+            }
+            if (best < 0) break;
+            node = best;
+            while (arena.keys[chosen] != nodes[node].key) ++chosen;
+        }
+        arena.path.push_back(node);
+        engine.applyAction(arena.actions[chosen]);
+    }
+
+    // 随机推演：与 RandomPlayer 相同的策略，有牌就出
+    int turnLimit = root.turn + MCTS_ROLLOUT_TURNS;
+    while (!engine.isFinished() && engine.getTurn() <= turnLimit) {
+        engine.legalActions(arena.actions);
+        if (arena.actions.size() <= 1) engine.applyAction(Action::endTurn());
+        else engine.applyAction(arena.actions[arena.rng.below((uint32_t)arena.actions.size() - 1)]);
+    }
+
+    double reward; // self 视角
+    if (engine.isFinished()) {
+        int winner = engine.getWinner();
+        reward = winner == 0 ? 0.5 : (winner == self + 1 ? 1.0 : 0.0);
+    } else {
+        int diff = engine.getPlayer(self).baseHP - engine.getPlayer(1 - self).baseHP;
+        reward = 0.5 + 0.5 * max(-1.0, min(1.0, diff / 50.0));
+    }
+    for (int idx : arena.path) {
+        Node& n = nodes[idx];
+        ++n.visits;
+        n.wins += (float)(n.mover == self ? reward : 1.0 - reward);
+    }
+}
+
+// EndgameSolver 实现
+namespace {
+    const int SOLVER_MAX_PLY = 512;  // 超过该层数的分支按未分胜负处理
+    const uint64_t BOUND_LOWER = 1;
+    const uint64_t BOUND_UPPER = 2;
+    const uint64_t BOUND_EXACT = 3;
+    const uint32_t NO_MOVE = 0xFFFFFFFFu;
+
+    // 置换表数据：2 位边界类型 | 2 位结果 | 12 位剩余回合 | 32 位最佳行动键
+    uint64_t packEntry(int value, uint64_t bound, int depth, uint32_t move) {
+        return bound | ((uint64_t)(value + 1) << 2) | ((uint64_t)min(depth, 0xFFF) << 4) | ((uint64_t)move << 16);
+    }
+    uint64_t entryBound(uint64_t data) { return data & 3; }
+    int entryValue(uint64_t data) { return (int)((data >> 2) & 3) - 1; }
+    int entryDepth(uint64_t data) { return (int)((data >> 4) & 0xFFF); }
+    uint32_t entryMove(uint64_t data) { return (uint32_t)(data >> 16); }
+}
+
+struct EndgameSolver::Worker {
+    MatchEngine engine;                   // 只用来执行规则，不记录历史、不输出日志
+    vector<GameState> stack;              // 每层一个局面，子局面由父局面复制后执行得到
+    vector<vector<Action>> moves;
+    vector<vector<pair<int, int>>> order; // (排序分, 行动下标)
+    unsigned int id;
+    Rng rng;
+    unsigned long long nodes = 0;
+    Action rootBest;
+    // 仅主线程填写
+    int resultValue = 0;
+    int resultTurns = 0;
+    Action resultBest;
+
+    explicit Worker(unsigned int id)
+        : engine(PlayerSetup(), PlayerSetup(), id), stack(SOLVER_MAX_PLY + 1),
+          moves(SOLVER_MAX_PLY), order(SOLVER_MAX_PLY), id(id), rng(id) {
+        engine.setRecordHistory(false);
+    }
+};
+
+EndgameSolver::EndgameSolver(size_t tableMB, unsigned int threads) : pool(threads) {
+    size_t bytes = max<size_t>(1, tableMB) << 20;
+    size_t entries = 1;
+    while (entries * 2 * sizeof(Entry) <= bytes) entries *= 2;
+    table.reset(new Entry[entries]);
+    mask = entries - 1;
+    clear();
+
+    cardCount = max<size_t>(1, CardDatabase::instance().getCardCount());
+    zobrist.resize(2 * 2 * MAX_PILE_CARDS * cardCount);
+    Rng gen(0x4D57534FULL); // 固定种子，同一局面在不同运行中键相同
+    for (auto& k : zobrist) k = gen.next();
+
+    for (unsigned int i = 0; i < pool.size(); ++i) workers.push_back(unique_ptr<Worker>(new Worker(i)));
+}
+
+EndgameSolver::~EndgameSolver() = default;
+
+void EndgameSolver::clear() {
+    for (size_t i = 0; i <= mask; ++i) {
+        table[i].check.store(0, memory_order_relaxed);
+        table[i].data.store(0, memory_order_relaxed);
+    }
+}
+
+uint64_t EndgameSolver::hash(const GameState& s) const {
+    uint64_t h = (s.active ? 0x9E3779B97F4A7C15ULL : 0) ^ mixSeed(s.rng.fingerprint());
+    const size_t zone = MAX_PILE_CARDS * cardCount;
+    for (int p = 0; p < 2; ++p) {
+        const PlayerState& ps = s.players[p];
+        // 手牌同样按位置取键：行动以手牌下标表示，顺序不同的手牌是不同的局面
+        const uint64_t* handKeys = &zobrist[(size_t)p * 2 * zone];
+        const uint64_t* deckKeys = handKeys + zone;
+        for (size_t i = 0; i < ps.hand.size(); ++i) h ^= handKeys[i * cardCount + ps.hand[i]];
+        for (size_t i = 0; i < ps.deck.size(); ++i) h ^= deckKeys[i * cardCount + ps.deck[i]];
+        // 生命、魔力取值范围不定，不适合查表，混合后并入
+        h ^= mixSeed(((uint64_t)p << 62) ^ ((uint64_t)(uint32_t)ps.baseHP << 32) ^ (uint32_t)ps.baseMana);
+        // 持续效果与减费牌与顺序无关，逐项混合后求和（同名牌可重复出现，不能用异或）
+        uint64_t effectKey = ((uint64_t)p << 62) ^ ((uint64_t)(uint32_t)ps.playsLeft << 16);
+        for (CardHandle card : ps.lasting) effectKey += mixSeed(((uint64_t)p << 62) ^ (1ULL << 32) ^ card);
+        for (CardHandle card : ps.discounted) effectKey += mixSeed(((uint64_t)p << 62) ^ (2ULL << 32) ^ card);
+        h ^= mixSeed(effectKey ^ 0xC2B2AE3D27D4EB4FULL);
+        for (size_t c = 0; c < ps.chars.size(); ++c) {
+            const PlayerCharState& pcs = ps.chars[c];
+            uint64_t slot = mixSeed((uint64_t)(uintptr_t)pcs.ch ^ (p * 4 + c));
+            h ^= mixSeed(slot ^ ((uint64_t)(uint32_t)pcs.curHP << 32) ^ (uint32_t)pcs.curEnergy);
+        }
+    }
+    return h;
+}
+
+bool EndgameSolver::probe(uint64_t key, uint64_t& data) const {
+    const Entry& e = table[key & mask];
+    uint64_t d = e.data.load(memory_order_relaxed);
+    uint64_t c = e.check.load(memory_order_relaxed);
+    if ((c ^ d) != key || entryBound(d) == 0) return false;
+    data = d;
+    return true;
+}
+
+void EndgameSolver::store(uint64_t key, uint64_t data) {
+    Entry& e = table[key & mask];
+    e.check.store(key ^ data, memory_order_relaxed);
+    e.data.store(data, memory_order_relaxed);
+}
+
+// 负极大值搜索，返回值以 stack[ply] 的行动方为视角；只有结束回合会换边
+int EndgameSolver::search(Worker& w, int ply, int alpha, int beta, int turnLimit) {
+    const GameState& s = w.stack[ply];
+    ++w.nodes;
+    if (s.finished) return s.winner == 0 ? 0 : (s.winner == s.active + 1 ? 1 : -1);
+    if (s.turn > turnLimit || ply >= SOLVER_MAX_PLY - 1) return 0;
+    if (w.id != 0 && stop.load(memory_order_relaxed)) return 0;
+
+    int depth = turnLimit - s.turn;
+    int alphaOrig = alpha;
+    uint64_t key = hash(s);
+    uint64_t data;
+    uint32_t ttMove = NO_MOVE;
+    if (probe(key, data)) {
+        int v = entryValue(data);
+        uint64_t bound = entryBound(data);
+        int stored = entryDepth(data);
+        ttMove = entryMove(data);
+        // 根节点总要实际展开才能给出本轮的最佳行动，置换表在根节点只用于排序。
+        // 必胜、必败只在记录时的期限不长于当前期限时可用，否则会报告出比实际证明更少的回合数；
+        // 未分胜负只在记录时的期限不短于当前期限时可用
+        if (ply > 0 && v != 0) {
+            if (stored <= depth && v == 1 && (bound & BOUND_LOWER)) return 1;
+            if (stored <= depth && v == -1 && (bound & BOUND_UPPER)) return -1;
+        } else if (ply > 0 && stored >= depth) {
+            if (bound == BOUND_EXACT) return 0;
+            if (bound == BOUND_LOWER) alpha = max(alpha, 0);
+            else beta = min(beta, 0);
+            if (alpha >= beta) return 0;
+        }
+    }
+
+    vector<Action>& moves = w.moves[ply];
+    w.engine.restore(s);
+    w.engine.legalActions(moves);
+
+    // 走法排序：置换表最佳行动、能直接击破基地的出牌、伤害高的出牌，结束回合最后
+    const CardDatabase& catalog = CardDatabase::instance();
+    const PlayerState& cur = s.players[s.active];
+    const PlayerState& opp = s.players[1 - s.active];
+    auto& order = w.order[ply];
+    order.clear();
+    for (size_t i = 0; i < moves.size(); ++i) {
+        const Action& a = moves[i];
+        int score = 0;
+        if (actionKey(a, cur) == ttMove) score = 1 << 24;
+        else if (a.type == +ActionType::PlayCard) {
+            int dmg = max(1, catalog.getCard(cur.hand[a.handIndex]).getCost());
+            score = 16 + dmg * 4 + (a.targetIsBase ? 2 : 0);
+            if (a.targetIsBase && dmg >= opp.baseHP) score += 1 << 20;
+        }
+        // 辅助线程打乱同分走法的次序，与主线程探索不同的子树
+        if (w.id != 0) score = score * 8 + (int)w.rng.below(8);
+        order.emplace_back(score, (int)i);
+    }
+    sort(order.begin(), order.end(), [](const pair<int, int>& a, const pair<int, int>& b) { return a.first > b.first; });
+
+    int best = -2;
+    uint32_t bestKey = NO_MOVE;
+    for (const auto& o : order) {
+        const Action& a = moves[o.second];
+        w.engine.restore(s);
+        w.engine.applyAction(a);
+        w.stack[ply + 1] = w.engine.getState();
+        int v = (w.stack[ply + 1].active != s.active)
+            ? -search(w, ply + 1, -beta, -alpha, turnLimit)
+            : search(w, ply + 1, alpha, beta, turnLimit);
+        if (v > best) {
+            best = v;
+            bestKey = actionKey(a, cur);
+            if (ply == 0) w.rootBest = a;
+        }
+        if (v > alpha) alpha = v;
+        if (alpha >= beta) break;
+    }
+
+    // 被中止的搜索结果不完整，不写入置换表
+    if (!stop.load(memory_order_relaxed)) {
+        uint64_t bound = best <= alphaOrig ? BOUND_UPPER : (best >= beta ? BOUND_LOWER : BOUND_EXACT);
+        store(key, packEntry(best, bound, depth, bestKey));
+    }
+    return best;
+}
+
+// 按回合期限迭代加深，浅层结果经置换表为深层提供走法排序
+void EndgameSolver::iterate(Worker& w, const GameState& root, int maxTurns, bool main) {
+    for (int t = main ? 1 : 1 + (int)(w.id % 2); t <= maxTurns; ++t) {
+        if (!main && stop.load(memory_order_relaxed)) return;
+        w.stack[0] = root;
+        w.rootBest = Action();
+        int v = search(w, 0, -1, 1, root.turn + t - 1);
+        if (main) {
+            w.resultValue = v;
+            w.resultTurns = t;
+            w.resultBest = w.rootBest;
+            if (v != 0) break;
+        }
+    }
+    if (main) stop.store(true, memory_order_relaxed);
+}
+
+SolveResult EndgameSolver::solve(const GameState& position, int maxTurns) {
+    SolveResult r;
+    r.threads = pool.size();
+    if (position.finished) {
+        r.value = position.winner == 0 ? 0 : (position.winner == position.active + 1 ? 1 : -1);
+        return r;
+    }
+    if (maxTurns <= 0) return r;
+
+    stop.store(false);
+    for (auto& w : workers) {
+        w->nodes = 0;
+        w->rootBest = Action();
+        w->resultValue = 0;
+        w->resultTurns = 0;
+        w->resultBest = Action();
+    }
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        Worker* w = workers[i].get();
+        pool.submit([this, w, &position, maxTurns, i](unsigned int) { iterate(*w, position, maxTurns, i == 0); });
+    }
+    pool.wait();
+
+    const Worker& m = *workers[0];
+    r.value = m.resultValue;
+    r.best = m.resultBest;
+    r.turns = m.resultTurns;
+    for (const auto& w : workers) r.nodes += w->nodes;
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return r;
+}
+
+// ThreadPool 实现
+namespace {
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local unsigned int currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int threads) {
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threads; ++i) queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+    for (unsigned int i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lk(stateMutex);
+        stopping = true;
+    }
+    workCv.notify_all();
+    for (auto& w : workers) if (w.joinable()) w.join();
+}
+
+void ThreadPool::submit(Task task) {
+    // 工作线程内部提交的任务进入自己的队列，外部提交则轮流分配
+    unsigned int q = (currentPool == this) ? currentWorker : nextQueue++ % queues.size();
+    {
+        lock_guard<mutex> lk(stateMutex);
+        ++pending;
+        ++queued;
+    }
+    {
+        lock_guard<mutex> lk(queues[q]->m);
+        queues[q]->tasks.push_back(move(task));
+    }
+    workCv.notify_one();
+}
+
+bool ThreadPool::tryPop(unsigned int self, Task& task) {
+    {
+        WorkQueue& own = *queues[self];
+        lock_guard<mutex> lk(own.m);
+        if (!own.tasks.empty()) {
+            task = move(own.tasks.back());
+            own.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i) {
+        WorkQueue& victim = *queues[(self + i) % queues.size()];
+        lock_guard<mutex> lk(victim.m);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned int index) {
+    currentPool = this;
+    currentWorker = index;
+    while (true) {
+        Task task;
+        if (tryPop(index, task)) {
+            task(index);
+            if (--pending == 0) {
+                lock_guard<mutex> lk(stateMutex);
+                doneCv.notify_all();
+            }
+            continue;
+        }
+        unique_lock<mutex> lk(stateMutex);
+        workCv.wait(lk, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> lk(stateMutex);
+    doneCv.wait(lk, [this] { return pending == 0; });
+}
+
+// WaitSignal 实现
+// 等待方 waiters 自增与通知方发布数据后各有一道 seq_cst 栅栏：要么通知方看到等待者并推进 epoch，
+// 要么等待方在睡眠前的复查中看到新数据，不会丢失唤醒
+uint32_t WaitSignal::prepare() {
+    waiters.fetch_add(1, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    return epoch.load(memory_order_acquire);
+}
+
+void WaitSignal::cancel() {
+    waiters.fetch_sub(1, memory_order_relaxed);
+}
+
+void WaitSignal::wait(uint32_t ticket, chrono::milliseconds timeout) {
+#if defined(__linux__)
+    static_assert(sizeof(epoch) == sizeof(uint32_t) && atomic<uint32_t>::is_always_lock_free, "futex 需要 32 位无锁原子量");
+    if (epoch.load(memory_order_acquire) == ticket) {
+        timespec ts;
+        ts.tv_sec = (time_t)(timeout.count() / 1000);
+        ts.tv_nsec = (long)(timeout.count() % 1000) * 1000000L;
+        // 返回 EAGAIN（票据已过期）、EINTR 或 ETIMEDOUT 都交给调用方复查条件
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAIT_PRIVATE, ticket, &ts, nullptr, 0);
+    }
+#else
+    {
+        unique_lock<mutex> lk(sleepMutex);
+        sleepCv.wait_for(lk, timeout, [&] { return epoch.load(memory_order_acquire) != ticket; });
+    }
+#endif
+    waiters.fetch_sub(1, memory_order_relaxed);
+}
+
+void WaitSignal::notify() {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (waiters.load(memory_order_relaxed) == 0) return; // 对方没有在睡眠，无需系统调用
+#if defined(__linux__)
+    epoch.fetch_add(1, memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    {
+        lock_guard<mutex> lk(sleepMutex);
+        epoch.fetch_add(1, memory_order_release);
+    }
+    sleepCv.notify_all();
+#endif
+}
+
+// 胜率的 95% Wilson 置信区间，wins 中平局按半场计；返回 [下界, 上界]
+static pair<double, double> wilsonInterval(double wins, double n) {
+    const double z = 1.96;
+    double p = wins / n;
+    double denom = 1 + z * z / n;
+    double center = (p + z * z / (2 * n)) / denom;
+    double half = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n)) / denom;
+    return { max(0.0, center - half), min(1.0, center + half) };
+}
+
+// Simulator 实现
+SimulationReport Simulator::run(const PlayerSetup& a, const PlayerSetup& b, long long games,
+                                uint64_t seed, int maxTurns) {
+    struct alignas(64) Totals {
+        long long winsA = 0, winsB = 0, draws = 0;
+        double turns = 0, turnsSq = 0;
+    };
+    vector<Totals> perWorker(pool.size());
+    const long long chunk = 256;
+
+    auto start = chrono::steady_clock::now();
+    for (long long begin = 0; begin < games; begin += chunk) {
+        long long end = min(games, begin + chunk);
+        pool.submit([&, begin, end](unsigned int worker) {
+            Totals local;
+            for (long long g = begin; g < end; ++g) {
+                uint64_t gameSeed = streamSeed(seed, (uint64_t)g);
+                bool aFirst = (g % 2 == 0); // 轮流先手
+                MatchEngine engine(aFirst ? a : b, aFirst ? b : a, gameSeed);
+                RandomPlayer first(playerSeed(gameSeed, 0)), second(playerSeed(gameSeed, 1));
+                int winner = engine.play(first, second, maxTurns);
+                if (winner == 0) ++local.draws;
+                else if ((winner == 1) == aFirst) ++local.winsA;
+                else ++local.winsB;
+                double t = engine.getTurn();
+                local.turns += t;
+                local.turnsSq += t * t;
+            }
+            Totals& acc = perWorker[worker];
+            acc.winsA += local.winsA; acc.winsB += local.winsB; acc.draws += local.draws;
+            acc.turns += local.turns; acc.turnsSq += local.turnsSq;
+        });
+    }
+    pool.wait();
+
+    SimulationReport r;
+    double turns = 0, turnsSq = 0;
+    for (const auto& t : perWorker) {
+        r.winsA += t.winsA; r.winsB += t.winsB; r.draws += t.draws;
+        turns += t.turns; turnsSq += t.turnsSq;
+    }
+    r.games = games;
+    r.threads = pool.size();
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (games > 0) {
+        double n = (double)games, z = 1.96;
+        double wins = r.winsA + 0.5 * r.draws;
+        r.winRateA = wins / n;
+        tie(r.winRateLow, r.winRateHigh) = wilsonInterval(wins, n);
+        r.avgTurns = turns / n;
+        double variance = max(0.0, turnsSq / n - r.avgTurns * r.avgTurns);
+        r.turnsMargin = z * sqrt(variance / n);
+    }
+    return r;
+}
+
+// DeckOptimizer 实现
+DeckOptimizer::DeckOptimizer(const vector<PlayerSetup>& opponents, unsigned int threads)
+    : opponents(opponents), pool(threads) {
+}
+
+double DeckOptimizer::Evaluation::upperBound() const {
+    if (totalGames == 0) return 1.0;
+    return wilsonInterval(totalWins, (double)totalGames).second;
+}
+
+// 多重集哈希取各卡牌键之和，换一张卡只需减去旧键、加上新键
+uint64_t DeckOptimizer::cardKey(CardHandle card) {
+    return mixSeed(0x5DECC0DEULL + card);
+}
+
+// 把 eval 中每个对手的对局补到 target 局，按（对手, 局号段）拆成任务并行模拟
+void DeckOptimizer::extend(const OptimizerConfig& config, const vector<CardHandle>& cards,
+                           Evaluation& eval, int target) {
+    const int chunk = 16;
+    PlayerSetup candidate{"候选", cards, config.characters};
+    struct Task { size_t opponent; int begin, end; double wins; };
+    vector<Task> tasks;
+    for (size_t o = 0; o < opponents.size(); ++o) {
+        for (int g = eval.games[o]; g < target; g += chunk) {
+            tasks.push_back({o, g, min(target, g + chunk), 0.0});
+        }
+    }
+    for (Task& task : tasks) {
+        pool.submit([&, t = &task](unsigned int) {
+            const PlayerSetup& opponent = opponents[t->opponent];
+            for (int g = t->begin; g < t->end; ++g) {
+                uint64_t gameSeed = streamSeed(streamSeed(config.seed, t->opponent), (uint64_t)g);
+                bool candidateFirst = (g % 2 == 0); // 轮流先手
+                MatchEngine engine(candidateFirst ? candidate : opponent, candidateFirst ? opponent : candidate,
+                                   gameSeed);
+                RandomPlayer first(playerSeed(gameSeed, 0)), second(playerSeed(gameSeed, 1));
+                int winner = engine.play(first, second, config.maxTurns);
+                if (winner == 0) t->wins += 0.5;
+                else if ((winner == 1) == candidateFirst) t->wins += 1.0;
+            }
+        });
+    }
+    pool.wait();
+
+    for (const Task& task : tasks) {
+        int n = task.end - task.begin;
+        eval.games[task.opponent] = max(eval.games[task.opponent], task.end);
+        eval.wins[task.opponent] += task.wins;
+        eval.totalGames += n;
+        eval.totalWins += task.wins;
+        gamesPlayed += n;
+    }
+}
+
+OptimizerResult DeckOptimizer::run(const OptimizerConfig& config, ostream* progress) {
+    const CardDatabase& catalog = CardDatabase::instance();
+    OptimizerResult result;
+    auto start = chrono::steady_clock::now();
+    gamesPlayed = 0;
+    cache.clear();
+
+    // 可选卡牌：标准牌组排除趣味稀有度（与 Deck::addCard 的限制一致）
+    vector<CardHandle> choices;
+    for (size_t i = 0; i < catalog.getCardCount(); ++i) {
+        const Card& card = catalog.getCard(static_cast<CardHandle>(i));
+        if (config.deckType == +DeckType::Standard && card.getRarity() == +Rarity::Funny) continue;
+        choices.push_back(card.getHandle());
+    }
+    int maxCopies = max(1, config.maxCopies);
+    if (choices.empty() || opponents.empty() || (long long)choices.size() * maxCopies < config.deckSize) {
+        return result;
+    }
+
+    Rng rng(config.seed);
+    vector<int> copies(catalog.getCardCount(), 0);
+    vector<CardHandle> cards;
+    uint64_t hash = 0;
+    while ((int)cards.size() < config.deckSize) {
+        CardHandle card = choices[rng.below((uint32_t)choices.size())];
+        if (copies[card] >= maxCopies) continue;
+        ++copies[card];
+        cards.push_back(card);
+        hash += cardKey(card);
+    }
+
+    auto lookup = [&](uint64_t key) -> Evaluation& {
+        auto it = cache.find(key);
+        if (it != cache.end()) {
+            ++result.cacheHits;
+            return it->second;
+        }
+        Evaluation& eval = cache[key];
+        eval.games.assign(opponents.size(), 0);
+        eval.wins.assign(opponents.size(), 0.0);
+        return eval;
+    };
+
+    Evaluation* incumbent = &lookup(hash);
+    extend(config, cards, *incumbent, config.maxGames);
+
+    for (int iter = 0; iter < config.iterations; ++iter) {
+        // 邻域：把某个位置的卡牌换成池中另一张未达上限的卡牌
+        size_t slot = rng.below((uint32_t)cards.size());
+        CardHandle removed = cards[slot];
+        CardHandle added = choices[rng.below((uint32_t)choices.size())];
+        if (added == removed || copies[added] >= maxCopies) continue;
+        ++result.candidates;
+
+        uint64_t candidateHash = hash - cardKey(removed) + cardKey(added);
+        cards[slot] = added;
+        Evaluation& candidate = lookup(candidateHash);
+
+        // 分批追加对局，上界已不可能超过当前牌组时提前淘汰
+        bool beaten = false;
+        while (candidate.games[0] < config.maxGames) {
+            if (candidate.totalGames > 0 && candidate.upperBound() < incumbent->mean()) {
+                beaten = true;
+                break;
+            }
+            extend(config, cards, candidate, min(config.maxGames, candidate.games[0] + config.batchGames));
+        }
+
+        if (!beaten && candidate.mean() > incumbent->mean()) {
+            --copies[removed];
+            ++copies[added];
+            hash = candidateHash;
+            incumbent = &candidate;
+            ++result.accepted;
+            if (progress) {
+                *progress << "第 " << iter + 1 << " 轮: 胜率 " << fixed << setprecision(2) << incumbent->mean() * 100
+                          << "% (接受 " << result.accepted << " / 候选 " << result.candidates << ", 对局 "
+                          << gamesPlayed << ")" << endl;
+                progress->unsetf(ios::floatfield);
+                *progress << setprecision(6);
+            }
+        } else {
+            if (beaten) ++result.rejectedEarly;
+            cards[slot] = removed;
+        }
+    }
+
+    sort(cards.begin(), cards.end());
+    result.cards = cards;
+    result.winRate = incumbent->mean();
+    result.games = gamesPlayed;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void SimulationReport::print(ostream& out) const {
+    out << "=== 模拟结果 ===" << endl;
+    out << "对局数: " << games << " (线程: " << threads << ", 用时: " << fixed << setprecision(2) << seconds << " 秒, "
+        << setprecision(0) << (seconds > 0 ? games / seconds : 0.0) << " 局/秒)" << endl;
+    out << "A 胜: " << winsA << "  B 胜: " << winsB << "  平局: " << draws << endl;
+    out << setprecision(2) << "A 胜率: " << winRateA * 100 << "% (95% 置信区间 " << winRateLow * 100
+        << "% - " << winRateHigh * 100 << "%)" << endl;
+    out << "平均回合数: " << avgTurns << " ± " << turnsMargin << endl;
+    out.unsetf(ios::floatfield);
+    out << setprecision(6);
+}
+
+// MappedFile 实现
+#ifdef _WIN32
+MappedFile::MappedFile(const string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) return;
+    length = static_cast<size_t>(fileSize.QuadPart);
+    opened = true;
+    if (length == 0) return; // 空文件无法映射，视为打开成功的空内容
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) { opened = false; return; }
+    mappingHandle = mapping;
+    ptr = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!ptr) opened = false;
+}
+
+MappedFile::~MappedFile() {
+    if (ptr) UnmapViewOfFile(ptr);
+    if (mappingHandle) CloseHandle(static_cast<HANDLE>(mappingHandle));
+    if (fileHandle) CloseHandle(static_cast<HANDLE>(fileHandle));
+}
+#else
+MappedFile::MappedFile(const string& path) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0) return;
+    length = static_cast<size_t>(st.st_size);
+    opened = true;
+    if (length == 0) return; // 空文件无法映射，视为打开成功的空内容
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) { opened = false; return; }
+    ptr = static_cast<const char*>(mapped);
+    madvise(mapped, length, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    if (ptr) munmap(const_cast<char*>(ptr), length);
+    if (fd >= 0) close(fd);
+}
+#endif
+
+// 网络层实现
+namespace net {
+#ifdef _WIN32
+    static bool startup() {
+        // 进程内只初始化一次，退出时自动清理，各错误路径不再需要手动 WSACleanup
+        struct Winsock {
+            bool ok;
+            Winsock() { WSADATA data; ok = WSAStartup(MAKEWORD(2, 2), &data) == 0; }
+            ~Winsock() { if (ok) WSACleanup(); }
+        };
+        static Winsock winsock;
+        return winsock.ok;
+    }
+    static bool wouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+    static void closeHandle(socket_t h) { closesocket((SOCKET)h); }
+
+    string lastError() { return "WSA 错误 " + to_string(WSAGetLastError()); }
+#else
+    static bool startup() { return true; }
+    static bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+    static void closeHandle(socket_t h) { ::close(h); }
+
+    string lastError() { return strerror(errno); }
+#endif
+
+    static Socket newSocket(int type, int protocol, string* error) {
+        if (!startup()) {
+            if (error) *error = "网络初始化失败";
+            return Socket();
+        }
+        Socket s((socket_t)::socket(AF_INET, type, protocol));
+        if (!s.valid()) {
+            if (error) *error = lastError();
+            return s;
+        }
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(s.get(), SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+        return s;
+    }
+
+    Socket& Socket::operator=(Socket&& other) noexcept {
+        if (this != &other) {
+            close();
+            handle = other.release();
+        }
+        return *this;
+    }
+
+    void Socket::close() {
+        if (valid()) {
+            closeHandle(handle);
+            handle = INVALID_HANDLE;
+        }
+    }
+
+    Socket Socket::listenTcp(uint16_t port, int backlog, bool reusePort, string* error) {
+        Socket s = newSocket(SOCK_STREAM, IPPROTO_TCP, error);
+        if (!s.valid()) return s;
+        int one = 1;
+#ifndef _WIN32
+        // Windows 的 SO_REUSEADDR 允许抢占他人正在监听的端口，只在 POSIX 上设置
+        setsockopt(s.get(), SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+#endif
+        if (reusePort) {
+#ifdef SO_REUSEPORT
+            if (setsockopt(s.get(), SOL_SOCKET, SO_REUSEPORT, (const char*)&one, sizeof(one)) != 0) {
+                if (error) *error = lastError();
+                return Socket();
+            }
+#else
+            if (error) *error = "当前平台不支持 SO_REUSEPORT";
+            return Socket();
+#endif
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (::bind(s.get(), (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(s.get(), backlog) != 0 ||
+            !s.setNonBlocking(true)) {
+            if (error) *error = lastError();
+            return Socket();
+        }
+        return s;
+    }
+
+    Socket Socket::connectTcp(const string& host, uint16_t port, string* error) {
+        if (!startup()) {
+            if (error) *error = "网络初始化失败";
+            return Socket();
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &result) != 0 || !result) {
+            if (error) *error = "无法解析地址 " + host;
+            return Socket();
+        }
+        Socket s = newSocket(SOCK_STREAM, IPPROTO_TCP, error);
+        if (s.valid() && ::connect(s.get(), result->ai_addr, (socklen_t)result->ai_addrlen) != 0) {
+            if (error) *error = lastError();
+            s.close();
+        }
+        freeaddrinfo(result);
+        if (s.valid()) {
+            s.setNonBlocking(true);
+            s.setNoDelay(true);
+        }
+        return s;
+    }
+
+    Socket Socket::accept() const {
+        Socket client((socket_t)::accept(handle, nullptr, nullptr));
+        if (client.valid()) {
+            client.setNonBlocking(true);
+            client.setNoDelay(true);
+#ifdef SO_NOSIGPIPE
+            int one = 1;
+            setsockopt(client.get(), SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+        }
+        return client;
+    }
+
+    bool Socket::setNonBlocking(bool enabled) {
+#ifdef _WIN32
+        u_long mode = enabled ? 1 : 0;
+        return ioctlsocket((SOCKET)handle, FIONBIO, &mode) == 0;
+#else
+        int flags = fcntl(handle, F_GETFL, 0);
+        if (flags < 0) return false;
+        return fcntl(handle, F_SETFL, enabled ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) == 0;
+#endif
+    }
+
+    bool Socket::setNoDelay(bool enabled) {
+        int value = enabled ? 1 : 0;
+        return setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&value, sizeof(value)) == 0;
+    }
+
+    uint16_t Socket::localPort() const {
+        sockaddr_in addr{};
+        socklen_t length = sizeof(addr);
+        if (getsockname(handle, (sockaddr*)&addr, &length) != 0) return 0;
+        return ntohs(addr.sin_port);
+    }
+
+    long Socket::receive(void* buffer, size_t length) {
+#ifdef _WIN32
+        int n = ::recv((SOCKET)handle, (char*)buffer, (int)min<size_t>(length, INT_MAX), 0);
+#else
+        ssize_t n;
+        do n = ::recv(handle, buffer, length, 0); while (n < 0 && errno == EINTR);
+#endif
+        if (n >= 0) return (long)n;
+        return wouldBlock() ? WOULD_BLOCK : FAILED;
+    }
+
+    long Socket::send(const void* data, size_t length) {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL; // 对端已关闭时返回错误而不是触发 SIGPIPE
+#else
+        const int flags = 0;
+#endif
+#ifdef _WIN32
+        int n = ::send((SOCKET)handle, (const char*)data, (int)min<size_t>(length, INT_MAX), flags);
+#else
+        ssize_t n;
+        do n = ::send(handle, data, length, flags); while (n < 0 && errno == EINTR);
+#endif
+        if (n >= 0) return (long)n;
+        return wouldBlock() ? WOULD_BLOCK : FAILED;
+    }
+
+    bool RecvBuffer::fill(Socket& socket) {
+        if (begin == end) begin = end = 0;
+        while (true) {
+            if (end == buffer.size()) {
+                if (begin == 0) return true; // 缓冲已满，等调用方消费后再读
+                memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            long n = socket.receive(buffer.data() + end, buffer.size() - end);
+            if (n > 0) {
+                end += (size_t)n;
+                continue;
+            }
+            return n == Socket::WOULD_BLOCK;
+        }
+    }
+
+    bool RecvBuffer::nextLine(string_view& line) {
+        const char* start = buffer.data() + begin;
+        const char* newline = static_cast<const char*>(memchr(start, '\n', end - begin));
+        if (!newline) return false;
+        size_t length = newline - start;
+        begin += length + 1;
+        if (length > 0 && start[length - 1] == '\r') --length;
+        line = string_view(start, length);
+        return true;
+    }
+
+    void RecvBuffer::consume(size_t n) {
+        begin += min(n, size());
+    }
+
+    void SendBuffer::append(const void* data, size_t length) {
+        if (sent == buffer.size()) {
+            buffer.clear();
+            sent = 0;
+        }
+        const char* bytes = static_cast<const char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + length);
+    }
+
+    bool SendBuffer::flush(Socket& socket) {
+        while (sent < buffer.size()) {
+            long n = socket.send(buffer.data() + sent, buffer.size() - sent);
+            if (n > 0) sent += (size_t)n;
+            else return n != Socket::FAILED;
+        }
+        buffer.clear();
+        sent = 0;
+        return true;
+    }
+
+    void SendBuffer::clear(size_t keepCapacity) {
+        buffer.clear();
+        sent = 0;
+        if (buffer.capacity() > keepCapacity) {
+            std::vector<char> smaller;
+            smaller.reserve(keepCapacity);
+            buffer.swap(smaller);
+        }
+    }
+
+    void ChunkQueue::push(SharedChunk chunk) {
+        if (chunk->empty()) return;
+        bytes += chunk->size();
+        chunks.push_back(std::move(chunk));
+    }
+
+    bool ChunkQueue::flush(Socket& socket) {
+        while (head < chunks.size()) {
+            const std::string& chunk = *chunks[head];
+            long n = socket.send(chunk.data() + offset, chunk.size() - offset);
+            if (n <= 0) {
+                // 读得慢的连接上已写完的引用越积越多时前移，保持队列短小
+                if (head >= 16 && head * 2 >= chunks.size()) {
+                    chunks.erase(chunks.begin(), chunks.begin() + head);
+                    head = 0;
+                }
+                return n != Socket::FAILED;
+            }
+            offset += (size_t)n;
+            bytes -= (size_t)n;
+            if (offset == chunk.size()) {
+                chunks[head++].reset();
+                offset = 0;
+            }
+        }
+        clear();
+        return true;
+    }
+
+    void ChunkQueue::clear() {
+        chunks.clear();
+        head = 0;
+        offset = 0;
+        bytes = 0;
+    }
+
+#ifndef MW_NET_EPOLL
+    // 没有 eventfd 的平台用一个连接到自身的回环 UDP 套接字唤醒事件循环
+    static Socket makeWakeSocket() {
+        Socket s = newSocket(SOCK_DGRAM, IPPROTO_UDP, nullptr);
+        if (!s.valid()) return s;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (::bind(s.get(), (const sockaddr*)&addr, sizeof(addr)) != 0 ||
+            getsockname(s.get(), (sockaddr*)&addr, &length) != 0 ||
+            ::connect(s.get(), (const sockaddr*)&addr, length) != 0 || !s.setNonBlocking(true)) return Socket();
+        return s;
+    }
+
+    static void drainWakeSocket(Socket& s) {
+        char buf[64];
+        while (s.receive(buf, sizeof(buf)) > 0) {}
+    }
+#endif
+
+    struct EventLoop::Backend {
+#if defined(MW_NET_EPOLL)
+        int epollFd = -1;
+        int wakeFd = -1;
+        vector<epoll_event> events = vector<epoll_event>(256);
+#elif defined(MW_NET_KQUEUE)
+        int kqueueFd = -1;
+        Socket wakeSocket;
+        vector<struct kevent> events = vector<struct kevent>(256);
+#else
+        Socket wakeSocket;
+        vector<pollfd> fds;
+        vector<Registration*> owners;
+#endif
+    };
+
+#if defined(MW_NET_EPOLL)
+    static uint32_t toEpoll(int events) {
+        uint32_t mask = 0;
+        if (events & EventLoop::READABLE) mask |= (uint32_t)(EPOLLIN | EPOLLRDHUP);
+        if (events & EventLoop::WRITABLE) mask |= (uint32_t)EPOLLOUT;
+        return mask;
+    }
+#elif defined(MW_NET_KQUEUE)
+    static bool updateKqueue(int kq, socket_t fd, void* owner, int oldEvents, int newEvents) {
+        struct kevent changes[2];
+        int n = 0;
+        if ((oldEvents ^ newEvents) & EventLoop::READABLE)
+            EV_SET(&changes[n++], fd, EVFILT_READ, (newEvents & EventLoop::READABLE) ? EV_ADD : EV_DELETE, 0, 0, owner);
+        if ((oldEvents ^ newEvents) & EventLoop::WRITABLE)
+            EV_SET(&changes[n++], fd, EVFILT_WRITE, (newEvents & EventLoop::WRITABLE) ? EV_ADD : EV_DELETE, 0, 0, owner);
+        return n == 0 || kevent(kq, changes, n, nullptr, 0, nullptr) == 0;
+    }
+#endif
+
+    EventLoop::EventLoop() : backend(new Backend()) {
+#if defined(MW_NET_EPOLL)
+        backend->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        backend->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (backend->epollFd >= 0 && backend->wakeFd >= 0) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = nullptr; // 空指针标记唤醒事件
+            epoll_ctl(backend->epollFd, EPOLL_CTL_ADD, backend->wakeFd, &ev);
+        }
+#elif defined(MW_NET_KQUEUE)
+        backend->kqueueFd = kqueue();
+        backend->wakeSocket = makeWakeSocket();
+        if (backend->kqueueFd >= 0 && backend->wakeSocket.valid())
+            updateKqueue(backend->kqueueFd, backend->wakeSocket.get(), nullptr, 0, READABLE);
+#else
+        backend->wakeSocket = makeWakeSocket();
+#endif
+    }
+
+    EventLoop::~EventLoop() {
+#if defined(MW_NET_EPOLL)
+        if (backend->epollFd >= 0) ::close(backend->epollFd);
+        if (backend->wakeFd >= 0) ::close(backend->wakeFd);
+#elif defined(MW_NET_KQUEUE)
+        if (backend->kqueueFd >= 0) ::close(backend->kqueueFd);
+#endif
+    }
+
+    bool EventLoop::isOpen() const {
+#if defined(MW_NET_EPOLL)
+        return backend->epollFd >= 0 && backend->wakeFd >= 0;
+#elif defined(MW_NET_KQUEUE)
+        return backend->kqueueFd >= 0 && backend->wakeSocket.valid();
+#else
+        return backend->wakeSocket.valid();
+#endif
+    }
+
+    bool EventLoop::add(socket_t fd, int events, Handler handler) {
+        if (registrations.count(fd)) return false;
+        unique_ptr<Registration> reg(new Registration{ fd, events, move(handler), true });
+#if defined(MW_NET_EPOLL)
+        epoll_event ev{};
+        ev.events = toEpoll(events);
+        ev.data.ptr = reg.get();
+        if (epoll_ctl(backend->epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) return false;
+#elif defined(MW_NET_KQUEUE)
+        if (!updateKqueue(backend->kqueueFd, fd, reg.get(), 0, events)) return false;
+#endif
+        registrations[fd] = move(reg);
+        return true;
+    }
+
+    bool EventLoop::modify(socket_t fd, int events) {
+        auto it = registrations.find(fd);
+        if (it == registrations.end()) return false;
+        Registration* reg = it->second.get();
+        if (reg->events == events) return true;
+#if defined(MW_NET_EPOLL)
+        epoll_event ev{};
+        ev.events = toEpoll(events);
+        ev.data.ptr = reg;
+        if (epoll_ctl(backend->epollFd, EPOLL_CTL_MOD, fd, &ev) != 0) return false;
+#elif defined(MW_NET_KQUEUE)
+        if (!updateKqueue(backend->kqueueFd, fd, reg, reg->events, events)) return false;
+#endif
+        reg->events = events;
+        return true;
+    }
+
+    void EventLoop::remove(socket_t fd) {
+        auto it = registrations.find(fd);
+        if (it == registrations.end()) return;
+#if defined(MW_NET_EPOLL)
+        epoll_event ev{};
+        epoll_ctl(backend->epollFd, EPOLL_CTL_DEL, fd, &ev);
+#elif defined(MW_NET_KQUEUE)
+        updateKqueue(backend->kqueueFd, fd, nullptr, it->second->events, 0);
+#endif
+        // 同一轮中可能还有指向该注册的事件，先标记失效，分发结束后再释放
+        it->second->active = false;
+        retired.push_back(move(it->second));
+        registrations.erase(it);
+    }
+
+    int EventLoop::poll(int timeoutMs) {
+        int dispatched = 0;
+#if defined(MW_NET_EPOLL)
+        int n = epoll_wait(backend->epollFd, backend->events.data(), (int)backend->events.size(), timeoutMs);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < n; ++i) {
+            const epoll_event& ev = backend->events[i];
+            if (!ev.data.ptr) {
+                uint64_t value;
+                while (read(backend->wakeFd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+            Registration* reg = static_cast<Registration*>(ev.data.ptr);
+            if (!reg->active) continue;
+            int fired = 0;
+            // 挂断与错误按可读分发，由回调中的 receive 得到 0 或错误
+            if (ev.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) fired |= READABLE;
+            if (ev.events & EPOLLOUT) fired |= WRITABLE;
+            reg->handler(fired);
+            ++dispatched;
+        }
+#elif defined(MW_NET_KQUEUE)
+        timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+        int n = kevent(backend->kqueueFd, nullptr, 0, backend->events.data(), (int)backend->events.size(),
+                       timeoutMs < 0 ? nullptr : &timeout);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < n; ++i) {
+            const struct kevent& ev = backend->events[i];
+            if (!ev.udata) {
+                drainWakeSocket(backend->wakeSocket);
+                continue;
+            }
+            Registration* reg = static_cast<Registration*>(ev.udata);
+            if (!reg->active) continue;
+            reg->handler(ev.filter == EVFILT_WRITE ? WRITABLE : READABLE);
+            ++dispatched;
+        }
+#else
+        auto& fds = backend->fds;
+        auto& owners = backend->owners;
+        fds.clear();
+        owners.clear();
+        pollfd wake{};
+        wake.fd = backend->wakeSocket.get();
+        wake.events = POLLIN;
+        fds.push_back(wake);
+        owners.push_back(nullptr);
+        for (const auto& entry : registrations) {
+            pollfd p{};
+            p.fd = entry.first;
+            p.events = (short)(((entry.second->events & READABLE) ? POLLIN : 0) | ((entry.second->events & WRITABLE) ? POLLOUT : 0));
+            fds.push_back(p);
+            owners.push_back(entry.second.get());
+        }
+#ifdef _WIN32
+        int n = WSAPoll(fds.data(), (ULONG)fds.size(), timeoutMs);
+#else
+        int n = ::poll(fds.data(), (nfds_t)fds.size(), timeoutMs);
+#endif
+        if (n < 0) {
+#ifdef _WIN32
+            return -1;
+#else
+            return errno == EINTR ? 0 : -1;
+#endif
+        }
+        for (size_t i = 0; i < fds.size() && n > 0; ++i) {
+            short revents = fds[i].revents;
+            if (!revents) continue;
+            --n;
+            if (!owners[i]) {
+                drainWakeSocket(backend->wakeSocket);
+                continue;
+            }
+            Registration* reg = owners[i];
+            if (!reg->active) continue;
+            int fired = 0;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) fired |= READABLE;
+            if (revents & POLLOUT) fired |= WRITABLE;
+            reg->handler(fired);
+            ++dispatched;
+        }
+#endif
+        retired.clear();
+        return dispatched;
+    }
+
+    void EventLoop::wakeup() {
+#if defined(MW_NET_EPOLL)
+        uint64_t one = 1;
+        ssize_t written = write(backend->wakeFd, &one, sizeof(one));
+        (void)written;
+#else
+        char one = 1;
+        backend->wakeSocket.send(&one, 1);
+#endif
+    }
+}
+
+// 联机协议实现
+namespace wire {
+    const char PREAMBLE[3] = { 'M', 'W', 'P' };
+
+    static void putU16(std::string& out, uint16_t v) {
+        out += (char)(v & 0xFF);
+        out += (char)(v >> 8);
+    }
+
+    static uint16_t getU16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+    static void putRecord(std::string& out, const ActionRecord& r) {
+        out += (char)r.type;
+        out += (char)r.hand;
+        out += (char)r.actor;
+        out += (char)r.target;
+        putU16(out, r.card);
+    }
+
+    static bool getRecord(const uint8_t* p, ActionRecord& r) {
+        r.type = p[0];
+        r.hand = p[1];
+        r.actor = p[2];
+        r.target = p[3];
+        r.card = getU16(p + 4);
+        if (r.type != ActionType::PlayCard && r.type != ActionType::EndTurn) return false;
+        return r.target <= 2 && (r.card == ActionRecord::NO_CARD || r.card < CardDatabase::instance().getCardCount());
+    }
+
+    ActionRecord ActionRecord::from(const Action& action, CardHandle card) {
+        ActionRecord r;
+        r.type = (uint8_t)action.type;
+        if (action.type == +ActionType::PlayCard) {
+            r.hand = (uint8_t)action.handIndex;
+            r.actor = (uint8_t)action.actorIndex;
+            r.target = action.targetIsBase ? 0 : (uint8_t)(action.targetIndex + 1);
+            r.card = card;
+        }
+        return r;
+    }
+
+    Action ActionRecord::toAction() const {
+        if (type != ActionType::PlayCard) return Action::endTurn();
+        return Action::playCard(hand, actor, target == 0, target - 1);
+    }
+
+    static int16_t clampView(int value) {
+        return (int16_t)max(-32768, min(32767, value));
+    }
+
+    SpectatorView SpectatorView::of(const GameState& state) {
+        SpectatorView view;
+        view.turn = (uint16_t)min(state.turn, 0xFFFF);
+        view.active = (uint8_t)state.active;
+        for (int p = 0; p < 2; ++p) {
+            const PlayerState& player = state.players[p];
+            int16_t* v = view.values[p];
+            v[VIEW_BASE_HP] = clampView(player.baseHP);
+            v[VIEW_BASE_MANA] = clampView(player.baseMana);
+            v[VIEW_HAND] = (int16_t)player.hand.size();
+            v[VIEW_DECK] = (int16_t)player.deck.size();
+            v[VIEW_CHARS] = (int16_t)player.chars.size();
+            for (size_t slot = 0; slot < 3; ++slot) {
+                int16_t* c = v + VIEW_CHAR_FIRST + 3 * slot;
+                if (slot < player.chars.size()) {
+                    const PlayerCharState& ch = player.chars[slot];
+                    c[0] = (int16_t)ch.ch->getIndex();
+                    c[1] = clampView(ch.curHP);
+                    c[2] = clampView(ch.curEnergy);
+                } else {
+                    c[0] = -1;
+                    c[1] = c[2] = 0;
+                }
+            }
+        }
+        return view;
+    }
+
+    void SpectatorView::diff(const SpectatorView& before, std::vector<ViewChange>& out) const {
+        for (int p = 0; p < 2; ++p)
+            for (uint8_t f = 0; f < VIEW_FIELDS; ++f)
+                if (values[p][f] != before.values[p][f]) out.push_back({ (uint8_t)(p << 7 | f), values[p][f] });
+    }
+
+    bool SpectatorView::apply(const ViewChange& change) {
+        uint8_t field = change.key & 0x7F;
+        if (field >= VIEW_FIELDS) return false;
+        values[change.key >> 7][field] = change.value;
+        return true;
+    }
+
+    void appendPreamble(std::string& out) {
+        out.append(PREAMBLE, sizeof(PREAMBLE));
+        out += (char)VERSION;
+    }
+
+    DecodeStatus readPreamble(net::RecvBuffer& in) {
+        size_t n = min(in.size(), PREAMBLE_SIZE);
+        if (memcmp(in.data(), PREAMBLE, min(n, sizeof(PREAMBLE))) != 0) return +DecodeStatus::Malformed;
+        if (n < PREAMBLE_SIZE) return +DecodeStatus::Incomplete;
+        if ((uint8_t)in.data()[3] != VERSION) return +DecodeStatus::Malformed;
+        in.consume(PREAMBLE_SIZE);
+        return +DecodeStatus::Ok;
+    }
+
+    void appendFrame(const Message& message, std::string& out) {
+        size_t header = out.size();
+        out.append(HEADER_SIZE, '\0'); // 长度在负载写完后回填
+        out[header + 2] = (char)(uint8_t)message.type;
+        switch (message.type) {
+            case +MessageType::Seed:
+                for (int i = 0; i < 8; ++i) out += (char)(message.value >> (8 * i));
+                break;
+            case +MessageType::Play:
+            case +MessageType::Opponent:
+                putRecord(out, message.action);
+                break;
+            case +MessageType::DeckCode:
+                out += message.deckCode;
+                break;
+            case +MessageType::Hello: {
+                size_t nameLength = min<size_t>(message.text.size(), 255);
+                out += (char)nameLength;
+                out.append(message.text, 0, nameLength);
+                out += message.deckCode;
+                break;
+            }
+            case +MessageType::Match:
+                out += (char)message.value;
+                out += message.text;
+                break;
+            case +MessageType::Turn:
+                putU16(out, (uint16_t)message.value);
+                for (const ActionRecord& r : message.moves) putRecord(out, r);
+                break;
+            case +MessageType::Result:
+                out += (char)message.value;
+                putU16(out, (uint16_t)message.turns);
+                break;
+            case +MessageType::Snapshot:
+                putU16(out, message.view.turn);
+                out += (char)message.view.active;
+                for (const std::string& name : message.names) {
+                    size_t nameLength = min<size_t>(name.size(), 255);
+                    out += (char)nameLength;
+                    out.append(name, 0, nameLength);
+                }
+                for (const auto& side : message.view.values)
+                    for (int16_t v : side) putU16(out, (uint16_t)v);
+                break;
+            case +MessageType::Delta:
+                putRecord(out, message.action);
+                putU16(out, message.view.turn);
+                out += (char)message.view.active;
+                for (const ViewChange& change : message.changes) {
+                    out += (char)change.key;
+                    putU16(out, (uint16_t)change.value);
+                }
+                break;
+            case +MessageType::EndTurn:
+            case +MessageType::Wait:
+            case +MessageType::Quit:
+            case +MessageType::Watch:
+                break;
+            default: // 其余类型的负载都是文本
+                out += message.text;
+                break;
+        }
+        size_t length = out.size() - header - HEADER_SIZE;
+        out[header] = (char)(length & 0xFF);
+        out[header + 1] = (char)(length >> 8);
+    }
+
+    DecodeStatus nextFrame(net::RecvBuffer& in, Message& out) {
+        if (in.size() < HEADER_SIZE) return +DecodeStatus::Incomplete;
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in.data());
+        size_t length = getU16(p);
+        if (length > MAX_PAYLOAD || HEADER_SIZE + length > in.capacity()) return +DecodeStatus::Malformed;
+        if (in.size() < HEADER_SIZE + length) return +DecodeStatus::Incomplete;
+        if (!MessageType::_is_valid(p[2])) return +DecodeStatus::Malformed;
+        MessageType type = MessageType::_from_integral(p[2]);
+
+        const uint8_t* payload = p + HEADER_SIZE;
+        const char* text = reinterpret_cast<const char*>(payload);
+        bool ok = true;
+        out.type = type;
+        switch (type) {
+            case +MessageType::Seed:
+                ok = length == 8;
+                if (ok) {
+                    out.value = 0;
+                    for (int i = 0; i < 8; ++i) out.value |= (uint64_t)payload[i] << (8 * i);
+                }
+                break;
+            case +MessageType::Play:
+            case +MessageType::Opponent:
+                ok = length == ActionRecord::SIZE && getRecord(payload, out.action);
+                break;
+            case +MessageType::DeckCode:
+                out.deckCode.assign(text, length);
+                break;
+            case +MessageType::Hello:
+                ok = length >= 1 && payload[0] < length;
+                if (ok) {
+                    out.text.assign(text + 1, payload[0]);
+                    out.deckCode.assign(text + 1 + payload[0], length - 1 - payload[0]);
+                }
+                break;
+            case +MessageType::Match:
+                ok = length >= 1;
+                if (ok) {
+                    out.value = payload[0];
+                    out.text.assign(text + 1, length - 1);
+                }
+                break;
+            case +MessageType::Turn:
+                ok = length >= 2 && (length - 2) % ActionRecord::SIZE == 0;
+                if (ok) {
+                    out.value = getU16(payload);
+                    out.moves.resize((length - 2) / ActionRecord::SIZE);
+                    for (size_t i = 0; ok && i < out.moves.size(); ++i)
+                        ok = getRecord(payload + 2 + i * ActionRecord::SIZE, out.moves[i]);
+                }
+                break;
+            case +MessageType::Result:
+                ok = length == 3;
+                if (ok) {
+                    out.value = payload[0];
+                    out.turns = getU16(payload + 1);
+                }
+                break;
+            case +MessageType::Snapshot: {
+                const size_t valuesSize = 2 * VIEW_FIELDS * 2;
+                size_t at = 3;
+                for (int i = 0; ok && i < 2; ++i) {
+                    ok = at < length && at + 1 + payload[at] <= length;
+                    if (ok) {
+                        out.names[i].assign(text + at + 1, payload[at]);
+                        at += 1 + payload[at];
+                    }
+                }
+                ok = ok && length == at + valuesSize && payload[2] <= 1;
+                if (ok) {
+                    out.view.turn = getU16(payload);
+                    out.view.active = payload[2];
+                    for (int p = 0; p < 2; ++p)
+                        for (int f = 0; f < VIEW_FIELDS; ++f, at += 2) out.view.values[p][f] = (int16_t)getU16(payload + at);
+                }
+                break;
+            }
+            case +MessageType::Delta: {
+                const size_t headerSize = ActionRecord::SIZE + 3;
+                ok = length >= headerSize && (length - headerSize) % 3 == 0 && getRecord(payload, out.action) &&
+                     payload[ActionRecord::SIZE + 2] <= 1;
+                if (ok) {
+                    out.view.turn = getU16(payload + ActionRecord::SIZE);
+                    out.view.active = payload[ActionRecord::SIZE + 2];
+                    out.changes.resize((length - headerSize) / 3);
+                    for (size_t i = 0; ok && i < out.changes.size(); ++i) {
+                        const uint8_t* item = payload + headerSize + i * 3;
+                        out.changes[i] = { item[0], (int16_t)getU16(item + 1) };
+                        ok = (item[0] & 0x7F) < VIEW_FIELDS;
+                    }
+                }
+                break;
+            }
+            case +MessageType::EndTurn:
+            case +MessageType::Wait:
+            case +MessageType::Quit:
+            case +MessageType::Watch:
+                ok = length == 0;
+                break;
+            default:
+                out.text.assign(text, length);
+                break;
+        }
+        if (!ok) return +DecodeStatus::Malformed;
+        in.consume(HEADER_SIZE + length);
+        return +DecodeStatus::Ok;
+    }
+
+    // 文本格式的行动：局域网对战为 卡牌ID;角色;b|t0|t1，服务器协议为 手牌;角色;0|1|2
+    static void appendTextAction(const ActionRecord& r, std::string& out) {
+        if (r.card != ActionRecord::NO_CARD) {
+            out += CardDatabase::instance().getCard(r.card).getId();
+            out += ';';
+            out += to_string(r.actor);
+            out += r.target == 0 ? ";b" : r.target == 1 ? ";t0" : ";t1";
+        } else {
+            out += to_string(r.hand);
+            out += ';';
+            out += to_string(r.actor);
+            out += ';';
+            out += to_string(r.target);
+        }
+    }
+
+    static bool parseNumber(string_view text, uint64_t& value) {
+        auto parsed = from_chars(text.data(), text.data() + text.size(), value);
+        return parsed.ec == errc() && parsed.ptr == text.data() + text.size();
+    }
+
+    static bool parseTextAction(string_view text, ActionRecord& r) {
+        string_view fields[3];
+        for (int i = 0; i < 3; ++i) {
+            size_t sep = i < 2 ? text.find(';') : text.size();
+            if (sep == string_view::npos) return false;
+            fields[i] = text.substr(0, sep);
+            text.remove_prefix(min(sep + 1, text.size()));
+        }
+        uint64_t hand = 0, actor, target;
+        if (!parseNumber(fields[1], actor) || actor > 255) return false;
+        r = ActionRecord();
+        r.type = ActionType::PlayCard;
+        r.actor = (uint8_t)actor;
+        if (fields[2] == "b" || fields[2] == "t0" || fields[2] == "t1") {
+            auto card = CardDatabase::instance().findCardById(fields[0]);
+            if (!card) return false;
+            r.card = card->getHandle();
+            r.target = fields[2] == "b" ? 0 : fields[2] == "t0" ? 1 : 2;
+            return true;
+        }
+        if (!parseNumber(fields[0], hand) || hand > 255 || !parseNumber(fields[2], target) || target > 2) return false;
+        r.hand = (uint8_t)hand;
+        r.target = (uint8_t)target;
+        return true;
+    }
+
+    void appendText(const Message& message, std::string& out) {
+        switch (message.type) {
+            case +MessageType::Name:       out += "NAME;"; out += message.text; break;
+            case +MessageType::Seed:       out += "SEED;"; out += to_string(message.value); break;
+            case +MessageType::DeckCode:   out += "DECKCODE;"; out += message.deckCode; break;
+            case +MessageType::Characters: out += "CHARS;"; out += message.text; break;
+            case +MessageType::Emoji:      out += "EMOJI;"; out += message.text; break;
+            case +MessageType::Wait:       out += "WAIT"; break;
+            case +MessageType::Quit:       out += "QUIT"; break;
+            case +MessageType::Watch:      out += "WATCH"; break;
+            case +MessageType::Snapshot:   // 观战数据没有文本格式
+            case +MessageType::Delta:
+                return;
+            case +MessageType::Reject:     out += "REJECT;"; out += message.text; break;
+            case +MessageType::Error:      out += "ERROR;"; out += message.text; break;
+            case +MessageType::EndTurn:    out += "ENDTURN"; break;
+            case +MessageType::Play:
+                out += "PLAY;";
+                appendTextAction(message.action, out);
+                break;
+            case +MessageType::Opponent:
+                if (message.action.type == ActionType::PlayCard) {
+                    out += "OPP;PLAY;";
+                    appendTextAction(message.action, out);
+                } else {
+                    out += "OPP;ENDTURN";
+                }
+                break;
+            case +MessageType::Hello:
+                out += "HELLO;"; out += message.text; out += ';'; out += message.deckCode;
+                break;
+            case +MessageType::Match:
+                out += "MATCH;"; out += to_string(message.value); out += ';'; out += message.text;
+                break;
+            case +MessageType::Turn:
+                out += "TURN;"; out += to_string(message.value); out += ';';
+                for (size_t i = 0; i < message.moves.size(); ++i) {
+                    const ActionRecord& r = message.moves[i];
+                    if (i) out += ',';
+                    out += to_string(r.hand); out += ':'; out += to_string(r.actor); out += ':'; out += to_string(r.target);
+                }
+                break;
+            case +MessageType::Result:
+                out += "RESULT;"; out += to_string(message.value); out += ';'; out += to_string(message.turns);
+                break;
+        }
+        out += '\n';
+    }
+
+    bool parseText(string_view line, Message& out) {
+        auto startsWith = [&](string_view prefix) {
+            if (line.compare(0, prefix.size(), prefix) != 0) return false;
+            line.remove_prefix(prefix.size());
+            return true;
+        };
+        uint64_t number;
+        if (startsWith("NAME;"))     { out.type = +MessageType::Name; out.text.assign(line); return true; }
+        if (startsWith("SEED;"))     { out.type = +MessageType::Seed; return parseNumber(line, out.value); }
+        if (startsWith("DECKCODE;")) { out.type = +MessageType::DeckCode; out.deckCode.assign(line); return true; }
+        if (startsWith("CHARS;"))    { out.type = +MessageType::Characters; out.text.assign(line); return true; }
+        if (startsWith("EMOJI;"))    { out.type = +MessageType::Emoji; out.text.assign(line); return true; }
+        if (startsWith("REJECT;"))   { out.type = +MessageType::Reject; out.text.assign(line); return true; }
+        if (startsWith("ERROR;"))    { out.type = +MessageType::Error; out.text.assign(line); return true; }
+        if (startsWith("PLAY;"))     { out.type = +MessageType::Play; return parseTextAction(line, out.action); }
+        if (line == "ENDTURN" || line == "END") { out.type = +MessageType::EndTurn; return true; }
+        if (line == "WAIT") { out.type = +MessageType::Wait; return true; }
+        if (line == "QUIT") { out.type = +MessageType::Quit; return true; }
+        if (line == "WATCH") { out.type = +MessageType::Watch; return true; }
+        if (startsWith("OPP;")) {
+            out.type = +MessageType::Opponent;
+            if (line == "ENDTURN" || line == "END") { out.action = ActionRecord(); return true; }
+            return startsWith("PLAY;") && parseTextAction(line, out.action);
+        }
+
+        // 其余消息为 前缀;第一个字段;剩余部分
+        bool hello = startsWith("HELLO;");
+        bool match = !hello && startsWith("MATCH;");
+        bool result = !hello && !match && startsWith("RESULT;");
+        bool turn = !hello && !match && !result && startsWith("TURN;");
+        size_t sep = line.find(';');
+        if ((!hello && !match && !result && !turn) || sep == string_view::npos) return false;
+        string_view first = line.substr(0, sep);
+        string_view rest = line.substr(sep + 1);
+        if (hello) {
+            out.type = +MessageType::Hello;
+            out.text.assign(first);
+            out.deckCode.assign(rest);
+            return true;
+        }
+        if (!parseNumber(first, out.value)) return false;
+        if (match) {
+            out.type = +MessageType::Match;
+            out.text.assign(rest);
+            return true;
+        }
+        if (result) {
+            out.type = +MessageType::Result;
+            if (!parseNumber(rest, number)) return false;
+            out.turns = (uint32_t)number;
+            return true;
+        }
+        // TURN;<回合>;<手牌:角色:目标,...>
+        out.type = +MessageType::Turn;
+        out.moves.clear();
+        while (!rest.empty()) {
+            size_t comma = rest.find(',');
+            string_view move = rest.substr(0, comma);
+            rest.remove_prefix(comma == string_view::npos ? rest.size() : comma + 1);
+            ActionRecord r;
+            r.type = ActionType::PlayCard;
+            uint64_t fields[3];
+            for (int i = 0; i < 3; ++i) {
+                size_t colon = i < 2 ? move.find(':') : move.size();
+                if (colon == string_view::npos || !parseNumber(move.substr(0, colon), fields[i]) || fields[i] > 255) return false;
+                move.remove_prefix(min(colon + 1, move.size()));
+            }
+            if (fields[2] > 2) return false;
+            r.hand = (uint8_t)fields[0];
+            r.actor = (uint8_t)fields[1];
+            r.target = (uint8_t)fields[2];
+            out.moves.push_back(r);
+        }
+        return true;
+    }
+}
+
+// 由牌组代码构建对局配置；牌组代码不足 3 个角色时按角色库顺序补齐
+static bool setupFromDeckCode(string_view deckCode, const string& name, PlayerSetup& out) {
+    const CharacterDatabase& characterDB = CharacterDatabase::instance();
+    DeckCodeParser parser(CardDatabase::instance(), characterDB);
+    DecodedDeck decoded;
+    if (!parser.parse(deckCode, decoded)) return false;
+    const auto& allCharacters = characterDB.getAllCharacters();
+    out.name = name;
+    out.deck.swap(decoded.cards);
+    out.characters.clear();
+    for (uint16_t index : decoded.characters) out.characters.push_back(allCharacters[index]);
+    for (const auto& ch : allCharacters) {
+        if (out.characters.size() >= 3) break;
+        if (find(out.characters.begin(), out.characters.end(), ch) == out.characters.end()) out.characters.push_back(ch);
+    }
+    return !out.deck.empty();
+}
+
+// 局域网联机实现
+LanLink::LanLink(bool textProtocol, size_t bufferSize)
+    : textProtocol(textProtocol), inbox(bufferSize), peerPreamble(textProtocol), inboundQ(64), outboundQ(64) {}
+
+net::Socket LanLink::acceptPeer(const net::Socket& listener, int timeoutMs, string* error) {
+    net::Socket peer;
+    net::EventLoop acceptLoop;
+    if (!acceptLoop.isOpen()) { if (error) *error = net::lastError(); return peer; }
+    acceptLoop.add(listener.get(), net::EventLoop::READABLE, [&](int) { if (!peer.valid()) peer = listener.accept(); });
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(max(0, timeoutMs));
+    while (!peer.valid()) {
+        int wait = -1;
+        if (timeoutMs >= 0) {
+            wait = (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            if (wait <= 0) { if (error) *error = "等待连接超时"; break; }
+        }
+        if (acceptLoop.poll(wait) < 0) { if (error) *error = net::lastError(); break; }
+    }
+    return peer;
+}
+
+bool LanLink::start(net::Socket socket, string* error) {
+    if (!loop.isOpen()) { if (error) *error = "事件循环创建失败: " + net::lastError(); return false; }
+    conn = move(socket);
+    if (!textProtocol) { wire::appendPreamble(encoded); outbox.append(encoded); }
+    running = true;
+    loop.add(conn.get(), net::EventLoop::READABLE, [this](int events) {
+        if (events & net::EventLoop::READABLE) {
+            bool ok = inbox.fill(conn);
+            // 对端关闭前发来的消息照常解码
+            if (!decodeIncoming() || !ok) { closeConnection(); return; }
+        }
+        if ((events & net::EventLoop::WRITABLE) && !outbox.flush(conn)) closeConnection();
+    });
+    netThread = thread(&LanLink::runNetwork, this);
+    return true;
+}
+
+void LanLink::stop() {
+    running = false;
+    loop.wakeup();
+    inboundQ.wake();
+    if (netThread.joinable()) netThread.join();
+    loop.remove(conn.get());
+    conn.close();
+}
+
+void LanLink::closeConnection() {
+    running = false;
+    loop.remove(conn.get());
+    inboundQ.wake();
+}
+
+// 返回 false 表示对端发来无法解析的数据；接收队列满时置 inboundStalled，剩余数据留在缓冲中
+bool LanLink::decodeIncoming() {
+    inboundStalled = false;
+    if (textProtocol) {
+        string_view line;
+        while (wire::Message* slot = inboundQ.prepare()) {
+            if (!inbox.nextLine(line)) return !inbox.full(); // 单行超过缓冲容量
+            if (!wire::parseText(line, *slot)) {
+                // 无法解析的行按协议错误断开；以二进制前导开头说明对端使用的是二进制协议
+                mismatch = line.compare(0, sizeof(wire::PREAMBLE), string_view(wire::PREAMBLE, sizeof(wire::PREAMBLE))) == 0;
+                return false;
+            }
+            inboundQ.commit();
+        }
+        inboundStalled = true;
+        return true;
+    }
+    if (!peerPreamble) {
+        wire::DecodeStatus status = wire::readPreamble(inbox);
+        if (status == +wire::DecodeStatus::Malformed) { mismatch = true; return false; }
+        if (status == +wire::DecodeStatus::Incomplete) return true;
+        peerPreamble = true;
+    }
+    while (wire::Message* slot = inboundQ.prepare()) {
+        wire::DecodeStatus status = wire::nextFrame(inbox, *slot);
+        if (status == +wire::DecodeStatus::Incomplete) return true;
+        if (status == +wire::DecodeStatus::Malformed) return false;
+        inboundQ.commit();
+    }
+    inboundStalled = true;
+    return true;
+}
+
+void LanLink::runNetwork() {
+    while (running) {
+        while (wire::Message* m = outboundQ.front()) {
+            encoded.clear();
+            if (textProtocol) wire::appendText(*m, encoded);
+            else wire::appendFrame(*m, encoded);
+            outboundQ.pop();
+            outbox.append(encoded);
+        }
+        if (inboundStalled && !decodeIncoming()) { closeConnection(); break; }
+        if (!outbox.empty() && !outbox.flush(conn)) { closeConnection(); break; }
+        loop.modify(conn.get(), (inboundStalled ? 0 : net::EventLoop::READABLE) | (outbox.empty() ? 0 : net::EventLoop::WRITABLE));
+        if (loop.poll(200) < 0) { closeConnection(); break; }
+    }
+}
+
+// 提交后经事件循环的唤醒句柄通知网络线程
+void LanLink::send(const wire::Message& message) {
+    while (!outboundQ.push(message)) {
+        if (!running) return;
+        loop.wakeup();
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    loop.wakeup();
+}
+
+// 归还队首槽位，网络线程若因队列满而暂停则唤醒它继续解码
+void LanLink::release() {
+    inboundQ.pop();
+    if (inboundStalled) loop.wakeup();
+}
+
+// 对战服务器实现
+namespace {
+    const size_t SESSION_RECV_BYTES = 512;     // 最长的消息是 HELLO，牌组代码不到 100 字节
+    const size_t SESSION_SEND_KEEP = 256;      // 会话回池时保留的发送缓冲容量
+    const size_t SESSION_SEND_LIMIT = 64 * 1024; // 对端长期不读时断开
+    const size_t MAX_NAME_BYTES = 32;
+}
+
+struct GameServer::Session {
+    net::Socket socket;
+    net::RecvBuffer inbox{ SESSION_RECV_BYTES };
+    net::SendBuffer outbox;
+    net::ChunkQueue feed;   // 观战数据；非空时之后的消息也排在它后面，保证顺序
+    Match* watching = nullptr;
+    size_t spectatorSlot = 0; // 在 watching->spectators 中的下标
+    bool writable = false;  // 是否已关注可写事件
+    bool dirty = false;     // 本轮有待发送的数据
+    bool detected = false;  // 已根据首个字节确定协议
+    bool binary = true;
+    SessionPhase phase = +SessionPhase::Idle;
+    Match* match = nullptr;
+    int seat = 0;
+    PlayerSetup setup;
+    chrono::steady_clock::time_point waitingSince;
+};
+
+struct GameServer::Match {
+    MatchEngine engine;
+    Session* seats[2] = { nullptr, nullptr }; // nullptr 为服务器 AI
+    RandomPlayer bot;
+    PlayerSetup botSetup;
+    vector<Action> legal;
+    // 观战：只在有观众时按行动编码增量，本轮结束时合成一个共享块分发
+    vector<Session*> spectators;
+    wire::SpectatorView view;   // 上一次编码增量后的视图
+    string feed;                // 本轮待分发的已编码帧
+    net::SharedChunk snapshot;  // 当前状态的快照帧，状态变化时作废
+    bool publishing = false;    // 已在分片的待分发列表中
+
+    Match(const PlayerSetup& first, const PlayerSetup& second, uint64_t seed)
+        : engine(first, second, seed), bot(playerSeed(seed, 1)) {
+        engine.setRecordHistory(false);
+    }
+};
+
+struct GameServer::Shard {
+    net::Socket listener;
+    net::EventLoop loop;
+    bool allowText;
+    vector<unique_ptr<Session>> sessions;
+    vector<Session*> freeSessions;
+    vector<Session*> dirty; // 一轮事件处理完后统一发送，多条消息合并为一次写
+    vector<unique_ptr<Match>> matches;
+    vector<Match*> freeMatches;
+    Session* waiting = nullptr;
+    Match* featured = nullptr;          // 最近开始且仍在进行的对局，新观众观看这一局
+    vector<Session*> pendingSpectators; // 等待下一局开始的观众
+    vector<Match*> publishing;          // 本轮有待分发增量的对局
+    Rng rng;
+    wire::Message received;
+    wire::Message reply;
+    wire::Message spectate;
+    string encoded; // 编码缓冲，复用容量
+
+    atomic<unsigned long long> connections{ 0 }, activeSessions{ 0 }, matchesStarted{ 0 },
+        matchesFinished{ 0 }, botMatches{ 0 }, actions{ 0 }, rejected{ 0 },
+        spectators{ 0 }, broadcastBytes{ 0 }, fanoutBytes{ 0 };
+
+    Shard(uint64_t seed, bool allowText) : allowText(allowText), rng(seed) {}
+
+    void acceptAll() {
+        while (true) {
+            net::Socket client = listener.accept();
+            if (!client.valid()) return;
+            Session* session;
+            if (!freeSessions.empty()) {
+                session = freeSessions.back();
+                freeSessions.pop_back();
+            } else {
+                sessions.emplace_back(new Session());
+                session = sessions.back().get();
+            }
+            session->socket = move(client);
+            if (!loop.add(session->socket.get(), net::EventLoop::READABLE,
+                          [this, session](int events) { onEvents(*session, events); })) {
+                session->socket.close();
+                freeSessions.push_back(session);
+                continue;
+            }
+            connections.fetch_add(1, memory_order_relaxed);
+            activeSessions.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    void onEvents(Session& session, int events) {
+        if (events & net::EventLoop::READABLE) {
+            bool ok = session.inbox.fill(session.socket);
+            if (!ok && session.inbox.size() == 0) { close(session); return; }
+            if (!decodeAll(session)) return;
+            if (!ok || session.inbox.full()) { close(session); return; }
+        }
+        if (events & net::EventLoop::WRITABLE) {
+            if (!flushSession(session)) { close(session); return; }
+            updateInterest(session);
+        }
+    }
+
+    // 先写私有的发送缓冲，写完后再写观战数据
+    bool flushSession(Session& session) {
+        if (!session.outbox.flush(session.socket)) return false;
+        return !session.outbox.empty() || session.feed.flush(session.socket);
+    }
+
+    // 解出缓冲中所有完整的消息；会话在处理中被关闭时返回 false
+    bool decodeAll(Session& session) {
+        if (!session.detected) {
+            if (session.inbox.size() == 0) return true;
+            // 二进制客户端以前导 "MWP" 开头；文本协议的消息都以大写字母开头且不会是 M 之外的前导
+            if (session.inbox.data()[0] == 'M') {
+                wire::DecodeStatus status = wire::readPreamble(session.inbox);
+                if (status == +wire::DecodeStatus::Incomplete) return true;
+                if (status == +wire::DecodeStatus::Malformed) { sendError(session, "BadVersion"); return false; }
+                session.binary = true;
+                encoded.clear();
+                wire::appendPreamble(encoded);
+                session.outbox.append(encoded);
+                markDirty(session);
+            } else if (allowText) {
+                session.binary = false;
+            } else {
+                session.binary = false;
+                sendError(session, "TextProtocolDisabled");
+                return false;
+            }
+            session.detected = true;
+        }
+        if (!session.binary) {
+            string_view text;
+            while (session.socket.valid() && session.inbox.nextLine(text)) {
+                if (wire::parseText(text, received)) handleMessage(session, received);
+                else sendReject(session, "BadMessage");
+            }
+            return session.socket.valid();
+        }
+        while (session.socket.valid()) {
+            wire::DecodeStatus status = wire::nextFrame(session.inbox, received);
+            if (status == +wire::DecodeStatus::Incomplete) break;
+            if (status == +wire::DecodeStatus::Malformed) { sendError(session, "BadMessage"); return false; }
+            handleMessage(session, received);
+        }
+        return session.socket.valid();
+    }
+
+    // 只编码进发送缓冲，本轮事件处理完后由 flushDirty 统一写出；写失败时关闭会话
+    void send(Session& session, const wire::Message& message) {
+        if (!session.socket.valid()) return;
+        encoded.clear();
+        if (session.binary) wire::appendFrame(message, encoded);
+        else wire::appendText(message, encoded);
+        if (session.feed.empty()) session.outbox.append(encoded);
+        else session.feed.push(make_shared<const string>(encoded));
+        markDirty(session);
+    }
+
+    void markDirty(Session& session) {
+        if (session.dirty) return;
+        session.dirty = true;
+        dirty.push_back(&session);
+    }
+
+    void flushDirty() {
+        // 关闭会话可能向对手追加消息，用下标遍历
+        for (size_t i = 0; i < dirty.size(); ++i) {
+            Session& session = *dirty[i];
+            session.dirty = false;
+            if (!session.socket.valid()) continue;
+            if (!flushSession(session) || session.outbox.pending() + session.feed.pending() > SESSION_SEND_LIMIT) {
+                close(session);
+                continue;
+            }
+            updateInterest(session);
+        }
+        dirty.clear();
+    }
+
+    void sendReject(Session& session, const char* reason) {
+        reply.type = +wire::MessageType::Reject;
+        reply.text = reason;
+        send(session, reply);
+    }
+
+    // 发送错误并断开；错误消息尽力写出一次
+    void sendError(Session& session, const char* reason) {
+        reply.type = +wire::MessageType::Error;
+        reply.text = reason;
+        send(session, reply);
+        flushSession(session);
+        close(session);
+    }
+
+    void updateInterest(Session& session) {
+        bool want = !session.outbox.empty() || !session.feed.empty();
+        if (want == session.writable) return;
+        session.writable = want;
+        loop.modify(session.socket.get(), net::EventLoop::READABLE | (want ? net::EventLoop::WRITABLE : 0));
+    }
+
+    void close(Session& session) {
+        if (!session.socket.valid()) return;
+        loop.remove(session.socket.get());
+        session.socket.close();
+        if (waiting == &session) waiting = nullptr;
+        if (session.phase == +SessionPhase::Spectating) {
+            if (session.watching) detachSpectator(session);
+            else pendingSpectators.erase(find(pendingSpectators.begin(), pendingSpectators.end(), &session));
+        }
+        if (Match* match = session.match) {
+            // 中途断开判负
+            match->seats[session.seat] = nullptr;
+            session.match = nullptr;
+            finishMatch(*match, 2 - session.seat);
+        }
+        session.inbox.clear();
+        session.outbox.clear(SESSION_SEND_KEEP);
+        session.feed.clear();
+        session.writable = false;
+        session.detected = false;
+        session.phase = +SessionPhase::Idle;
+        session.setup.deck.clear();
+        session.setup.characters.clear();
+        freeSessions.push_back(&session);
+        activeSessions.fetch_sub(1, memory_order_relaxed);
+    }
+
+    void handleMessage(Session& session, const wire::Message& message) {
+        switch (message.type) {
+            case +wire::MessageType::Hello:
+                if (session.phase != +SessionPhase::Idle) { sendReject(session, "Busy"); return; }
+                if (!setupFromDeckCode(message.deckCode, message.text.substr(0, MAX_NAME_BYTES), session.setup)) {
+                    sendError(session, "BadDeck");
+                    return;
+                }
+                if (waiting && waiting != &session) {
+                    Session* opponent = waiting;
+                    waiting = nullptr;
+                    startMatch(opponent, &session);
+                } else {
+                    waiting = &session;
+                    session.phase = +SessionPhase::Waiting;
+                    session.waitingSince = chrono::steady_clock::now();
+                    reply.type = +wire::MessageType::Wait;
+                    send(session, reply);
+                }
+                return;
+            case +wire::MessageType::Watch:
+                if (session.phase != +SessionPhase::Idle) { sendReject(session, "Busy"); return; }
+                if (!session.binary) { sendReject(session, "BinaryOnly"); return; }
+                if (featured) {
+                    attachSpectator(session, *featured);
+                } else {
+                    session.phase = +SessionPhase::Spectating;
+                    pendingSpectators.push_back(&session);
+                    reply.type = +wire::MessageType::Wait;
+                    send(session, reply);
+                }
+                return;
+            case +wire::MessageType::Quit:
+                close(session);
+                return;
+            case +wire::MessageType::Play:
+            case +wire::MessageType::EndTurn:
+                break;
+            default:
+                sendReject(session, "BadMessage");
+                return;
+        }
+
+        Match* match = session.match;
+        if (!match) { sendReject(session, "NotInMatch"); return; }
+        if (match->engine.getActive() != session.seat) { sendReject(session, "NotYourTurn"); return; }
+        Action action = message.type == +wire::MessageType::Play ? message.action.toAction() : Action::endTurn();
+        CardHandle card = playedCard(match->engine, action);
+        ActionResult result = match->engine.applyAction(action);
+        if (result != +ActionResult::Ok) {
+            rejected.fetch_add(1, memory_order_relaxed);
+            sendReject(session, result._to_string());
+            return;
+        }
+        actions.fetch_add(1, memory_order_relaxed);
+        broadcastAction(*match, action, card);
+        if (Session* opponent = match->seats[1 - session.seat]) sendOpponentAction(*opponent, action);
+        advance(*match);
+    }
+
+    void sendOpponentAction(Session& session, const Action& action) {
+        reply.type = +wire::MessageType::Opponent;
+        reply.action = wire::ActionRecord::from(action);
+        send(session, reply);
+    }
+
+    // 行动将要打出的卡牌，供观战增量显示；行动非法时结果无意义（随后被引擎拒绝）
+    static CardHandle playedCard(const MatchEngine& engine, const Action& action) {
+        if (action.type != +ActionType::PlayCard) return wire::ActionRecord::NO_CARD;
+        const PlayerState& player = engine.getPlayer(engine.getActive());
+        if (action.handIndex < 0 || action.handIndex >= (int)player.hand.size()) return wire::ActionRecord::NO_CARD;
+        return player.hand[action.handIndex];
+    }
+
+    // 新观众先收到当前状态的快照；在此之前先把本轮已编码的增量分发给原有观众
+    void attachSpectator(Session& session, Match& match) {
+        publish(match);
+        if (!match.snapshot) {
+            match.view = wire::SpectatorView::of(match.engine.getState());
+            spectate.type = +wire::MessageType::Snapshot;
+            spectate.view = match.view;
+            for (int i = 0; i < 2; ++i) spectate.names[i] = match.engine.getPlayerName(i);
+            encoded.clear();
+            wire::appendFrame(spectate, encoded);
+            match.snapshot = make_shared<const string>(encoded);
+            broadcastBytes.fetch_add(encoded.size(), memory_order_relaxed);
+        }
+        session.phase = +SessionPhase::Spectating;
+        session.watching = &match;
+        session.spectatorSlot = match.spectators.size();
+        match.spectators.push_back(&session);
+        session.feed.push(match.snapshot);
+        markDirty(session);
+        spectators.fetch_add(1, memory_order_relaxed);
+        fanoutBytes.fetch_add(match.snapshot->size(), memory_order_relaxed);
+    }
+
+    void detachSpectator(Session& session) {
+        Match& match = *session.watching;
+        Session* last = match.spectators.back();
+        match.spectators[session.spectatorSlot] = last;
+        last->spectatorSlot = session.spectatorSlot;
+        match.spectators.pop_back();
+        session.watching = nullptr;
+        spectators.fetch_sub(1, memory_order_relaxed);
+    }
+
+    // 行动被引擎接受后调用：对局状态已变，快照作废；有观众时编码一帧增量
+    void broadcastAction(Match& match, const Action& action, CardHandle card) {
+        match.snapshot.reset();
+        if (match.spectators.empty()) return;
+        wire::SpectatorView now = wire::SpectatorView::of(match.engine.getState());
+        spectate.type = +wire::MessageType::Delta;
+        spectate.action = wire::ActionRecord::from(action, card);
+        spectate.view = now;
+        spectate.changes.clear();
+        now.diff(match.view, spectate.changes);
+        match.view = now;
+        appendFeed(match, spectate);
+    }
+
+    void appendFeed(Match& match, const wire::Message& message) {
+        size_t before = match.feed.size();
+        wire::appendFrame(message, match.feed);
+        broadcastBytes.fetch_add(match.feed.size() - before, memory_order_relaxed);
+        if (!match.publishing) {
+            match.publishing = true;
+            publishing.push_back(&match);
+        }
+    }
+
+    // 本轮的增量合成一个共享块，每个观众的发送队列只增加一个引用，数据不按观众复制
+    void publish(Match& match) {
+        if (match.feed.empty()) return;
+        if (!match.spectators.empty()) {
+            net::SharedChunk chunk = make_shared<const string>(match.feed);
+            for (Session* s : match.spectators) {
+                s->feed.push(chunk);
+                markDirty(*s);
+            }
+            fanoutBytes.fetch_add(chunk->size() * match.spectators.size(), memory_order_relaxed);
+        }
+        match.feed.clear();
+    }
+
+    void publishAll() {
+        for (Match* match : publishing) {
+            match->publishing = false;
+            publish(*match);
+        }
+        publishing.clear();
+    }
+
+    // 对局对象只在池空时新建，构造时的配置随即被 start 覆盖
+    Match* acquireMatch(const PlayerSetup& setup) {
+        if (!freeMatches.empty()) {
+            Match* match = freeMatches.back();
+            freeMatches.pop_back();
+            return match;
+        }
+        matches.emplace_back(new Match(setup, setup, 0));
+        return matches.back().get();
+    }
+
+    // b 为空时与服务器 AI 对局，AI 使用与玩家相同的牌组；先手随机
+    void startMatch(Session* a, Session* b) {
+        Match* match = acquireMatch(a->setup);
+        if (!b) {
+            match->botSetup.name = "服务器AI";
+            match->botSetup.deck = a->setup.deck;
+            match->botSetup.characters = a->setup.characters;
+            botMatches.fetch_add(1, memory_order_relaxed);
+        }
+        int first = (int)rng.below(2);
+        Session* seats[2] = { first ? b : a, first ? a : b };
+        const PlayerSetup* setups[2];
+        for (int i = 0; i < 2; ++i) setups[i] = seats[i] ? &seats[i]->setup : &match->botSetup;
+        uint64_t seed = rng.next();
+        match->engine.start(*setups[0], *setups[1], seed);
+        match->bot = RandomPlayer(playerSeed(seed, 1));
+        match->snapshot.reset();
+        matchesStarted.fetch_add(1, memory_order_relaxed);
+
+        for (int i = 0; i < 2; ++i) {
+            match->seats[i] = seats[i];
+            Session* s = seats[i];
+            if (!s) continue;
+            s->match = match;
+            s->seat = i;
+            s->phase = +SessionPhase::Playing;
+            reply.type = +wire::MessageType::Match;
+            reply.value = i + 1;
+            reply.text = setups[1 - i]->name;
+            send(*s, reply);
+        }
+        featured = match;
+        for (Session* s : pendingSpectators) attachSpectator(*s, *match);
+        pendingSpectators.clear();
+        advance(*match);
+    }
+
+    // 推进对局：AI 的回合直接在分片线程内走完；轮到玩家时发送可选行动
+    void advance(Match& match) {
+        MatchEngine& engine = match.engine;
+        while (!engine.isFinished() && engine.getTurn() <= MAX_TURNS && !match.seats[engine.getActive()]) {
+            int actor = engine.getActive();
+            Action action = match.bot.chooseAction(engine, actor);
+            CardHandle card = playedCard(engine, action);
+            if (engine.applyAction(action) != +ActionResult::Ok) {
+                action = Action::endTurn();
+                card = wire::ActionRecord::NO_CARD;
+                engine.applyAction(action);
+            }
+            broadcastAction(match, action, card);
+            if (Session* human = match.seats[1 - actor]) sendOpponentAction(*human, action);
+        }
+        if (engine.isFinished() || engine.getTurn() > MAX_TURNS) {
+            finishMatch(match, engine.isFinished() ? engine.getWinner() : 0);
+            return;
+        }
+        engine.legalActions(match.legal);
+        reply.type = +wire::MessageType::Turn;
+        reply.value = (uint64_t)engine.getTurn();
+        reply.moves.clear();
+        for (const Action& a : match.legal)
+            if (a.type == +ActionType::PlayCard) reply.moves.push_back(wire::ActionRecord::from(a));
+        send(*match.seats[engine.getActive()], reply);
+    }
+
+    void finishMatch(Match& match, int winner) {
+        Session* seats[2] = { match.seats[0], match.seats[1] };
+        match.seats[0] = match.seats[1] = nullptr;
+        reply.type = +wire::MessageType::Result;
+        reply.value = (uint64_t)winner;
+        reply.turns = (uint32_t)match.engine.getTurn();
+        for (Session* s : seats) {
+            if (!s) continue;
+            s->match = nullptr;
+            s->phase = +SessionPhase::Idle;
+            send(*s, reply);
+        }
+        // 观众随最后的增量一起收到结果，之后回到空闲状态，可再次观战
+        if (!match.spectators.empty()) {
+            appendFeed(match, reply);
+            publish(match);
+            for (Session* s : match.spectators) {
+                s->watching = nullptr;
+                s->phase = +SessionPhase::Idle;
+            }
+            spectators.fetch_sub(match.spectators.size(), memory_order_relaxed);
+            match.spectators.clear();
+        }
+        match.snapshot.reset();
+        if (featured == &match) featured = nullptr;
+        freeMatches.push_back(&match);
+        matchesFinished.fetch_add(1, memory_order_relaxed);
+    }
+
+    void checkWaiting(chrono::steady_clock::time_point now) {
+        if (waiting && now - waiting->waitingSince >= chrono::milliseconds(MATCH_WAIT_MS)) {
+            Session* alone = waiting;
+            waiting = nullptr;
+            startMatch(alone, nullptr);
+        }
+    }
+};
+
+GameServer::GameServer(uint16_t port, unsigned int threads, bool allowText)
+    : port(port), allowText(allowText), threadCount(threads ? threads : max(1u, thread::hardware_concurrency())) {
+#ifndef SO_REUSEPORT
+    threadCount = 1;
+#endif
+}
+
+GameServer::~GameServer() {
+    stop();
+}
+
+bool GameServer::start(string* error) {
+    if (running) return true;
+    shards.clear();
+    uint64_t seed = mixSeed((uint64_t)chrono::steady_clock::now().time_since_epoch().count());
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        unique_ptr<Shard> shard(new Shard(mixSeed(seed + i), allowText));
+        shard->listener = net::Socket::listenTcp(port, 1024, threadCount > 1, error);
+        if (!shard->listener.valid() || !shard->loop.isOpen()) {
+            if (error && error->empty()) *error = "事件循环创建失败";
+            shards.clear();
+            return false;
+        }
+        if (port == 0) port = shard->listener.localPort(); // 其余分片绑定到同一个临时端口
+        Shard* s = shard.get();
+        s->loop.add(s->listener.get(), net::EventLoop::READABLE, [s](int) { s->acceptAll(); });
+        shards.push_back(move(shard));
+    }
+    running = true;
+    for (auto& shard : shards) {
+        Shard* s = shard.get();
+        threads.emplace_back([this, s] { runShard(*s, running); });
+    }
+    return true;
+}
+
+void GameServer::stop() {
+    if (!running) return;
+    running = false;
+    for (auto& shard : shards) shard->loop.wakeup();
+    for (auto& t : threads) t.join();
+    threads.clear();
+    shards.clear();
+}
+
+void GameServer::runShard(Shard& shard, const atomic<bool>& running) {
+    while (running) {
+        if (shard.loop.poll(100) < 0) break;
+        shard.checkWaiting(chrono::steady_clock::now());
+        shard.publishAll();
+        shard.flushDirty();
+    }
+}
+
+GameServer::Stats GameServer::getStats() const {
+    Stats stats;
+    for (const auto& s : shards) {
+        stats.connections += s->connections.load(memory_order_relaxed);
+        stats.activeSessions += s->activeSessions.load(memory_order_relaxed);
+        stats.matchesStarted += s->matchesStarted.load(memory_order_relaxed);
+        stats.matchesFinished += s->matchesFinished.load(memory_order_relaxed);
+        stats.botMatches += s->botMatches.load(memory_order_relaxed);
+        stats.actions += s->actions.load(memory_order_relaxed);
+        stats.rejected += s->rejected.load(memory_order_relaxed);
+        stats.spectators += s->spectators.load(memory_order_relaxed);
+        stats.broadcastBytes += s->broadcastBytes.load(memory_order_relaxed);
+        stats.fanoutBytes += s->fanoutBytes.load(memory_order_relaxed);
+    }
+    return stats;
+}
+
+size_t GameServer::sessionBytes() {
+    return sizeof(Session) + SESSION_RECV_BYTES + SESSION_SEND_KEEP;
+}
+
+size_t GameServer::matchBytes() {
+    return sizeof(Match);
+}
+
+// ConsolePlayer 实现
+static void showPlayerState(const string& name, const PlayerState& p) {
+    cout << "\n玩家: " << name << " | 基地生命: " << p.baseHP << " | 基地魔力: " << p.baseMana << endl;
+    cout << "前场角色:" << endl;
+    for (int i = 0; i < (int)p.chars.size() && i < 2; ++i) {
+        const auto& pcs = p.chars[i];
+        cout << " [" << i << "] " << pcs.ch->getName() << " (HP: " << pcs.curHP << "/" << pcs.ch->getHealth()
+             << ", MP: " << pcs.curEnergy << "/" << pcs.ch->getEnergy() << ")" << endl;
+    }
+    if (p.chars.size() == 3) {
+        const auto& r = p.chars[2];
+        cout << " 后场替补: " << r.ch->getName() << " (HP: " << r.curHP << "/" << r.ch->getHealth()
+             << ", MP: " << r.curEnergy << "/" << r.ch->getEnergy() << ")" << endl;
+    } else cout << " 无后场替补" << endl;
+    cout << "手牌(" << p.hand.size() << "): ";
+    const CardDatabase& catalog = CardDatabase::instance();
+    for (int i = 0; i < (int)p.hand.size(); ++i) cout << "[" << i << "]" << catalog.getCard(p.hand[i]).getName() << " ";
+    cout << endl;
+    if (p.playsLeft >= 0) cout << "时空限速：对手的下个回合开始前还能打出 " << p.playsLeft << " 张牌" << endl;
+}
+
+Action ConsolePlayer::chooseAction(const MatchEngine& engine, int self) {
+    while (true) {
+        showPlayerState(engine.getPlayerName(self), engine.getPlayer(self));
+        showPlayerState(engine.getPlayerName(1 - self), engine.getPlayer(1 - self));
+
+        cout << "\n操作：p 出牌；e 结束回合；q 退出对局。输入操作字母: ";
+        string op; getline(cin, op);
+        if (!cin || op == "q" || op == "Q") return Action::quit();
+        if (op == "e" || op == "E") return Action::endTurn();
+        if (op != "p" && op != "P") { cout << "未知操作，请重试。" << endl; continue; }
+
+        if (engine.getPlayer(self).hand.empty()) { cout << "手牌为空，无法出牌。" << endl; continue; }
+        cout << "选择出牌的手牌索引: ";
+        string idxs; getline(cin, idxs);
+        int hidx = -1;
+        try { hidx = stoi(idxs); } catch(...) { hidx = -1; }
+        cout << "选择使用该牌的前场角色索引(0或1): ";
+        string sidx; getline(cin, sidx);
+        int charIdx = -1; try { charIdx = stoi(sidx); } catch(...) { charIdx = -1; }
+        cout << "选择目标：输入 t0 或 t1 指对方对应前场，输入 b 指对方基地: ";
+        string target; getline(cin, target);
+        bool targetIsBase = (target == "b" || target == "B");
+        int targetIdx = (target == "t0") ? 0 : (target == "t1") ? 1 : -1;
+        if (!targetIsBase && targetIdx < 0) { cout << "无效目标指示。" << endl; continue; }
+        return Action::playCard(hidx, charIdx, targetIsBase, targetIdx);
+    }
+}
+
+void ConsolePlayer::onRejected(const Action&, ActionResult result) {
+    switch (result) {
+        case +ActionResult::EmptyHand: cout << "手牌为空，无法出牌。" << endl; break;
+        case +ActionResult::InvalidHandIndex: cout << "无效手牌索引。" << endl; break;
+        case +ActionResult::InvalidActor: cout << "无效角色索引。" << endl; break;
+        case +ActionResult::PhysicalOnly: cout << "普通人只能使用物理属性的牌，无法打出该牌。" << endl; break;
+        case +ActionResult::EmptyTargetSlot: cout << "对方该前场位置没有角色，无法作为目标。" << endl; break;
+        case +ActionResult::InvalidTarget: cout << "无效目标指示。" << endl; break;
+        case +ActionResult::PlayLimit: cout << "受时空限速影响，在对手的下个回合开始前不能再打出牌。" << endl; break;
+        default: cout << "无效操作。" << endl; break;
+    }
+}
+
+// GameManager 实现
+void GameManager::displayAllCards() const {
+    cout << "=== 所有卡牌 ===" << endl;
+    for (const auto& card : cardDB.getAllCards()) {
+        card->display();
+    }
+}
+
+void GameManager::displayAllCharacters() const {
+    cout << "=== 所有角色 ===" << endl;
+    for (const auto& character : characterDB.getAllCharacters()) {
+        character->display();
     }
 }
 
@@ -801,7 +4660,7 @@ void GameManager::createDeck() {
 			continue;
 		}
 		auto card = availableCards[cidx];
-		newDeck.addCard(card);
+		newDeck.addCard(card->getHandle());
 		cout << "已添加卡牌: " << card->getName() << " (" << newDeck.getCardCount() << "/" << newDeck.getMaxCardLimit() << ")" << endl;
 	}
     
@@ -810,161 +4669,1397 @@ void GameManager::createDeck() {
         decks.push_back(newDeck);
         cout << "牌组创建成功!" << endl;
     } else {
-        cout << "牌组无效! 需要至少20张卡牌和3个角色。" << endl;
-        cout << "当前: " << newDeck.getCardCount() << "张卡牌, " << newDeck.getCharacterCount() << "个角色" << endl;
+        cout << "牌组无效! 需要至少20张卡牌和3个角色。" << endl;
+        cout << "当前: " << newDeck.getCardCount() << "张卡牌, " << newDeck.getCharacterCount() << "个角色" << endl;
+    }
+}
+
+void GameManager::displayDecks() const {
+    cout << "=== 我的牌组 ===" << endl;
+    for (size_t i = 0; i < decks.size(); ++i) {
+        string validStatus = decks[i].isValid() ? "有效" : "无效";
+        cout << i + 1 << ". " << decks[i].getName() 
+                  << " (" << decks[i].getCardCount() << " 张卡牌, " 
+                  << decks[i].getCharacterCount() << " 个角色) - " << validStatus << endl;
+    }
+}
+
+void GameManager::displayDeckDetails() const {
+    if (decks.empty()) {
+        cout << "没有牌组可以显示。" << endl;
+        return;
+    }
+    
+    displayDecks();
+    cout << "选择牌组编号: ";
+    int choice;
+    cin >> choice;
+    
+    if (choice > 0 && choice <= static_cast<int>(decks.size())) {
+        decks[choice - 1].display();
+    } else {
+        cout << "无效选择" << endl;
+    }
+}
+
+void GameManager::exportDeckCode() const {
+    if (decks.empty()) {
+        cout << "没有牌组可以导出" << endl;
+        return;
+    }
+    
+    displayDecks();
+    cout << "选择要导出的牌组编号: ";
+    int choice;
+    cin >> choice;
+    
+    if (choice > 0 && choice <= static_cast<int>(decks.size())) {
+        cout << "牌组代码: " << decks[choice - 1].getDeckCode() << endl;
+        cout << "请保存此代码以备后续导入。" << endl;
+    } else {
+        cout << "无效选择" << endl;
+    }
+}
+
+void GameManager::importDeckFromCode() {
+    string deckCode;
+    cout << "请输入牌组代码: ";
+    cin.ignore();
+    getline(cin, deckCode);
+
+    // 只解码一次，随后直接用解码结果构建牌组
+    DeckCodeParser parser(cardDB, characterDB);
+    DecodedDeck decoded;
+    if (!parser.parse(deckCode, decoded)) {
+        cout << "无效的牌组代码: " << DeckCodeParser::describe(decoded.error) << endl;
+        return;
+    }
+
+    string newName;
+    cout << "牌组解析成功，原始牌组名: " << decoded.name << endl;
+    cout << "请输入导入后的牌组名称（回车使用原名）: ";
+    getline(cin, newName);
+    if (!newName.empty()) decoded.name = newName;
+
+    Deck importedDeck(decoded.name, decoded.deckType);
+    importedDeck.assign(decoded, characterDB);
+    decks.push_back(importedDeck);
+    cout << "牌组导入完成!" << endl;
+    importedDeck.display();
+}
+
+// 解析 Deck::getDeckCode() 并构建玩家牌库
+void GameManager::buildDeckFromDeckCode(const string& deckCode, vector<CardHandle>& outDeck) const {
+    outDeck.clear();
+    DeckCodeParser parser(cardDB, characterDB);
+    DecodedDeck decoded;
+    if (parser.parse(deckCode, decoded)) {
+        outDeck.swap(decoded.cards);
+    }
+}
+
+// 本地对局（编号选角、选择已有牌组），由 MatchEngine 结算规则
+void GameManager::playLocalMatch() {
+    cin.ignore(numeric_limits<streamsize>::max(), '\n'); // 清除缓冲
+
+    // 选择先从已保存的牌组中选择牌组作为玩家牌库
+    if (decks.empty()) {
+        cout << "没有已创建的牌组，请先创建牌组后再开始对局。" << endl;
+        return;
+    }
+    auto chooseDeckForPlayer = [this](const string &playerName) -> Deck* {
+        cout << playerName << " 请选择一个牌组编号：" << endl;
+        for (size_t i = 0; i < decks.size(); ++i) {
+            cout << "[" << i << "] " << decks[i].getName() << " (" << decks[i].getCardCount() << " 张)" << endl;
+        }
+        while (true) {
+            cout << "输入编号: ";
+            string s; getline(cin, s);
+            int idx = -1;
+            try { idx = stoi(s); } catch(...) { idx = -1; }
+            if (idx >= 0 && idx < (int)decks.size()) return &decks[idx];
+            cout << "无效编号，请重试。" << endl;
+        }
+    };
+
+    // 选角（按编号）
+    auto promptSelectCharsByIndex = [this](PlayerSetup &p) {
+        cout << "玩家 " << p.name << " 请从列表中选择 3 个角色的编号:" << endl;
+        auto all = characterDB.getAllCharacters();
+        for (size_t i = 0; i < all.size(); ++i) cout << "[" << i << "] " << all[i]->getName() << endl;
+        for (int i = 0; i < 3; ++i) {
+            cout << "选择第" << (i+1) << "个角色编号: ";
+            string s; getline(cin, s);
+            int idx = -1; try { idx = stoi(s); } catch(...) { idx = -1; }
+            if (idx < 0 || idx >= (int)all.size()) { cout << "无效编号，重试。" << endl; --i; continue; }
+            p.characters.push_back(all[idx]);
+        }
+    };
+
+    auto initializePlayerDeck = [this](PlayerSetup &p, Deck* chosenDeck) {
+        buildDeckFromDeckCode(chosenDeck->getDeckCode(), p.deck);
+        if (p.deck.empty()) {
+            for (const auto &c : cardDB.getAllCards()) p.deck.push_back(c->getHandle());
+        }
+    };
+
+    PlayerSetup p1, p2;
+    cout << "请输入玩家1 名称: "; getline(cin, p1.name); if (p1.name.empty()) p1.name="玩家1";
+    Deck* d1 = chooseDeckForPlayer(p1.name);
+    cout << "玩家2 由电脑控制？(y/N): ";
+    string aiAnswer; getline(cin, aiAnswer);
+    bool vsComputer = !aiAnswer.empty() && (aiAnswer[0] == 'y' || aiAnswer[0] == 'Y');
+    if (vsComputer) p2.name = "电脑";
+    else { cout << "请输入玩家2 名称: "; getline(cin, p2.name); if (p2.name.empty()) p2.name="玩家2"; }
+    Deck* d2 = chooseDeckForPlayer(p2.name);
+
+    promptSelectCharsByIndex(p1);
+    promptSelectCharsByIndex(p2);
+
+    initializePlayerDeck(p1, d1);
+    initializePlayerDeck(p2, d2);
+
+    // 牌组代码无法解析时牌库退回为全部卡牌，这样的对局无法按代码回放，不保存回放
+    bool replayable = !d1->getDeckCode().empty() && !d2->getDeckCode().empty();
+    Replay replay;
+    const PlayerSetup* setups[2] = { &p1, &p2 };
+    const Deck* chosenDecks[2] = { d1, d2 };
+    for (int i = 0; i < 2; ++i) {
+        replay.sides[i].name = setups[i]->name;
+        replay.sides[i].deckCode = chosenDecks[i]->getDeckCode();
+        for (const auto& ch : setups[i]->characters) replay.sides[i].characters.push_back(ch->getIndex());
+        DecodedDeck check;
+        replayable = replayable && DeckCodeParser(cardDB, characterDB).parse(replay.sides[i].deckCode, check);
+    }
+
+    std::random_device rd;
+    replay.seed = rd();
+    MatchEngine engine(p1, p2, replay.seed, &cout);
+    engine.setActionLog(&replay.actions);
+    ConsolePlayer c1, c2;
+    if (vsComputer) {
+        MctsPlayer ai(100, 0, rd());
+        engine.play(c1, ai);
+    } else {
+        engine.play(c1, c2);
+    }
+
+    if (replayable) {
+        replay.winner = engine.getWinner();
+        replay.turns = engine.getTurn();
+        if (replay.appendToFile(REPLAY_FILE)) cout << "回放已保存到 " << REPLAY_FILE << "。" << endl;
+        else cout << "无法写入回放文件 " << REPLAY_FILE << "。" << endl;
+    }
+    cout << "对局结束，返回主菜单。" << endl;
+}
+
+// 按牌组代码构建模拟用的玩家配置，角色不足 3 个时按角色库顺序补齐
+bool GameManager::loadPlayerSetup(const string& deckCode, const string& name, PlayerSetup& out) const {
+    return setupFromDeckCode(deckCode, name, out);
+}
+
+// simulate <牌组代码A> <牌组代码B> [局数] [线程数] [种子]
+int GameManager::runSimulation(const vector<string>& args) {
+    if (args.size() < 3) {
+        cout << "用法: simulate <牌组代码A> <牌组代码B> [局数] [线程数] [种子]" << endl;
+        return 1;
+    }
+    long long games = 10000;
+    unsigned int threads = 0;
+    uint64_t seed = random_device()();
+    try {
+        if (args.size() > 3) games = stoll(args[3]);
+        if (args.size() > 4) threads = (unsigned int)stoul(args[4]);
+        if (args.size() > 5) seed = stoull(args[5]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+    if (games <= 0) {
+        cout << "局数必须为正数。" << endl;
+        return 1;
+    }
+
+    PlayerSetup a, b;
+    if (!loadPlayerSetup(args[1], "A", a)) { cout << "牌组代码A无效!" << endl; return 1; }
+    if (!loadPlayerSetup(args[2], "B", b)) { cout << "牌组代码B无效!" << endl; return 1; }
+
+    Simulator simulator(threads);
+    cout << "开始模拟 " << games << " 局 (种子 " << seed << ", 线程 " << simulator.getThreadCount() << ")..." << endl;
+    SimulationReport report = simulator.run(a, b, games, seed);
+    report.print(cout);
+    return 0;
+}
+
+// optimize <角色ID,角色ID,角色ID> <Standard|Casual> <对手牌组文件> [迭代次数] [线程数] [种子]
+int GameManager::runOptimizer(const vector<string>& args) {
+    if (args.size() < 4) {
+        cout << "用法: optimize <角色ID,角色ID,角色ID> <Standard|Casual> <对手牌组文件> [迭代次数] [线程数] [种子]" << endl;
+        return 1;
+    }
+    OptimizerConfig config;
+    unsigned int threads = 0;
+    config.seed = random_device()();
+    try {
+        if (args.size() > 4) config.iterations = stoi(args[4]);
+        if (args.size() > 5) threads = (unsigned int)stoul(args[5]);
+        if (args.size() > 6) config.seed = stoull(args[6]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+
+    vector<string> characterIds;
+    boost::split(characterIds, args[1], boost::is_any_of(","));
+    for (const auto& id : characterIds) {
+        auto character = characterDB.findCharacterById(id);
+        if (!character || find(config.characters.begin(), config.characters.end(), character) != config.characters.end()) {
+            cout << "无效或重复的角色ID: " << id << endl;
+            return 1;
+        }
+        config.characters.push_back(character);
+    }
+    if (config.characters.size() != 3) {
+        cout << "需要指定 3 个不同的角色。" << endl;
+        return 1;
+    }
+    config.deckType = Deck::parseDeckType(args[2]);
+
+    // 对手池：每行一个牌组代码，空行忽略
+    ifstream in(args[3]);
+    if (!in) {
+        cout << "无法打开对手牌组文件: " << args[3] << endl;
+        return 1;
+    }
+    vector<PlayerSetup> opponents;
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line)) {
+        ++lineNumber;
+        boost::trim(line);
+        if (line.empty()) continue;
+        PlayerSetup setup;
+        if (!loadPlayerSetup(line, "对手" + to_string(opponents.size() + 1), setup)) {
+            cout << "第 " << lineNumber << " 行的牌组代码无效，已跳过。" << endl;
+            continue;
+        }
+        opponents.push_back(setup);
+    }
+    if (opponents.empty()) {
+        cout << "对手牌组文件中没有有效的牌组代码。" << endl;
+        return 1;
+    }
+
+    DeckOptimizer optimizer(opponents, threads);
+    cout << "开始搜索: " << opponents.size() << " 个对手, " << config.iterations << " 轮 (种子 " << config.seed
+         << ", 线程 " << optimizer.getThreadCount() << ")..." << endl;
+    OptimizerResult result = optimizer.run(config, &cout);
+    if (result.cards.empty()) {
+        cout << "可选卡牌不足，无法组成牌组。" << endl;
+        return 1;
+    }
+
+    Deck deck("优化牌组", config.deckType);
+    for (const auto& character : config.characters) deck.addCharacter(character);
+    for (CardHandle card : result.cards) deck.addCard(card);
+
+    cout << "=== 搜索结果 ===" << endl;
+    cout << "候选: " << result.candidates << "  接受: " << result.accepted << "  提前淘汰: " << result.rejectedEarly
+         << "  缓存命中: " << result.cacheHits << endl;
+    cout << "对局数: " << result.games << ", 用时: " << fixed << setprecision(2) << result.seconds << " 秒, "
+         << setprecision(0) << (result.seconds > 0 ? result.candidates * 3600.0 / result.seconds : 0.0)
+         << " 候选/小时" << endl;
+    cout << setprecision(2) << "对手池平均胜率: " << result.winRate * 100 << "%" << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    deck.display();
+    return 0;
+}
+
+// 校验一段以换行分隔的牌组代码，每行输出一条结果：
+//   OK <牌组类型> <卡牌句柄,...>  或  INVALID <错误码>
+static void validateDeckCodes(const char* begin, const char* end, string& out,
+                              long long& valid, long long& invalid) {
+    DeckCodeParser parser(CardDatabase::instance(), CharacterDatabase::instance());
+    DecodedDeck decoded;
+    char number[8];
+    for (const char* line = begin; line < end; ) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!eol) eol = end;
+        const char* first = line;
+        const char* last = eol;
+        while (first < last && isspace(static_cast<unsigned char>(*first))) ++first;
+        while (last > first && isspace(static_cast<unsigned char>(last[-1]))) --last;
+        line = eol + 1;
+
+        if (!parser.parse(string_view(first, last - first), decoded)) {
+            out += "INVALID ";
+            out += decoded.error._to_string();
+            out += '\n';
+            ++invalid;
+            continue;
+        }
+        ++valid;
+        out += "OK ";
+        out += static_cast<char>('0' + decoded.deckType._to_integral());
+        out += ' ';
+        const auto& cards = decoded.cards;
+        for (size_t i = 0; i < cards.size(); ++i) {
+            if (i) out += ',';
+            int n = snprintf(number, sizeof(number), "%u", static_cast<unsigned>(cards[i]));
+            out.append(number, n);
+        }
+        out += '\n';
+    }
+}
+
+// validate <输入文件|-> <输出文件> [线程数]
+int GameManager::runValidation(const vector<string>& args) {
+    if (args.size() < 3) {
+        cout << "用法: validate <输入文件|-> <输出文件> [线程数]" << endl;
+        return 1;
+    }
+    unsigned int threads = 0;
+    try {
+        if (args.size() > 3) threads = (unsigned int)stoul(args[3]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+
+    // 文件输入直接内存映射；标准输入则整体读入内存
+    unique_ptr<MappedFile> mapped;
+    string stdinBuffer;
+    const char* data = nullptr;
+    size_t size = 0;
+    if (args[1] == "-") {
+        stdinBuffer.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+        data = stdinBuffer.data();
+        size = stdinBuffer.size();
+    } else {
+        mapped.reset(new MappedFile(args[1]));
+        if (!mapped->isOpen()) {
+            cout << "无法打开输入文件: " << args[1] << endl;
+            return 1;
+        }
+        data = mapped->data();
+        size = mapped->size();
+    }
+
+    ofstream out(args[2], ios::binary);
+    if (!out) {
+        cout << "无法写入输出文件: " << args[2] << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    ThreadPool pool(threads);
+
+    // 按换行切分成若干块，块数多于线程数以便工作窃取均衡负载
+    size_t chunkCount = max<size_t>(1, min<size_t>(pool.size() * 8, size / 4096 + 1));
+    vector<pair<const char*, const char*>> chunks;
+    const char* end = data + size;
+    const char* chunkBegin = data;
+    for (size_t i = 1; i <= chunkCount && chunkBegin < end; ++i) {
+        const char* chunkEnd = (i == chunkCount) ? end : data + size * i / chunkCount;
+        if (chunkEnd < chunkBegin) chunkEnd = chunkBegin;
+        const char* nl = static_cast<const char*>(memchr(chunkEnd, '\n', end - chunkEnd));
+        chunkEnd = nl ? nl + 1 : end;
+        chunks.emplace_back(chunkBegin, chunkEnd);
+        chunkBegin = chunkEnd;
+    }
+
+    vector<string> results(chunks.size());
+    vector<long long> validCounts(chunks.size(), 0), invalidCounts(chunks.size(), 0);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        pool.submit([&, i](unsigned int) {
+            results[i].reserve((chunks[i].second - chunks[i].first) / 2);
+            validateDeckCodes(chunks[i].first, chunks[i].second, results[i], validCounts[i], invalidCounts[i]);
+        });
+    }
+    pool.wait();
+
+    long long valid = 0, invalid = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        out.write(results[i].data(), results[i].size());
+        valid += validCounts[i];
+        invalid += invalidCounts[i];
+    }
+    out.close();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long total = valid + invalid;
+    cout << "已处理 " << total << " 个牌组代码（有效 " << valid << "，无效 " << invalid << "），用时 "
+         << fixed << setprecision(3) << seconds << " 秒，" << setprecision(0)
+         << (seconds > 0 ? total / seconds : 0.0) << " 个/秒" << endl;
+    cout.unsetf(ios::floatfield);
+    cout << setprecision(6);
+    return 0;
+}
+
+static string describeAction(const GameState& state, const Action& action) {
+    if (action.type != +ActionType::PlayCard) return "结束回合";
+    const PlayerState& cur = state.players[state.active];
+    const PlayerState& opp = state.players[1 - state.active];
+    ostringstream out;
+    out << cur.chars[action.actorIndex].ch->getName() << " 使用 "
+        << CardDatabase::instance().getCard(cur.hand[action.handIndex]).getName() << " 攻击 ";
+    if (action.targetIsBase) out << "对方基地";
+    else out << opp.chars[action.targetIndex].ch->getName();
+    return out.str();
+}
+
+static const char* describeSolveValue(int value) {
+    return value > 0 ? "必胜" : (value < 0 ? "必败" : "无法分出胜负");
+}
+
+// solve <牌组代码A> <牌组代码B> [回合期限] [种子] [线程数]
+// 残局谜题：两名随机 AI 对弈至分出胜负，回到终局前第 3 个回合开始时的局面求解，并检验 MCTS AI 的选择
+int GameManager::runSolver(const vector<string>& args) {
+    if (args.size() < 3) {
+        cout << "用法: solve <牌组代码A> <牌组代码B> [回合期限] [种子] [线程数]" << endl;
+        return 1;
+    }
+    int maxTurns = 6;
+    uint64_t seed = random_device()();
+    unsigned int threads = 0;
+    try {
+        if (args.size() > 3) maxTurns = stoi(args[3]);
+        if (args.size() > 4) seed = stoull(args[4]);
+        if (args.size() > 5) threads = (unsigned int)stoul(args[5]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+    if (maxTurns <= 0) {
+        cout << "回合期限必须为正数。" << endl;
+        return 1;
+    }
+
+    PlayerSetup a, b;
+    if (!loadPlayerSetup(args[1], "A", a)) { cout << "牌组代码A无效!" << endl; return 1; }
+    if (!loadPlayerSetup(args[2], "B", b)) { cout << "牌组代码B无效!" << endl; return 1; }
+
+    MatchEngine engine(a, b, seed);
+    RandomPlayer first(playerSeed(seed, 0)), second(playerSeed(seed, 1));
+    if (engine.play(first, second, 200) == 0) {
+        cout << "该种子的对局未分胜负，请换一个种子。" << endl;
+        return 1;
+    }
+    engine.restoreTurn(max(1, engine.getTurn() - 2));
+
+    const GameState position = engine.snapshot();
+    const string& mover = engine.getPlayerName(position.active);
+    cout << "残局局面 (种子 " << seed << ", 回合 " << position.turn << ", 轮到 " << mover << "):" << endl;
+    for (int i = 0; i < 2; ++i) {
+        showPlayerState(engine.getPlayerName(i), position.players[i]);
+        cout << "牌库剩余: " << position.players[i].deck.size() << " 张" << endl;
+    }
+
+    EndgameSolver solver(64, threads);
+    cout << "\n开始求解 (回合期限 " << maxTurns << ", 线程 " << solver.getThreadCount() << ")..." << endl;
+    SolveResult result = solver.solve(position, maxTurns);
+    cout << "结果: " << mover << " 在 " << result.turns << " 个回合内" << describeSolveValue(result.value) << endl;
+    cout << "最佳行动: " << describeAction(position, result.best) << endl;
+    cout << "搜索节点: " << result.nodes << ", 用时 " << fixed << setprecision(3) << result.seconds << " 秒 ("
+         << setprecision(2) << (result.seconds > 0 ? result.nodes / result.seconds / 1e6 : 0.0) << " M 节点/秒)" << endl;
+
+    // 在同一回合期限内评估 MCTS 的选择
+    MctsPlayer ai(100, threads, seed);
+    Action choice = ai.chooseAction(engine, position.active);
+    engine.applyAction(choice);
+    const GameState& child = engine.getState();
+    int remaining = result.turns - (child.turn - position.turn);
+    int value = 0;
+    if (child.finished) value = child.winner == 0 ? 0 : (child.winner == position.active + 1 ? 1 : -1);
+    else if (remaining > 0) {
+        SolveResult reply = solver.solve(child, remaining);
+        value = child.active == position.active ? reply.value : -reply.value;
+    }
+    cout << "MCTS 选择: " << describeAction(position, choice) << " -> " << describeSolveValue(value)
+         << (value == result.value ? "（与求解结果一致）" : "（劣于最佳行动）") << endl;
+    return 0;
+}
+
+// record <牌组代码A> <牌组代码B> <回放文件> [局数] [种子]
+// 随机 AI 自对弈并把每局追加到回放文件，用于建立回归用的回放库
+int GameManager::runRecord(const vector<string>& args) {
+    if (args.size() < 4) {
+        cout << "用法: record <牌组代码A> <牌组代码B> <回放文件> [局数] [种子]" << endl;
+        return 1;
+    }
+    long long games = 1000;
+    uint64_t seed = random_device()();
+    try {
+        if (args.size() > 4) games = stoll(args[4]);
+        if (args.size() > 5) seed = stoull(args[5]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+    if (games <= 0) {
+        cout << "局数必须为正数。" << endl;
+        return 1;
+    }
+
+    PlayerSetup setups[2];
+    if (!loadPlayerSetup(args[1], "A", setups[0])) { cout << "牌组代码A无效!" << endl; return 1; }
+    if (!loadPlayerSetup(args[2], "B", setups[1])) { cout << "牌组代码B无效!" << endl; return 1; }
+    ReplaySide sides[2];
+    for (int i = 0; i < 2; ++i) {
+        sides[i].name = setups[i].name;
+        sides[i].deckCode = args[i + 1];
+        for (const auto& ch : setups[i].characters) sides[i].characters.push_back(ch->getIndex());
+    }
+
+    string records;
+    Replay replay;
+    for (long long g = 0; g < games; ++g) {
+        uint64_t gameSeed = streamSeed(seed, (uint64_t)g);
+        int first = (int)(g % 2); // 轮流先手
+        replay.seed = (uint32_t)gameSeed;
+        replay.sides[0] = sides[first];
+        replay.sides[1] = sides[1 - first];
+        replay.actions.clear();
+        MatchEngine engine(setups[first], setups[1 - first], replay.seed);
+        engine.setActionLog(&replay.actions);
+        RandomPlayer p1(playerSeed(gameSeed, 0)), p2(playerSeed(gameSeed, 1));
+        replay.winner = engine.play(p1, p2, 200);
+        replay.turns = engine.getTurn();
+        replay.appendTo(records);
+    }
+
+    ofstream out(args[3], ios::binary | ios::app);
+    if (!out || !out.write(records.data(), records.size())) {
+        cout << "无法写入回放文件: " << args[3] << endl;
+        return 1;
+    }
+    cout << "已追加 " << games << " 局到 " << args[3] << "，共 " << records.size() << " 字节（平均 "
+         << fixed << setprecision(1) << (double)records.size() / games << " 字节/局）" << endl;
+    return 0;
+}
+
+// replay <回放文件> [序号]
+// 不带序号时重新执行文件中的全部对局并与记录的结果比对；带序号时输出该局的完整过程
+int GameManager::runReplay(const vector<string>& args) {
+    if (args.size() < 2) {
+        cout << "用法: replay <回放文件> [序号]" << endl;
+        return 1;
+    }
+    long long only = -1;
+    try {
+        if (args.size() > 2) only = stoll(args[2]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+
+    MappedFile mapped(args[1]);
+    if (!mapped.isOpen()) {
+        cout << "无法打开回放文件: " << args[1] << endl;
+        return 1;
+    }
+    const uint8_t* p = (const uint8_t*)mapped.data();
+    const uint8_t* end = p + mapped.size();
+
+    ReplayRunner runner;
+    Replay replay;
+    ReplayOutcome outcome;
+    long long index = 0, replayed = 0, mismatched = 0, failed = 0;
+    bool corrupted = false;
+    auto start = chrono::steady_clock::now();
+    for (; p < end; ++index) {
+        if (!Replay::read(p, end, replay)) {
+            if (end - p >= 4 && memcmp(p, replay::MAGIC, 3) == 0 && p[3] != (uint8_t)replay::MAGIC[3])
+                cout << "第 " << index << " 条记录由其他版本的卡牌规则录制，无法回放，停止读取。" << endl;
+            else
+                cout << "第 " << index << " 条记录损坏，停止读取。" << endl;
+            corrupted = true;
+            break;
+        }
+        if (only >= 0 && index != only) continue;
+
+        bool verbose = only >= 0;
+        if (!runner.run(replay, outcome, verbose ? &cout : nullptr)) {
+            ++failed;
+            cout << "第 " << index << " 局无法回放（牌组代码或行动无效）。" << endl;
+        } else {
+            ++replayed;
+            if (!outcome.matchesRecord) {
+                ++mismatched;
+                cout << "第 " << index << " 局结果与记录不同: 记录 胜者 " << replay.winner << " / " << replay.turns
+                     << " 回合，回放 胜者 " << outcome.winner << " / " << outcome.turns << " 回合" << endl;
+            }
+        }
+        if (verbose) break;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (only >= 0) {
+        if (index != only) { cout << "回放文件中没有第 " << only << " 局。" << endl; return 1; }
+        if (replayed == 1 && mismatched == 0) cout << "回放结果与记录一致。" << endl;
+    } else {
+        cout << "回放 " << replayed << " 局，结果不一致 " << mismatched << " 局，无法回放 " << failed << " 局，用时 "
+             << fixed << setprecision(3) << seconds << " 秒 (" << setprecision(0)
+             << (seconds > 0 ? replayed / seconds : 0.0) << " 局/秒)" << endl;
     }
+    return (mismatched == 0 && failed == 0 && !corrupted) ? 0 : 2;
 }
 
-void GameManager::displayDecks() const {
-    cout << "=== 我的牌组 ===" << endl;
-    for (size_t i = 0; i < decks.size(); ++i) {
-        string validStatus = decks[i].isValid() ? "有效" : "无效";
-        cout << i + 1 << ". " << decks[i].getName() 
-                  << " (" << decks[i].getCardCount() << " 张卡牌, " 
-                  << decks[i].getCharacterCount() << " 个角色) - " << validStatus << endl;
+// 从参数中取出 --text 兼容开关，其余参数按位置保留
+static bool takeTextFlag(vector<string>& args) {
+    auto it = find(args.begin(), args.end(), "--text");
+    if (it == args.end()) return false;
+    args.erase(it);
+    return true;
+}
+
+// server [端口] [线程数] [秒数] [--text]
+// 秒数为 0 时一直运行；每 5 秒输出一次统计。--text 同时接受旧的文本协议客户端
+int GameManager::runServer(const vector<string>& rawArgs) {
+    vector<string> args = rawArgs;
+    bool allowText = takeTextFlag(args);
+    int port = 4000;
+    unsigned int threads = 0;
+    long long seconds = 0;
+    try {
+        if (args.size() > 1) port = stoi(args[1]);
+        if (args.size() > 2) threads = (unsigned int)stoul(args[2]);
+        if (args.size() > 3) seconds = stoll(args[3]);
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
     }
+    if (port < 0 || port > 65535) {
+        cout << "端口无效。" << endl;
+        return 1;
+    }
+
+    GameServer server((uint16_t)port, threads, allowText);
+    string error;
+    if (!server.start(&error)) {
+        cout << "服务器启动失败: " << error << endl;
+        return 1;
+    }
+    cout << "对战服务器已启动，端口 " << port << "，分片 " << server.getShardCount()
+         << (allowText ? "，兼容文本协议" : "") << "（每会话约 " << GameServer::sessionBytes()
+         << " 字节，每局对局对象约 " << GameServer::matchBytes() << " 字节）" << endl;
+
+    auto start = chrono::steady_clock::now();
+    auto nextReport = start;
+    while (seconds <= 0 || chrono::steady_clock::now() - start < chrono::seconds(seconds)) {
+        this_thread::sleep_for(chrono::milliseconds(200));
+        if (chrono::steady_clock::now() < nextReport) continue;
+        nextReport += chrono::seconds(5);
+        GameServer::Stats stats = server.getStats();
+        cout << "在线 " << stats.activeSessions << " / 累计连接 " << stats.connections
+             << "，对局 " << stats.matchesFinished << "/" << stats.matchesStarted
+             << "（AI 对局 " << stats.botMatches << "），行动 " << stats.actions
+             << "，拒绝 " << stats.rejected << "，观众 " << stats.spectators << "（观战数据编码 "
+             << stats.broadcastBytes / 1024 << " KB，分发 " << stats.fanoutBytes / 1024 << " KB）" << endl;
+    }
+    server.stop();
+    return 0;
 }
 
-void GameManager::displayDeckDetails() const {
-    if (decks.empty()) {
-        cout << "没有牌组可以显示。" << endl;
-        return;
+namespace {
+    // 压测客户端：按服务器协议随机出牌，无牌可出时结束回合
+    struct LoadClient {
+        net::Socket socket;
+        net::RecvBuffer inbox{ 2048 };
+        net::SendBuffer outbox;
+        bool writable = false;
+        bool detected = false; // 二进制协议下已收到服务器的前导
+        bool awaiting = false; // 已出牌，等待服务器回应
+        int remaining = 0;
+        chrono::steady_clock::time_point sentAt;
+    };
+
+    struct LoadStats {
+        unsigned long long connected = 0, matches = 0, actions = 0, rejected = 0, errors = 0;
+        unsigned long long samples = 0;
+        double latencySum = 0, latencyMax = 0;
+    };
+
+    class LoadWorker {
+    public:
+        LoadWorker(const string& name, const string& deckCode, bool text, int matches, uint64_t seed)
+            : text(text), matches(matches), rng(seed) {
+            hello.type = +wire::MessageType::Hello;
+            hello.text = name;
+            hello.deckCode = deckCode;
+        }
+
+        void run(const string& host, uint16_t port, int count, chrono::steady_clock::time_point deadline) {
+            clients.resize(count);
+            for (auto& c : clients) {
+                string error;
+                c.socket = net::Socket::connectTcp(host, port, &error);
+                if (!c.socket.valid()) { ++stats.errors; continue; }
+                LoadClient* client = &c;
+                loop.add(c.socket.get(), net::EventLoop::READABLE, [this, client](int events) { onEvents(*client, events); });
+                ++stats.connected;
+                ++open;
+                c.remaining = matches;
+                if (!text) {
+                    encoded.clear();
+                    wire::appendPreamble(encoded);
+                    c.outbox.append(encoded);
+                }
+                send(c, hello);
+            }
+            while (open > 0 && chrono::steady_clock::now() < deadline) loop.poll(100);
+        }
+
+        LoadStats stats;
+
+    private:
+        bool text;
+        int matches;
+        Rng rng;
+        net::EventLoop loop;
+        vector<LoadClient> clients;
+        int open = 0;
+        wire::Message hello, received, reply;
+        string encoded;
+
+        void send(LoadClient& c, const wire::Message& message) {
+            encoded.clear();
+            if (text) wire::appendText(message, encoded);
+            else wire::appendFrame(message, encoded);
+            c.outbox.append(encoded);
+            flush(c);
+        }
+
+        void flush(LoadClient& c) {
+            if (!c.outbox.flush(c.socket)) return;
+            bool want = !c.outbox.empty();
+            if (want != c.writable) {
+                c.writable = want;
+                loop.modify(c.socket.get(), net::EventLoop::READABLE | (want ? net::EventLoop::WRITABLE : 0));
+            }
+        }
+
+        void close(LoadClient& c) {
+            if (!c.socket.valid()) return;
+            loop.remove(c.socket.get());
+            c.socket.close();
+            --open;
+        }
+
+        void fail(LoadClient& c) {
+            ++stats.errors;
+            close(c);
+        }
+
+        void onEvents(LoadClient& c, int events) {
+            if (events & net::EventLoop::WRITABLE) flush(c);
+            if (!(events & net::EventLoop::READABLE)) return;
+            bool ok = c.inbox.fill(c.socket);
+            if (text) {
+                string_view line;
+                while (c.socket.valid() && c.inbox.nextLine(line)) {
+                    if (wire::parseText(line, received)) handleMessage(c, received);
+                    else fail(c);
+                }
+            } else {
+                if (!c.detected) {
+                    wire::DecodeStatus status = wire::readPreamble(c.inbox);
+                    if (status == +wire::DecodeStatus::Malformed) { fail(c); return; }
+                    c.detected = status == +wire::DecodeStatus::Ok;
+                }
+                while (c.socket.valid() && c.detected) {
+                    wire::DecodeStatus status = wire::nextFrame(c.inbox, received);
+                    if (status == +wire::DecodeStatus::Incomplete) break;
+                    if (status == +wire::DecodeStatus::Malformed) { fail(c); return; }
+                    handleMessage(c, received);
+                }
+            }
+            if (c.socket.valid() && (!ok || c.inbox.full())) {
+                if (c.remaining > 0) ++stats.errors;
+                close(c);
+            }
+        }
+
+        void handleMessage(LoadClient& c, const wire::Message& message) {
+            bool answer = message.type == +wire::MessageType::Turn || message.type == +wire::MessageType::Result ||
+                          message.type == +wire::MessageType::Reject;
+            if (c.awaiting && answer) {
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - c.sentAt).count();
+                stats.latencySum += ms;
+                stats.latencyMax = max(stats.latencyMax, ms);
+                ++stats.samples;
+                c.awaiting = false;
+            }
+            switch (message.type) {
+                case +wire::MessageType::Turn:
+                    if (message.moves.empty()) {
+                        reply.type = +wire::MessageType::EndTurn;
+                    } else {
+                        reply.type = +wire::MessageType::Play;
+                        reply.action = message.moves[rng.below((uint32_t)message.moves.size())];
+                        ++stats.actions;
+                        c.awaiting = true;
+                        c.sentAt = chrono::steady_clock::now();
+                    }
+                    send(c, reply);
+                    break;
+                case +wire::MessageType::Reject:
+                    ++stats.rejected;
+                    reply.type = +wire::MessageType::EndTurn;
+                    send(c, reply);
+                    break;
+                case +wire::MessageType::Result:
+                    ++stats.matches;
+                    if (--c.remaining > 0) send(c, hello);
+                    else close(c);
+                    break;
+                case +wire::MessageType::Error:
+                    fail(c);
+                    break;
+                default:
+                    break;
+            }
+        }
+    };
+}
+
+// loadtest <牌组代码> [连接数] [每连接局数] [端口] [线程数] [主机] [--text]
+int GameManager::runLoadTest(const vector<string>& rawArgs) {
+    vector<string> args = rawArgs;
+    bool text = takeTextFlag(args);
+    if (args.size() < 2) {
+        cout << "用法: loadtest <牌组代码> [连接数] [每连接局数] [端口] [线程数] [主机] [--text]" << endl;
+        return 1;
     }
-    
-    displayDecks();
-    cout << "选择牌组编号: ";
-    int choice;
-    cin >> choice;
-    
-    if (choice > 0 && choice <= static_cast<int>(decks.size())) {
-        decks[choice - 1].display();
-    } else {
-        cout << "无效选择" << endl;
+    int connections = 1000, matches = 3, port = 4000;
+    unsigned int threads = 0;
+    string host = "127.0.0.1";
+    try {
+        if (args.size() > 2) connections = stoi(args[2]);
+        if (args.size() > 3) matches = stoi(args[3]);
+        if (args.size() > 4) port = stoi(args[4]);
+        if (args.size() > 5) threads = (unsigned int)stoul(args[5]);
+        if (args.size() > 6) host = args[6];
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
+    }
+    if (connections <= 0 || matches <= 0 || port <= 0 || port > 65535) {
+        cout << "参数必须为正数。" << endl;
+        return 1;
+    }
+    PlayerSetup check;
+    if (!loadPlayerSetup(args[1], "check", check)) { cout << "牌组代码无效!" << endl; return 1; }
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    threads = min(threads, (unsigned int)connections);
+
+    cout << "压测 " << host << ":" << port << "：" << connections << " 个连接，每连接 " << matches
+         << " 局，" << threads << " 个线程" << (text ? "，文本协议" : "") << "..." << endl;
+    vector<unique_ptr<LoadWorker>> workers;
+    vector<thread> pool;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::minutes(10);
+    for (unsigned int i = 0; i < threads; ++i) {
+        int count = connections / (int)threads + ((int)i < connections % (int)threads ? 1 : 0);
+        workers.emplace_back(new LoadWorker("bot" + to_string(i), args[1], text, matches, mixSeed(i + 1)));
+        LoadWorker* worker = workers.back().get();
+        pool.emplace_back([=] { worker->run(host, (uint16_t)port, count, deadline); });
+    }
+    for (auto& t : pool) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    LoadStats total;
+    for (const auto& w : workers) {
+        total.connected += w->stats.connected;
+        total.matches += w->stats.matches;
+        total.actions += w->stats.actions;
+        total.rejected += w->stats.rejected;
+        total.errors += w->stats.errors;
+        total.samples += w->stats.samples;
+        total.latencySum += w->stats.latencySum;
+        total.latencyMax = max(total.latencyMax, w->stats.latencyMax);
     }
+    cout << fixed << setprecision(1);
+    cout << "已连接 " << total.connected << "/" << connections << "，客户端完成对局 " << total.matches
+         << "，出牌 " << total.actions << "（被拒绝 " << total.rejected << "），错误 " << total.errors << endl;
+    cout << "用时 " << seconds << " 秒，" << total.matches / seconds << " 局/秒，"
+         << total.actions / seconds << " 次出牌/秒" << endl;
+    if (total.samples)
+        cout << "出牌往返延迟: 平均 " << setprecision(3) << total.latencySum / total.samples << " ms，最大 "
+             << total.latencyMax << " ms" << endl;
+    return total.errors == 0 && total.matches == (unsigned long long)connections * matches ? 0 : 2;
 }
 
-void GameManager::exportDeckCode() const {
-    if (decks.empty()) {
-        cout << "没有牌组可以导出" << endl;
-        return;
+namespace {
+    struct WatchClient {
+        net::Socket socket;
+        net::RecvBuffer inbox{ 4096 };
+        net::SendBuffer outbox;
+        bool writable = false;
+        bool detected = false;
+        wire::SpectatorView view;
+        string names[2];
+    };
+
+    struct WatchStats {
+        unsigned long long connected = 0, snapshots = 0, deltas = 0, results = 0, bytes = 0, errors = 0;
+    };
+
+    // 观战客户端：所有连接在一个事件循环中，每局结束后重新观战；verbose 时打印第一个连接看到的对局过程
+    class WatchWorker {
+    public:
+        explicit WatchWorker(bool verbose) : verbose(verbose) { watch.type = +wire::MessageType::Watch; }
+
+        void run(const string& host, uint16_t port, int count, chrono::steady_clock::time_point deadline) {
+            clients.resize(count);
+            for (auto& c : clients) {
+                string error;
+                c.socket = net::Socket::connectTcp(host, port, &error);
+                if (!c.socket.valid()) { ++stats.errors; continue; }
+                WatchClient* client = &c;
+                loop.add(c.socket.get(), net::EventLoop::READABLE, [this, client](int events) { onEvents(*client, events); });
+                ++stats.connected;
+                ++open;
+                encoded.clear();
+                wire::appendPreamble(encoded);
+                wire::appendFrame(watch, encoded);
+                c.outbox.append(encoded);
+                flush(c);
+            }
+            while (open > 0 && chrono::steady_clock::now() < deadline) loop.poll(100);
+        }
+
+        WatchStats stats;
+
+    private:
+        bool verbose;
+        net::EventLoop loop;
+        vector<WatchClient> clients;
+        int open = 0;
+        wire::Message watch, received;
+        string encoded;
+
+        void flush(WatchClient& c) {
+            if (!c.outbox.flush(c.socket)) { fail(c); return; }
+            bool want = !c.outbox.empty();
+            if (want != c.writable) {
+                c.writable = want;
+                loop.modify(c.socket.get(), net::EventLoop::READABLE | (want ? net::EventLoop::WRITABLE : 0));
+            }
+        }
+
+        void fail(WatchClient& c) {
+            if (!c.socket.valid()) return;
+            ++stats.errors;
+            loop.remove(c.socket.get());
+            c.socket.close();
+            --open;
+        }
+
+        void onEvents(WatchClient& c, int events) {
+            if (events & net::EventLoop::WRITABLE) flush(c);
+            if (!(events & net::EventLoop::READABLE) || !c.socket.valid()) return;
+            size_t before = c.inbox.size();
+            bool ok = c.inbox.fill(c.socket);
+            stats.bytes += c.inbox.size() - before;
+            if (!c.detected) {
+                wire::DecodeStatus status = wire::readPreamble(c.inbox);
+                if (status == +wire::DecodeStatus::Malformed) { fail(c); return; }
+                c.detected = status == +wire::DecodeStatus::Ok;
+            }
+            while (c.socket.valid() && c.detected) {
+                wire::DecodeStatus status = wire::nextFrame(c.inbox, received);
+                if (status == +wire::DecodeStatus::Incomplete) break;
+                if (status == +wire::DecodeStatus::Malformed) { fail(c); return; }
+                handleMessage(c, received);
+            }
+            if (!ok || c.inbox.full()) fail(c);
+        }
+
+        void handleMessage(WatchClient& c, const wire::Message& message) {
+            bool show = verbose && &c == &clients[0];
+            switch (message.type) {
+                case +wire::MessageType::Snapshot:
+                    ++stats.snapshots;
+                    c.view = message.view;
+                    c.names[0] = message.names[0];
+                    c.names[1] = message.names[1];
+                    if (show) printSnapshot(c);
+                    break;
+                case +wire::MessageType::Delta: {
+                    ++stats.deltas;
+                    int actor = c.view.active;
+                    if (show) printAction(c, actor, message.action);
+                    c.view.turn = message.view.turn;
+                    c.view.active = message.view.active;
+                    for (const wire::ViewChange& change : message.changes) {
+                        int16_t old = c.view.values[change.key >> 7][change.key & 0x7F];
+                        c.view.apply(change);
+                        if (show) printChange(c, change, old);
+                    }
+                    break;
+                }
+                case +wire::MessageType::Result:
+                    ++stats.results;
+                    if (show) {
+                        cout << "对局结束：" << (message.value == 0 ? "平局" : c.names[message.value - 1] + " 获胜")
+                             << "（" << message.turns << " 回合）\n" << endl;
+                    }
+                    encoded.clear();
+                    wire::appendFrame(watch, encoded);
+                    c.outbox.append(encoded);
+                    flush(c);
+                    break;
+                case +wire::MessageType::Wait:
+                    if (show) cout << "暂无进行中的对局，等待下一局开始..." << endl;
+                    break;
+                default: // Reject / Error 或其他意外消息
+                    fail(c);
+                    break;
+            }
+        }
+
+        static string characterName(int16_t index) {
+            const auto& all = CharacterDatabase::instance().getAllCharacters();
+            return index >= 0 && index < (int)all.size() ? all[index]->getName() : string("?");
+        }
+
+        void printSnapshot(const WatchClient& c) const {
+            cout << "观战：" << c.names[0] << " 对 " << c.names[1] << "，第 " << c.view.turn << " 回合，轮到 "
+                 << c.names[c.view.active] << endl;
+            for (int p = 0; p < 2; ++p) {
+                const int16_t* v = c.view.values[p];
+                cout << "  " << c.names[p] << "：基地 " << v[wire::VIEW_BASE_HP] << "，法力 " << v[wire::VIEW_BASE_MANA]
+                     << "，手牌 " << v[wire::VIEW_HAND] << "，牌库 " << v[wire::VIEW_DECK];
+                for (int slot = 0; slot < v[wire::VIEW_CHARS] && slot < 3; ++slot) {
+                    const int16_t* ch = v + wire::VIEW_CHAR_FIRST + 3 * slot;
+                    cout << "，" << characterName(ch[0]) << " " << ch[1] << "/" << ch[2];
+                }
+                cout << endl;
+            }
+        }
+
+        void printAction(const WatchClient& c, int actor, const wire::ActionRecord& r) const {
+            cout << "[第 " << c.view.turn << " 回合] " << c.names[actor];
+            if (r.type != ActionType::PlayCard) { cout << " 结束回合" << endl; return; }
+            cout << " 使用 " << (r.card == wire::ActionRecord::NO_CARD ? string("?") : CardDatabase::instance().getCard(r.card).getName())
+                 << " 攻击 " << (r.target == 0 ? string("对方基地") : "对方前场 " + to_string(r.target)) << endl;
+        }
+
+        void printChange(const WatchClient& c, const wire::ViewChange& change, int16_t old) const {
+            static const char* const FIELDS[] = { "基地生命", "基地法力", "手牌", "牌库", "角色数" };
+            static const char* const CHAR_FIELDS[] = { "角色", "生命", "能量" };
+            int field = change.key & 0x7F;
+            cout << "    " << c.names[change.key >> 7] << " ";
+            if (field < wire::VIEW_CHAR_FIRST) {
+                cout << FIELDS[field] << " " << old << " -> " << change.value << endl;
+                return;
+            }
+            int slot = (field - wire::VIEW_CHAR_FIRST) / 3, kind = (field - wire::VIEW_CHAR_FIRST) % 3;
+            cout << "位置" << slot + 1 << " " << CHAR_FIELDS[kind] << " ";
+            if (kind == 0) cout << characterName(old) << " -> " << characterName(change.value) << endl;
+            else cout << old << " -> " << change.value << endl;
+        }
+    };
+}
+
+// watch [连接数] [秒数] [端口] [主机]
+// 观战客户端。单个连接时打印对局过程；多个连接用于测试服务器的观战分发，只输出统计
+int GameManager::runWatch(const vector<string>& args) {
+    int connections = 1, port = 4000;
+    long long seconds = 0;
+    string host = "127.0.0.1";
+    try {
+        if (args.size() > 1) connections = stoi(args[1]);
+        if (args.size() > 2) seconds = stoll(args[2]);
+        if (args.size() > 3) port = stoi(args[3]);
+        if (args.size() > 4) host = args[4];
+    } catch (...) {
+        cout << "参数格式错误。" << endl;
+        return 1;
     }
-    
-    displayDecks();
-    cout << "选择要导出的牌组编号: ";
-    int choice;
-    cin >> choice;
-    
-    if (choice > 0 && choice <= static_cast<int>(decks.size())) {
-        cout << "牌组代码: " << decks[choice - 1].getDeckCode() << endl;
-        cout << "请保存此代码以备后续导入。" << endl;
-    } else {
-        cout << "无效选择" << endl;
+    if (connections <= 0 || port <= 0 || port > 65535) {
+        cout << "参数必须为正数。" << endl;
+        return 1;
     }
+
+    cout << "观战 " << host << ":" << port << "：" << connections << " 个连接"
+         << (seconds > 0 ? "，" + to_string(seconds) + " 秒" : string()) << "..." << endl;
+    WatchWorker worker(connections == 1);
+    auto start = chrono::steady_clock::now();
+    auto deadline = seconds > 0 ? start + chrono::seconds(seconds) : chrono::steady_clock::time_point::max();
+    worker.run(host, (uint16_t)port, connections, deadline);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    const WatchStats& stats = worker.stats;
+    cout << fixed << setprecision(1);
+    cout << "已连接 " << stats.connected << "/" << connections << "，收到快照 " << stats.snapshots << "、增量 "
+         << stats.deltas << "、结果 " << stats.results << "，错误 " << stats.errors << endl;
+    cout << "共收到 " << stats.bytes / 1024.0 << " KB，用时 " << elapsed << " 秒";
+    if (stats.deltas) cout << "，平均每帧增量约 " << (double)stats.bytes / (stats.deltas + stats.snapshots + stats.results) << " 字节";
+    cout << endl;
+    return stats.errors == 0 && stats.connected == (unsigned long long)connections ? 0 : 2;
 }
 
-void GameManager::importDeckFromCode() {
-    string deckCode;
-    cout << "请输入牌组代码: ";
-    cin.ignore();
-    getline(cin, deckCode);
+namespace {
+    // 在非阻塞套接字上写完全部数据，超时或出错时返回 false
+    bool sendAll(net::Socket& socket, const char* data, size_t length) {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (length > 0) {
+            long n = socket.send(data, length);
+            if (n == net::Socket::FAILED || chrono::steady_clock::now() > deadline) return false;
+            if (n == net::Socket::WOULD_BLOCK) { this_thread::sleep_for(chrono::milliseconds(1)); continue; }
+            data += n;
+            length -= (size_t)n;
+        }
+        return true;
+    }
 
-    // 先用已有方法尝试导入
-    if (!Deck::isValidDeckCode(deckCode)) {
-        cout << "无效的牌组代码!" << endl;
-        return;
+    // 等待下一条消息；连接断开且队列已空或超时时返回 nullptr
+    const wire::Message* waitMessage(LanLink& link, int timeoutMs) {
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        while (true) {
+            if (const wire::Message* m = link.front()) return m;
+            auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+            if (!link.connected() || left.count() <= 0) return nullptr;
+            link.wait(left);
+        }
     }
 
-    Deck probe("导入的牌组");
-    if (probe.importFromDeckCode(deckCode, cardDB.getAllCards(), characterDB.getAllCharacters())) {
-        string newName;
-        cout << "牌组导入成功! 请输入新的牌组名称: ";
-        getline(cin, newName);
-        Deck importedDeck(newName, probe.getDeckType());
-        if (importedDeck.importFromDeckCode(deckCode, cardDB.getAllCards(), characterDB.getAllCharacters())) {
-            decks.push_back(importedDeck);
-            cout << "牌组导入完成!" << endl;
-            importedDeck.display();
-            return;
+    bool waitDisconnected(const LanLink& link, int timeoutMs) {
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+        while (link.connected() && chrono::steady_clock::now() < deadline) this_thread::sleep_for(chrono::milliseconds(1));
+        return !link.connected();
+    }
+
+    // 只比较局域网对战用到的字段；文本协议的出牌只传卡牌、角色与目标
+    bool sameLanMessage(const wire::Message& a, const wire::Message& b) {
+        if (a.type != b.type) return false;
+        switch (a.type) {
+            case +wire::MessageType::Seed: return a.value == b.value;
+            case +wire::MessageType::DeckCode: return a.deckCode == b.deckCode;
+            case +wire::MessageType::Play:
+                return a.action.card == b.action.card && a.action.actor == b.action.actor && a.action.target == b.action.target;
+            case +wire::MessageType::EndTurn: return true;
+            default: return a.text == b.text;
         }
-        // 若上面失败则继续尝试手动解析（作为回退）
-        cout << "警告：自动导入步骤异常，尝试手动解析..." << endl;
-    } else {
-        cout << "自动导入失败，尝试手动解析..." << endl;
     }
 
-    // 回退：手动解码并解析牌组数据
-    try {
-        string decoded = base64::decode(deckCode);
-        size_t sep = decoded.find('|');
-        if (sep == string::npos) {
-            cout << "解析失败：找不到校验分隔符" << endl;
-            return;
+    // 局域网对战一局开始时双方会交换的各类消息
+    vector<wire::Message> lanScript() {
+        vector<wire::Message> script(7);
+        script[0].type = +wire::MessageType::Name;
+        script[0].text = "回环测试";
+        script[1].type = +wire::MessageType::Seed;
+        script[1].value = 0xF00DFACE12345678ULL;
+        script[2].type = +wire::MessageType::DeckCode;
+        script[2].deckCode = "ogEBFAFBAwABAgwAAgACAAIAAgACAAIAAgACAAEAAQABAAHp3dVn";
+        script[3].type = +wire::MessageType::Characters;
+        script[3].text = "xxmlt,neko,soybeanmilk";
+        script[4].type = +wire::MessageType::Play;
+        script[4].action = wire::ActionRecord::from(Action::playCard(3, 1, false, 1), CardDatabase::instance().getAllCards().front()->getHandle());
+        script[5].type = +wire::MessageType::Emoji;
+        for (int i = 0; i < 300; ++i) script[5].text += "呜"; // 900 字节，跨越多次读取
+        script[6].type = +wire::MessageType::EndTurn;
+        return script;
+    }
+
+    string encodeLan(const wire::Message& message, bool text) {
+        string out;
+        if (text) wire::appendText(message, out);
+        else wire::appendFrame(message, out);
+        return out;
+    }
+
+    // 在 127.0.0.1 上建立一对已连接的套接字
+    bool connectLoopback(net::Socket& hostSide, net::Socket& clientSide, string& error) {
+        net::Socket listener = net::Socket::listenTcp(0, 1, false, &error);
+        if (!listener.valid()) return false;
+        clientSide = net::Socket::connectTcp("127.0.0.1", listener.localPort(), &error);
+        if (!clientSide.valid()) return false;
+        hostSide = LanLink::acceptPeer(listener, 2000, &error);
+        return hostSide.valid();
+    }
+}
+
+// 局域网联机回环自检：在 127.0.0.1 上连接主机与客户端，依次检查握手、消息被拆成多次读取、
+// 接收队列满时暂停读取、错误数据、协议不一致与断开处理，二进制与文本协议各检查一遍
+int GameManager::runLanTest(const vector<string>&) {
+    int failures = 0;
+    auto check = [&](bool ok, const string& what) {
+        cout << (ok ? "[通过] " : "[失败] ") << what << endl;
+        if (!ok) ++failures;
+    };
+    const vector<wire::Message> script = lanScript();
+
+    for (int pass = 0; pass < 2; ++pass) {
+        const bool text = pass == 1;
+        const string protocol = text ? "文本协议" : "二进制协议";
+        string error;
+
+        // 握手：双方交换名称，主机发送种子；之后客户端关闭，主机应察觉断开
+        {
+            net::Socket hostSide, clientSide;
+            if (!connectLoopback(hostSide, clientSide, error)) { check(false, protocol + " 建立连接: " + error); continue; }
+            LanLink host(text), client(text);
+            bool started = host.start(move(hostSide), &error) && client.start(move(clientSide), &error);
+            check(started, protocol + " 启动网络线程" + (started ? "" : ": " + error));
+            if (!started) continue;
+            wire::Message out;
+            out.type = +wire::MessageType::Name; out.text = "主机"; host.send(out);
+            out.type = +wire::MessageType::Seed; out.value = 0x0123456789ABCDEFULL; host.send(out);
+            out.type = +wire::MessageType::Name; out.text = "客户端"; client.send(out);
+
+            const wire::Message* m = waitMessage(host, 2000);
+            check(m && m->type == +wire::MessageType::Name && m->text == "客户端", protocol + " 握手：主机收到客户端名称");
+            if (m) host.release();
+            m = waitMessage(client, 2000);
+            bool nameOk = m && m->type == +wire::MessageType::Name && m->text == "主机";
+            if (m) client.release();
+            m = waitMessage(client, 2000);
+            bool seedOk = m && m->type == +wire::MessageType::Seed && m->value == 0x0123456789ABCDEFULL;
+            if (m) client.release();
+            check(nameOk && seedOk, protocol + " 握手：客户端收到主机名称与 64 位种子");
+
+            client.stop();
+            auto start = chrono::steady_clock::now();
+            m = waitMessage(host, 2000);
+            double waited = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            check(!m && !host.connected() && waited < 1.0, protocol + " 断开：客户端关闭后主机停止等待并标记断开");
         }
 
-        string dataPart = decoded.substr(0, sep);
-        string checksum = decoded.substr(sep + 1);
-        if (crc32::generate_checksum(dataPart) != checksum) {
-            cout << "解析失败：校验和不匹配" << endl;
-            return;
+        // 拆分读取：裸套接字把整段数据切成 1~13 字节的小块陆续发出，帧头、负载与行都会被拆开
+        {
+            net::Socket hostSide, clientSide;
+            if (!connectLoopback(hostSide, clientSide, error)) { check(false, protocol + " 建立连接: " + error); continue; }
+            LanLink host(text);
+            host.start(move(hostSide), &error);
+            string stream;
+            if (!text) wire::appendPreamble(stream);
+            for (const wire::Message& msg : script) stream += encodeLan(msg, text);
+            const size_t pieces[] = { 1, 2, 3, 5, 8, 13 };
+            bool sent = true;
+            for (size_t offset = 0, i = 0; offset < stream.size() && sent; ++i) {
+                size_t n = min(pieces[i % 6], stream.size() - offset);
+                sent = sendAll(clientSide, stream.data() + offset, n);
+                offset += n;
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            size_t matched = 0;
+            for (const wire::Message& expected : script) {
+                const wire::Message* m = waitMessage(host, 2000);
+                if (!m) break;
+                bool same = sameLanMessage(*m, expected);
+                host.release();
+                if (!same) break;
+                ++matched;
+            }
+            check(sent && matched == script.size(),
+                  protocol + " 拆分读取：" + to_string(stream.size()) + " 字节分多次到达，" + to_string(matched) + "/" + to_string(script.size()) + " 条消息完整且有序");
+
+            // 关闭前发出的消息仍应送达，之后主机标记断开
+            string last = encodeLan(script[0], text);
+            sendAll(clientSide, last.data(), last.size());
+            clientSide.close();
+            const wire::Message* m = waitMessage(host, 2000);
+            bool delivered = m && sameLanMessage(*m, script[0]);
+            if (m) host.release();
+            check(delivered && waitDisconnected(host, 2000), protocol + " 断开：对端关闭前发出的消息先送达，随后标记断开");
         }
 
-        // data layout: name;type;charIds;cardIds;maxLimit;
-        vector<string> parts;
-        boost::split(parts, dataPart, boost::is_any_of(";"));
-        if (parts.size() < 4) {
-            cout << "解析失败：数据字段不完整" << endl;
-            return;
+        // 接收队列满：一次写入远超队列容量的消息，主机稍后才开始取，网络线程应暂停读取并在腾出槽位后继续
+        {
+            net::Socket hostSide, clientSide;
+            if (!connectLoopback(hostSide, clientSide, error)) { check(false, protocol + " 建立连接: " + error); continue; }
+            LanLink host(text);
+            host.start(move(hostSide), &error);
+            const int burst = 500;
+            string stream;
+            if (!text) wire::appendPreamble(stream);
+            wire::Message emoji;
+            emoji.type = +wire::MessageType::Emoji;
+            for (int i = 0; i < burst; ++i) { emoji.text = to_string(i); stream += encodeLan(emoji, text); }
+            bool sent = sendAll(clientSide, stream.data(), stream.size());
+            this_thread::sleep_for(chrono::milliseconds(100));
+            int received = 0;
+            while (received < burst) {
+                const wire::Message* m = waitMessage(host, 2000);
+                if (!m || m->text != to_string(received)) break;
+                host.release();
+                ++received;
+            }
+            check(sent && received == burst, protocol + " 背压：" + to_string(received) + "/" + to_string(burst) + " 条消息在接收队列满后依次取到");
         }
 
-        string parsedName = parts[0];
-        int deckTypeValue = 0;
-        try { deckTypeValue = stoi(parts[1]); } catch(...) { deckTypeValue = +DeckType::Casual; }
-        DeckType dt = (deckTypeValue == +DeckType::Standard) ? +DeckType::Standard : +DeckType::Casual;
-
-        string charIds = parts[2];
-        string cardIds = parts[3];
-        // 若有第五字段为最大卡数，则可解析（可选)
-        int maxLimit = 20;
-        if (parts.size() >= 5) {
-            try { maxLimit = stoi(parts[4]); } catch(...) { /* ignore */ }
-        }
-
-        // 询问用户给定牌组名
-        string newName;
-        cout << "牌组解析成功，原始牌组名: " << parsedName << endl;
-        cout << "请输入导入后的牌组名称（回车使用原名）: ";
-        getline(cin, newName);
-        if (newName.empty()) newName = parsedName;
-
-        Deck importedDeck(newName, dt);
-        // 解析角色 id 并加入
-        vector<string> charIdList;
-        boost::split(charIdList, charIds, boost::is_any_of(","));
-        for (const auto &cid : charIdList) {
-            if (cid.empty()) continue;
-            auto ch = characterDB.findCharacterById(cid);
-            if (ch) importedDeck.addCharacter(ch);
-        }
-        // 解析卡牌 id 并加入
-        vector<string> cardIdList;
-        boost::split(cardIdList, cardIds, boost::is_any_of(","));
-        for (const auto &cid : cardIdList) {
-            if (cid.empty()) continue;
-            auto c = cardDB.findCardById(cid);
-            if (c) importedDeck.addCard(c);
-        }
-        // 尝试设置最大卡牌限制（如果类支持 setMaxCardLimit）
-        // ... 若 Deck 类提供 setMaxCardLimit，可在此调用 importedDeck.setMaxCardLimit(maxLimit);
-
-        // 更新牌组编码并加入列表 
-        // 牌组已通过 addCharacter/addCard 更新其内部状态，直接加入列表
-        decks.push_back(importedDeck);
-        importedDeck.display();
-        cout << "手动导入成功!" << endl;
-        importedDeck.display();
-    } catch (...) {
-        cout << "手动解析失败，导入取消。" << endl;
+        // 无法解析的数据：之前的消息照常送达，随后按协议错误断开，不算协议不一致
+        {
+            net::Socket hostSide, clientSide;
+            if (!connectLoopback(hostSide, clientSide, error)) { check(false, protocol + " 建立连接: " + error); continue; }
+            LanLink host(text);
+            host.start(move(hostSide), &error);
+            string stream;
+            if (!text) wire::appendPreamble(stream);
+            stream += encodeLan(script[0], text);
+            if (text) stream += "GARBAGE;1\n";
+            else stream += string("\0\0\xFF", 3); // 空负载、未知消息类型
+            sendAll(clientSide, stream.data(), stream.size());
+            const wire::Message* m = waitMessage(host, 2000);
+            bool delivered = m && sameLanMessage(*m, script[0]);
+            if (m) host.release();
+            check(delivered && waitDisconnected(host, 2000) && !host.protocolMismatch() && !host.front(),
+                  protocol + " 错误数据：无法解析的消息被拒绝并断开连接");
+        }
+    }
+
+    // 协议不一致：二进制主机收到文本协议的数据，应识别为协议不符并断开
+    {
+        string error;
+        net::Socket hostSide, clientSide;
+        if (connectLoopback(hostSide, clientSide, error)) {
+            LanLink host(false);
+            host.start(move(hostSide), &error);
+            string line = encodeLan(script[0], true);
+            sendAll(clientSide, line.data(), line.size());
+            check(waitDisconnected(host, 2000) && host.protocolMismatch() && !host.front(), "协议不一致：二进制主机拒绝文本协议的对端");
+        } else {
+            check(false, "建立连接: " + error);
+        }
+    }
+
+    cout << (failures == 0 ? "局域网回环自检全部通过。" : "局域网回环自检有 " + to_string(failures) + " 项失败。") << endl;
+    return failures == 0 ? 0 : 1;
+}
+
+int GameManager::runCommand(const vector<string>& args) {
+    if (args.empty()) {
+        run();
+        return 0;
     }
+    if (args[0] == "simulate") return runSimulation(args);
+    if (args[0] == "validate") return runValidation(args);
+    if (args[0] == "optimize") return runOptimizer(args);
+    if (args[0] == "solve") return runSolver(args);
+    if (args[0] == "record") return runRecord(args);
+    if (args[0] == "replay") return runReplay(args);
+    if (args[0] == "server") return runServer(args);
+    if (args[0] == "loadtest") return runLoadTest(args);
+    if (args[0] == "watch") return runWatch(args);
+    if (args[0] == "lantest") return runLanTest(args);
+
+    cout << "用法:" << endl;
+    cout << "  MagicWound                     交互菜单" << endl;
+    cout << "  MagicWound simulate <牌组代码A> <牌组代码B> [局数] [线程数] [种子]" << endl;
+    cout << "  MagicWound validate <输入文件|-> <输出文件> [线程数]" << endl;
+    cout << "  MagicWound optimize <角色ID,角色ID,角色ID> <Standard|Casual> <对手牌组文件> [迭代次数] [线程数] [种子]" << endl;
+    cout << "  MagicWound solve <牌组代码A> <牌组代码B> [回合期限] [种子] [线程数]" << endl;
+    cout << "  MagicWound record <牌组代码A> <牌组代码B> <回放文件> [局数] [种子]" << endl;
+    cout << "  MagicWound replay <回放文件> [序号]" << endl;
+    cout << "  MagicWound server [端口] [线程数] [秒数] [--text]" << endl;
+    cout << "  MagicWound loadtest <牌组代码> [连接数] [每连接局数] [端口] [线程数] [主机] [--text]" << endl;
+    cout << "  MagicWound watch [连接数] [秒数] [端口] [主机]" << endl;
+    cout << "  MagicWound lantest                局域网联机回环自检" << endl;
+    return 1;
 }
 
 void GameManager::showMenu() const {
@@ -1013,333 +6108,11 @@ void GameManager::run() {
             case 8:
                 cout << "再见!" << endl;
                 break;
-            case 9: { // 对局实现（编号选角、选择已有牌组、卡牌效果注册表）
-                cin.ignore(numeric_limits<streamsize>::max(), '\n'); // 清除缓冲
-
-                struct PlayerCharState {
-                    shared_ptr<Character> ch;
-                    int curHP;
-                    int curEnergy;
-                };
-                struct PlayerState {
-                    string name;
-                    int baseHP = 50;
-                    int baseMana = 30;
-                    vector<PlayerCharState> chars; // 0,1 前场；2 后场（替补）
-                    vector<shared_ptr<Card>> deck;
-                    vector<shared_ptr<Card>> hand;
-                };
-
-                // 选择先从已保存的牌组中选择牌组作为玩家牌库
-                if (decks.empty()) {
-                    cout << "没有已创建的牌组，请先创建牌组后再开始对局。" << endl;
-                    break;
-                }
-                auto chooseDeckForPlayer = [this](const string &playerName) -> Deck* {
-                    cout << playerName << " 请选择一个牌组编号：" << endl;
-                    for (size_t i = 0; i < decks.size(); ++i) {
-                        cout << "[" << i << "] " << decks[i].getName() << " (" << decks[i].getCardCount() << " 张)" << endl;
-                    }
-                    while (true) {
-                        cout << "输入编号: ";
-                        string s; getline(cin, s);
-                        int idx = -1;
-                        try { idx = stoi(s); } catch(...) { idx = -1; }
-                        if (idx >= 0 && idx < (int)decks.size()) return &decks[idx];
-                        cout << "无效编号，请重试。" << endl;
-                    }
-                };
-
-                // 创建两个玩家并选择牌组、选角（按编号）
-                auto promptSelectCharsByIndex = [this](PlayerState &p) {
-                    cout << "玩家 " << p.name << " 请从列表中选择 3 个角色的编号:" << endl;
-                    auto all = characterDB.getAllCharacters();
-                    for (size_t i = 0; i < all.size(); ++i) cout << "[" << i << "] " << all[i]->getName() << endl;
-                    for (int i = 0; i < 3; ++i) {
-                        cout << "选择第" << (i+1) << "个角色编号: ";
-                        string s; getline(cin, s);
-                        int idx = -1; try { idx = stoi(s); } catch(...) { idx = -1; }
-                        if (idx < 0 || idx >= (int)all.size()) { cout << "无效编号，重试。" << endl; --i; continue; }
-                        PlayerCharState pcs; pcs.ch = all[idx]; pcs.curHP = all[idx]->getHealth(); pcs.curEnergy = (all[idx]->getEnergy()+1)/2;
-                        p.chars.push_back(pcs);
-                    }
-                };
-
-                PlayerState p1, p2;
-                cout << "请输入玩家1 名称: "; getline(cin, p1.name); if (p1.name.empty()) p1.name="玩家1";
-                Deck* d1 = chooseDeckForPlayer(p1.name);
-                cout << "请输入玩家2 名称: "; getline(cin, p2.name); if (p2.name.empty()) p2.name="玩家2";
-                Deck* d2 = chooseDeckForPlayer(p2.name);
-
-                promptSelectCharsByIndex(p1);
-                promptSelectCharsByIndex(p2);
-
-                // 解析 Deck::getDeckCode() 中的卡牌 ID，并构建玩家牌库（使用 cardDB 查找）
-                auto buildDeckFromDeckCode = [this](const string &deckCode, vector<shared_ptr<Card>> &outDeck) {
-                    outDeck.clear();
-                    try {
-                        string decoded = base64::decode(deckCode);
-                        size_t sep = decoded.find('|');
-                        if (sep == string::npos) return;
-                        string data = decoded.substr(0, sep);
-                        vector<string> parts;
-                        boost::split(parts, data, boost::is_any_of(";"));
-                        if (parts.size() < 4) return;
-                        string cardIds = parts[3];
-                        vector<string> cardIdList;
-                        boost::split(cardIdList, cardIds, boost::is_any_of(","));
-                        for (const auto &cid : cardIdList) {
-                            if (cid.empty()) continue;
-                            auto c = cardDB.findCardById(cid);
-                            if (c) outDeck.push_back(c);
-                        }
-                    } catch(...) { return; }
-                };
-
-                auto initializePlayerDeck = [&](PlayerState &p, Deck* chosenDeck) {
-                    buildDeckFromDeckCode(chosenDeck->getDeckCode(), p.deck);
-                    if (p.deck.empty()) {
-                        auto all = cardDB.getAllCards();
-                        for (const auto &c : all) p.deck.push_back(c);
-                    }
-                    std::random_device rd; std::mt19937 g(rd());
-                    std::shuffle(p.deck.begin(), p.deck.end(), g);
-                    for (int i = 0; i < 3 && !p.deck.empty(); ++i) { p.hand.push_back(p.deck.back()); p.deck.pop_back(); }
-                };
-
-                initializePlayerDeck(p1, d1);
-                initializePlayerDeck(p2, d2);
-
-                // 辅助：判断角色是否为法师（拥有除Physical外的元素）
-                auto isMage = [](const shared_ptr<Character>& ch) {
-                    for (auto &e : ch->getElements()) {
-                        if (e != +Element::Physical) return true;
-                    }
-                    return false;
-                };
-
-                // 在对局内部注册卡牌效果（指针函数/回调），effect 可修改 finalDmg 或产生副作用
-                unordered_map<string, function<void(PlayerState&, PlayerState&, int, bool, int, shared_ptr<Card>, int&, bool&)>> cardEffects;
-                // 辅助：抽牌
-                auto drawCards = [](PlayerState &p, int n) {
-                    for (int i = 0; i < n && !p.deck.empty(); ++i) { p.hand.push_back(p.deck.back()); p.deck.pop_back(); }
-                };
-                cardEffects["Wordle"] = [](PlayerState&, PlayerState&, int, bool, int, shared_ptr<Card>, int &finalDmg, bool &) {
-                    finalDmg *= 2; cout << "[效果] Wordle: 伤害翻倍！" << endl;
-                };
-                cardEffects["IDontcar"] = [](PlayerState&, PlayerState&, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    cout << "[效果] 窝不载乎：对手似乎被汽车鸣笛分散了注意力。" << endl;
-                };
-                cardEffects["madposion"] = [](PlayerState&, PlayerState&, int, bool, int, shared_ptr<Card>, int &finalDmg, bool&) {
-                    finalDmg *= 3; cout << "[效果] 狂乱药水：伤害×3（简化）。" << endl;
-                };
-                cardEffects["organichemistry"] = [drawCards](PlayerState& owner, PlayerState&, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    drawCards(owner, 3); cout << "[效果] 魔药学：抽取最多3张牌。" << endl;
-                };
-                cardEffects["slowdown"] = [](PlayerState&, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    int dec = 2; opp.baseMana = max(0, opp.baseMana - dec); cout << "[效果] 缓慢药水：对手基地魔力 -" << dec << "。" << endl;
-                };
-                cardEffects["Timeelder"] = [](PlayerState&, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    if (!opp.hand.empty()) { cout << "[效果] 时空限速：对手弃掉手牌 " << opp.hand.back()->getName() << "。" << endl; opp.hand.pop_back(); }
-                };
-                cardEffects["LGBTQ"] = [](PlayerState& owner, PlayerState&, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    owner.baseMana += 1000; cout << "[效果] 多彩药水：本回合获得属性适配（简化）。" << endl;
-                };
-                cardEffects["Lazarus,Arise!"] = [](PlayerState& owner, PlayerState&, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    owner.baseHP += 5; cout << "[效果] 起尸：基地回复5生命（简化）。" << endl;
-                };
-                cardEffects["DontForgotMe"] = [](PlayerState& owner, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    int move = min(8, (int)opp.deck.size());
-                    for (int i = 0; i < move; ++i) { owner.deck.push_back(opp.deck.back()); opp.deck.pop_back(); }
-                    cout << "[效果] 瓶装记忆：将对手牌库顶最多 " << move << " 张牌移入我的牌库（简化）。" << endl;
-                };
-                cardEffects["TheCardLetMeWin"] = [](PlayerState&, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.pop_back();
-                    for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.erase(opp.deck.begin());
-                    cout << "[效果] 记忆屏蔽：摧毁对手牌库顶/底各2张（简化）。" << endl;
-                };
-                cardEffects["TheCardLetYouLose"] = [](PlayerState& owner, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    for (int i = 0; i < 2 && !owner.deck.empty(); ++i) owner.deck.pop_back();
-                    for (int i = 0; i < 2 && !owner.deck.empty(); ++i) owner.deck.erase(owner.deck.begin());
-                    for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.pop_back();
-                    for (int i = 0; i < 2 && !opp.deck.empty(); ++i) opp.deck.erase(opp.deck.begin());
-                    if (owner.deck.empty()) owner.baseHP = 0;
-                    cout << "[效果] 记忆摧毁：双方顶底各2张，被激活后若你的牌库为空你输（简化）。" << endl;
-                };
-                cardEffects["whAt"] = [](PlayerState&, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    if (!opp.deck.empty()) { cout << "[效果] 你说啥？：摧毁对手一张牌 " << opp.deck.back()->getName() << "（顶）。" << endl; opp.deck.pop_back(); }
-                };
-                cardEffects["balance"] = [drawCards](PlayerState& owner, PlayerState&, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    int n = owner.hand.size(); owner.hand.clear(); drawCards(owner, n); cout << "[效果] 平衡：弃手并抽等量的牌（简化）。" << endl;
-                };
-                cardEffects["TearAll"] = [](PlayerState&, PlayerState& opp, int, bool, int, shared_ptr<Card>, int&, bool&) {
-                    opp.deck.clear(); cout << "[效果] 遗忘灵药：摧毁对手牌库（简化）。" << endl;
-                };
-
-                // 辅助：替补上阵（当前场 idx 位置死亡，用后场替补到该位置）
-                auto tryReplaceDead = [](PlayerState &p, int deadIndex) {
-                    if (deadIndex < 0 || deadIndex > 1) return;
-                    if (p.chars.size() >= 3) {
-                        if (p.chars.size() == 3) {
-                            auto replaced = p.chars[2];
-                            p.chars[deadIndex] = replaced;
-                            p.chars.pop_back();
-                            cout << p.name << " 的后场角色已替补到前场位置 " << deadIndex+1 << "。" << endl;
-                        }
-                    }
-                };
-
-                // 辅助：应用伤害到目标（角色或基地），并处理溢出到基地与替补
-                auto applyDamageToChar = [&](PlayerState &owner, int idx, int dmg, bool isMagic) {
-                    if (idx < 0 || idx > 1) return;
-                    if (idx >= (int)owner.chars.size()) return;
-                    PlayerCharState &t = owner.chars[idx];
-                    if (isMagic && isMage(t.ch)) {
-                        int energyTaken = min(t.curEnergy, dmg);
-                        t.curEnergy -= energyTaken;
-                        dmg -= energyTaken;
-                    }
-                    if (dmg > 0) t.curHP -= dmg;
-                    if (t.curHP <= 0) {
-                        int overflow = -t.curHP;
-                        cout << owner.name << " 的角色 " << t.ch->getName() << " 被击败！" << endl;
-                        bool hasReserve = owner.chars.size() == 3;
-                        if (hasReserve) {
-                            owner.chars[idx] = owner.chars[2];
-                            owner.chars.pop_back();
-                        } else {
-                            owner.chars[idx].curHP = 0;
-                        }
-                        if (overflow > 0) { owner.baseHP -= overflow; cout << owner.name << " 的基地受到溢出伤害 " << overflow << " 点！" << endl; }
-                    }
-                };
-
-                auto applyDamageToBase = [&](PlayerState &owner, int dmg) { owner.baseHP -= dmg; };
-
-                auto checkWinner = [&](const PlayerState &a, const PlayerState &b) -> int {
-                    if (a.baseHP <= 0) return 2;
-                    if (b.baseHP <= 0) return 1;
-                    return 0;
-                };
-
-                // 每回合处理与出牌循环
-                int turn = 1;
-                int active = 0; // 0 -> p1, 1 -> p2
-                bool running = true;
-                while (running) {
-                    PlayerState &cur = (active == 0) ? p1 : p2;
-                    PlayerState &opp = (active == 0) ? p2 : p1;
-
-                    cout << "\n=== 回合 " << turn << " - " << cur.name << " 的回合开始 ===" << endl;
-                    if (!cur.deck.empty()) { cur.hand.push_back(cur.deck.back()); cur.deck.pop_back(); cout << cur.name << " 抽了1张牌。" << endl; }
-                    else cout << cur.name << " 的牌库已空，无法抽牌。" << endl;
-
-                    cur.baseMana = min(30, cur.baseMana + 5);
-                    for (auto &pcs : cur.chars) { int maxE = pcs.ch->getEnergy(); pcs.curEnergy = min(maxE, pcs.curEnergy + 5); }
-
-                    while (true) {
-                        auto showPlayerState = [](const PlayerState &p) {
-                            cout << "\n玩家: " << p.name << " | 基地生命: " << p.baseHP << " | 基地魔力: " << p.baseMana << endl;
-                            cout << "前场角色:" << endl;
-                            for (int i = 0; i < (int)p.chars.size() && i < 2; ++i) {
-                                const auto &pcs = p.chars[i];
-                                cout << " [" << i << "] " << pcs.ch->getName() << " (HP: " << pcs.curHP << "/" << pcs.ch->getHealth()
-                                     << ", MP: " << pcs.curEnergy << "/" << pcs.ch->getEnergy() << ")" << endl;
-                            }
-                            if (p.chars.size() == 3) {
-                                const auto &r = p.chars[2];
-                                cout << " 后场替补: " << r.ch->getName() << " (HP: " << r.curHP << "/" << r.ch->getHealth()
-                                     << ", MP: " << r.curEnergy << "/" << r.ch->getEnergy() << ")" << endl;
-                            } else cout << " 无后场替补" << endl;
-                            cout << "手牌(" << p.hand.size() << "): ";
-                            for (int i = 0; i < (int)p.hand.size(); ++i) cout << "[" << i << "]" << p.hand[i]->getName() << " ";
-                            cout << endl;
-                        };
-
-                        showPlayerState(cur);
-                        showPlayerState(opp);
-
-                        cout << "\n操作：p 出牌；e 结束回合；q 退出对局。输入操作字母: ";
-                        string op; getline(cin, op);
-                        if (op == "q" || op == "Q") { cout << "对局提前结束。" << endl; running = false; break; }
-                        if (op == "e" || op == "E") { cout << "结束回合。" << endl; break; }
-                        if (op == "p" || op == "P") {
-                            if (cur.hand.empty()) { cout << "手牌为空，无法出牌。" << endl; continue; }
-                            cout << "选择出牌的手牌索引: ";
-                            string idxs; getline(cin, idxs);
-                            int hidx = -1;
-                            try { hidx = stoi(idxs); } catch(...) { hidx = -1; }
-                            if (hidx < 0 || hidx >= (int)cur.hand.size()) { cout << "无效手牌索引。" << endl; continue; }
-                            auto card = cur.hand[hidx];
-                            bool isPhysical = false;
-                            for (auto &e : card->getElements()) if (e == +Element::Physical) isPhysical = true;
-                            cout << "选择使用该牌的前场角色索引(0或1): ";
-                            string sidx; getline(cin, sidx);
-                            int charIdx = -1; try { charIdx = stoi(sidx); } catch(...) { charIdx = -1; }
-                            if (charIdx < 0 || charIdx > 1 || charIdx >= (int)cur.chars.size()) { cout << "无效角色索引。" << endl; continue; }
-                            auto &actor = cur.chars[charIdx];
-                            bool actorIsMage = isMage(actor.ch);
-                            if (!actorIsMage && !isPhysical) { cout << "普通人只能使用物理属性的牌，无法打出该牌。" << endl; continue; }
-                            cout << "选择目标：输入 t0 或 t1 指对方对应前场，输入 b 指对方基地: ";
-                            string target; getline(cin, target);
-                            bool targetIsBase = false; int targetIdx = -1;
-                            if (target == "b" || target == "B") targetIsBase = true;
-                            else if (target == "t0" || target == "t1") { targetIdx = (target == "t0") ? 0 : 1; if (targetIdx >= (int)opp.chars.size()) { cout << "对方该前场位置没有角色，无法作为目标。" << endl; continue; } }
-                            else { cout << "无效目标指示。" << endl; continue; }
-
-                            int cost = card->getCost(); if (isPhysical) cost = 0;
-                            int remainingCost = cost;
-                            if (actorIsMage && cost > 0) {
-                                int fromChar = min(actor.curEnergy, remainingCost); actor.curEnergy -= fromChar; remainingCost -= fromChar;
-                                int fromBase = min(cur.baseMana, remainingCost); cur.baseMana -= fromBase; remainingCost -= fromBase;
-                                if (remainingCost > 0) { cout << "魔力不足，使用生命支付剩余费用: " << remainingCost << " 点（直接扣角色生命）。" << endl; actor.curHP -= remainingCost; remainingCost = 0; }
-                            }
-
-                            int baseDmg = max(1, card->getCost());
-                            bool elementMatch = false;
-                            for (auto &ce : card->getElements()) if (actor.ch->hasElement(ce)) { elementMatch = true; break; }
-                            int finalDmg = baseDmg * (elementMatch ? 2 : 1);
-                            bool dmgIsMagic = !isPhysical;
-
-                            // 先执行卡牌效果（若注册）
-                            if (cardEffects.count(card->getId())) {
-                                try { cardEffects[card->getId()](cur, opp, charIdx, targetIsBase, targetIdx, card, finalDmg, dmgIsMagic); } catch(...) {}
-                            }
-
-                            cout << actor.ch->getName() << " 使用 " << card->getName() << " 对 ";
-                            if (targetIsBase) cout << opp.name << " 的基地"; else cout << opp.chars[targetIdx].ch->getName();
-                            cout << " 造成 " << finalDmg << (dmgIsMagic ? " 魔法伤害" : " 物理伤害") << "（已支付消耗）。" << endl;
-
-                            if (targetIsBase) {
-                                applyDamageToBase(opp, finalDmg);
-                                cout << opp.name << " 的基地剩余生命: " << opp.baseHP << endl;
-                            } else {
-                                applyDamageToChar(opp, targetIdx, finalDmg, dmgIsMagic);
-                            }
-
-                            cur.hand.erase(cur.hand.begin() + hidx);
-
-                            int win = checkWinner(p1, p2);
-                            if (win != 0) { 
-								if (win == 1) cout << p1.name << " 获胜！" << endl; 
-								else cout << p2.name << " 获胜！" << endl; 
-								running = false; 
-								break; 
-							}
-                        } else cout << "未知操作，请重试。" << endl;
-                    } // 回合内行动循环结束
-
-					if (!running) break;
-
-					// 回合切换
-					active = 1 - active;
-					++turn;
-				} // 对局主循环结束
-
-				cout << "对局结束，返回主菜单。" << endl;
-			} break;
+            case 9:
+                playLocalMatch();
+                break;
 
-			case 10: { // 局域网联机（主机/加入） - 简化的对战同步 + 表情原型（Windows 下可用）
+			case 10: { // 局域网联机（主机/加入） - 简化的对战同步 + 表情原型
 				cin.ignore(numeric_limits<streamsize>::max(), '\n');
 
 				cout << "局域网联机模式：选择 1 主机，2 加入，其他 取消: ";
@@ -1350,130 +6123,120 @@ void GameManager::run() {
 					break;
 				}
 
-#if defined(_WIN32) || defined(_WIN64)
-				WSADATA wsaData;
-				if (WSAStartup(MAKEWORD(2,2), &wsaData) != 0) {
-					cout << "WSAStartup 失败，无法使用网络。" << endl;
-					break;
-				}
-				using socket_t = SOCKET;
-#else
-				cout << "当前平台未实现局域网联机（仅 Windows 支持），返回主菜单。" << endl;
-				break;
-#endif
-				const int BUF = 4096;
-				atomic<bool> netRunning{true};
-				queue<string> recvQ;
-				mutex qMutex;
-				condition_variable qCv;
-				auto enqueue = [&](string m){
-					lock_guard<mutex> lk(qMutex);
-					recvQ.push(move(m));
-					qCv.notify_one();
-				};
-				auto dequeueAll = [&]()->vector<string>{
-					vector<string> out;
-					lock_guard<mutex> lk(qMutex);
-					while(!recvQ.empty()){ out.push_back(recvQ.front()); recvQ.pop(); }
-					return out;
-				};
+				cout << "使用旧版文本协议（与旧版本联机，双方需一致）？(y/N): ";
+				string compat; getline(cin, compat);
+				const bool textProtocol = (compat == "y" || compat == "Y");
 
-				socket_t conn = 0;
+				LanLink link(textProtocol);
+				net::Socket conn;
 				bool isHost = (mode == "1");
+				string netError;
 
-#if defined(_WIN32) || defined(_WIN64)
 				if (isHost) {
 					cout << "主机：输入监听端口（默认4000）: ";
 					string ps; getline(cin, ps); int port=4000; try{ if(!ps.empty()) port=stoi(ps); }catch(...) {}
-					SOCKET listenSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-					if (listenSock == INVALID_SOCKET) { cout << "创建监听失败: " << WSAGetLastError() << endl; WSACleanup(); break; }
-					sockaddr_in svc{}; svc.sin_family = AF_INET; svc.sin_addr.s_addr = INADDR_ANY; svc.sin_port = htons((unsigned short)port);
-					if (bind(listenSock, (SOCKADDR*)&svc, sizeof(svc)) == SOCKET_ERROR) { cout << "bind 失败: " << WSAGetLastError() << endl; closesocket(listenSock); WSACleanup(); break; }
-					if (listen(listenSock,1) == SOCKET_ERROR) { cout << "listen 失败: " << WSAGetLastError() << endl; closesocket(listenSock); WSACleanup(); break; }
+					net::Socket listenSock = net::Socket::listenTcp((uint16_t)port, 1, false, &netError);
+					if (!listenSock.valid()) { cout << "监听失败: " << netError << endl; break; }
 					cout << "等待连接，端口 " << port << " ..." << endl;
-					SOCKET client = accept(listenSock, nullptr, nullptr);
-					if (client == INVALID_SOCKET) { cout << "accept 失败: " << WSAGetLastError() << endl; closesocket(listenSock); WSACleanup(); break; }
-					conn = client; closesocket(listenSock);
+					conn = LanLink::acceptPeer(listenSock, -1, &netError);
+					if (!conn.valid()) { cout << "accept 失败: " << netError << endl; break; }
 				} else {
 					cout << "加入：输入主机地址（默认127.0.0.1）: ";
 					string host; getline(cin, host); if (host.empty()) host="127.0.0.1";
 					cout << "输入端口（默认4000）: ";
 					string ps; getline(cin, ps); int port=4000; try{ if(!ps.empty()) port=stoi(ps); }catch(...) {}
-					SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-					if (sock == INVALID_SOCKET) { cout << "socket 失败: " << WSAGetLastError() << endl; WSACleanup(); break; }
-					sockaddr_in serv{}; serv.sin_family = AF_INET; inet_pton(AF_INET, host.c_str(), &serv.sin_addr); serv.sin_port = htons((unsigned short)port);
 					cout << "尝试连接..." << endl;
-					if (connect(sock, (SOCKADDR*)&serv, sizeof(serv)) == SOCKET_ERROR) { cout << "connect 失败: " << WSAGetLastError() << endl; closesocket(sock); WSACleanup(); break; }
-					conn = sock;
+					conn = net::Socket::connectTcp(host, (uint16_t)port, &netError);
+					if (!conn.valid()) { cout << "connect 失败: " << netError << endl; break; }
 				}
-#endif
-
-				// 启动接收线程
-				thread recvThread([&](){
-					char buf[BUF];
-					while(netRunning){
-#if defined(_WIN32) || defined(_WIN64)
-						int r = recv(conn, buf, BUF-1, 0);
-#else
-						int r = recv(conn, buf, BUF-1, 0);
-#endif
-						if (r <= 0) { netRunning = false; qCv.notify_one(); break; }
-						buf[r]=0;
-						// 支持粘包：逐行分割
-						string s(buf);
-						size_t pos=0;
-						while(true){
-							size_t nl = s.find('\n', pos);
-							if (nl==string::npos) { string tail = s.substr(pos); if(!tail.empty()) enqueue(tail); break; }
-							string line = s.substr(pos, nl-pos);
-							enqueue(line);
-							pos = nl+1;
-						}
-					}
-				});
+				if (!link.start(move(conn), &netError)) { cout << netError << endl; break; }
+				wire::Message outgoing;
 
 				// 简单握手：交换 NAME
 				cout << "请输入你的名称: ";
 				string myName; getline(cin, myName); if (myName.empty()) myName = (isHost ? "Host" : "Client");
-				auto sendLine = [&](const string &m){
-#if defined(_WIN32) || defined(_WIN64)
-					send(conn, m.c_str(), (int)m.size(), 0);
-#endif
-				};
-				sendLine(string("NAME;")+myName+"\n");
+				outgoing.type = +wire::MessageType::Name;
+				outgoing.text = myName;
+				link.send(outgoing);
+				// 主机生成本局种子发给对端，双方各用从该种子拆分出的子流洗牌，整局可由这一个种子复现
+				uint64_t matchSeed = 0;
+				bool haveSeed = isHost;
+				if (isHost) {
+					random_device rd;
+					matchSeed = ((uint64_t)rd() << 32) | rd();
+					outgoing.type = +wire::MessageType::Seed;
+					outgoing.value = matchSeed;
+					link.send(outgoing);
+				}
 				string theirName = "对手";
-				// 等待短时间看是否收到 NAME
+				// 等待短时间接收 NAME（以及客户端等待 SEED）
 				{
-					unique_lock<mutex> lk(qMutex);
-					if (qCv.wait_for(lk, chrono::seconds(2), [&]{ return !recvQ.empty(); })) {
-						auto v = dequeueAll();
-						for (auto &msg : v) if (msg.rfind("NAME;",0)==0) theirName = msg.substr(5);
+					bool haveName = false;
+					auto deadline = chrono::steady_clock::now() + chrono::seconds(isHost ? 2 : 5);
+					// 握手完成即停止，之后的 DeckCode/Characters 留在队列中给后续流程处理
+					while (!(haveName && haveSeed)) {
+						const wire::Message* msg = link.front();
+						if (!msg) {
+							auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+							if (!link.connected() || left.count() <= 0) break; // 连接已断开或超时
+							link.wait(left);
+							continue;
+						}
+						if (msg->type == +wire::MessageType::Name) { theirName = msg->text; haveName = true; }
+						else if (msg->type == +wire::MessageType::Seed) { matchSeed = msg->value; haveSeed = true; }
+						link.release();
 					}
 				}
-				cout << "已连接: " << theirName << endl;
+				if (link.protocolMismatch()) {
+					cout << "对方使用的联机协议与本机不同，请双方在文本协议选项上保持一致。" << endl;
+					link.stop();
+					break;
+				}
+				if (!haveSeed) {
+					matchSeed = random_device()();
+					cout << "未收到主机的随机种子，本局无法复现。" << endl;
+				}
+				Rng matchRng(matchSeed);
+				Rng hostRng = matchRng.split();
+				Rng clientRng = matchRng.split();
+				Rng& localRng = isHost ? hostRng : clientRng;
+				cout << "已连接: " << theirName << "（本局种子 " << matchSeed << "）" << endl;
 
 				// 选择牌组与角色（仅本地选择）
-				if (decks.empty()) { cout << "没有牌组，取消联机。" << endl; netRunning=false; if (recvThread.joinable()) recvThread.join(); closesocket(conn); WSACleanup(); break; }
+				if (decks.empty()) { cout << "没有牌组，取消联机。" << endl; link.stop(); break; }
 				displayDecks();
 				cout << "选择你的牌组编号: ";
 				string ds; getline(cin, ds); int didx = 0; try{ didx=stoi(ds); }catch(...){ didx=0; } if (didx<0||didx>=(int)decks.size()) didx=0;
 				Deck* chosen = &decks[didx];
 				// 发送 DECKCODE（供对端参考）
-				sendLine(string("DECKCODE;")+chosen->getDeckCode()+"\n");
+				outgoing.type = +wire::MessageType::DeckCode;
+				outgoing.deckCode = chosen->getDeckCode();
+				link.send(outgoing);
 
 				// 本地玩家状态结构（简化复制）
 				struct NChar { shared_ptr<Character> ch; int hp; int energy; };
-				struct NPlayer { string name; int baseHP=50; int baseMana=30; vector<NChar> chars; vector<shared_ptr<Card>> deck; vector<shared_ptr<Card>> hand; };
+				struct NPlayer { string name; int baseHP=50; int baseMana=30; vector<NChar> chars; vector<CardHandle> deck; vector<CardHandle> hand; };
 				NPlayer local, remote; local.name = myName; remote.name = theirName;
 
+				// 解析对端发来的 DECKCODE，记录其牌库
+				DeckCodeParser remoteParser(cardDB, characterDB);
+				DecodedDeck remoteDeck;
+				auto handleRemoteDeckCode = [&](const string &code){
+					if (remoteParser.parse(code, remoteDeck)) {
+						remote.deck = remoteDeck.cards;
+						cout << "\n对手牌组: " << remoteDeck.name << "（" << remoteDeck.cards.size() << " 张卡牌）" << endl;
+					} else {
+						cout << "\n对手牌组代码无效: " << DeckCodeParser::describe(remoteDeck.error) << endl;
+					}
+				};
+
 				// 构建本地牌库并抽初始手牌
-				{ vector<shared_ptr<Card>> tmp; 
-				  // reuse local helper buildDeckFromDeckCode if available; fallback to cardDB
-				  try { string code = chosen->getDeckCode(); string decoded = base64::decode(code); size_t sep = decoded.find('|'); if (sep!=string::npos){ string data=decoded.substr(0,sep); vector<string> parts; boost::split(parts,data,boost::is_any_of(";")); if (parts.size()>=4){ vector<string> ids; boost::split(ids, parts[3], boost::is_any_of(",")); for (auto &id:ids){ if (id.empty()) continue; auto c = cardDB.findCardById(id); if (c) tmp.push_back(c);} } } } catch(...){} 
-				  if (tmp.empty()) tmp = cardDB.getAllCards();
+				{ vector<CardHandle> tmp; 
+				  buildDeckFromDeckCode(chosen->getDeckCode(), tmp);
+				  if (tmp.empty()) { for (const auto &c : cardDB.getAllCards()) tmp.push_back(c->getHandle()); }
 				  local.deck = tmp;
 				  // shuffle
-				  std::random_device rd; std::mt19937 g(rd()); std::shuffle(local.deck.begin(), local.deck.end(), g);
+				  localRng.shuffle(local.deck.begin(), local.deck.end());
 				  for (int i=0;i<3 && !local.deck.empty();++i){ local.hand.push_back(local.deck.back()); local.deck.pop_back(); }
 				}
 
@@ -1488,31 +6251,59 @@ void GameManager::run() {
 					NChar nc; nc.ch = allChars[ci]; nc.hp = nc.ch->getHealth(); nc.energy = (nc.ch->getEnergy()+1)/2; local.chars.push_back(nc);
 				}
 				// 发送本地角色 id 列表
-				{ string ids; for (size_t i=0;i<local.chars.size();++i){ if (i) ids+=","; ids += local.chars[i].ch->getId(); } sendLine(string("CHARS;")+ids+"\n"); }
+				outgoing.type = +wire::MessageType::Characters;
+				outgoing.text.clear();
+				for (size_t i=0;i<local.chars.size();++i){ if (i) outgoing.text+=","; outgoing.text += local.chars[i].ch->getId(); }
+				link.send(outgoing);
+
+				// 工具：应用对方的消息到本地（简化伤害逻辑）
+				bool myTurn = isHost;
+				bool gotChars = false;
+				auto applyRemote = [&](const wire::Message &m){
+					switch (m.type) {
+						case +wire::MessageType::Play: {
+							const wire::ActionRecord& r = m.action;
+							if (r.card == wire::ActionRecord::NO_CARD) return;
+							const Card& card = cardDB.getCard(r.card);
+							bool isPhysical = card.hasElement(+Element::Physical);
+							int baseD = max(1, card.getCost());
+							int finalD = baseD;
+							// 不考虑元素匹配（远端 actor 元素未知），直接应用
+							bool dmgMagic = !isPhysical;
+							if (r.target == 0){ local.baseHP -= finalD; cout << "\n[对方] 对你基地造成 " << finalD << " 点伤害\n"; }
+							else { int tidx = r.target - 1; if (tidx < (int)local.chars.size()){ auto &tc = local.chars[tidx]; if (dmgMagic){ int et = min(tc.energy, finalD); tc.energy -= et; finalD -= et; } if (finalD>0) tc.hp -= finalD; cout << "\n[对方] 攻击了你的 " << tc.ch->getName() << "\n"; } }
+							break;
+						}
+						case +wire::MessageType::Emoji:
+							cout << "\n[对方表情] " << m.text << endl;
+							break;
+						case +wire::MessageType::DeckCode:
+							handleRemoteDeckCode(m.deckCode);
+							break;
+						case +wire::MessageType::Characters: {
+							vector<string> arr; boost::split(arr, m.text, boost::is_any_of(","));
+							for (auto &id : arr){ auto ch = characterDB.findCharacterById(id); if (ch){ NChar nc; nc.ch = ch; nc.hp = ch->getHealth(); nc.energy = (ch->getEnergy()+1)/2; remote.chars.push_back(nc);} }
+							gotChars = true;
+							break;
+						}
+						case +wire::MessageType::EndTurn:
+							myTurn = true;
+							break;
+						default:
+							break;
+					}
+				};
+				auto drainInbound = [&](){
+					while (const wire::Message* m = link.front()) { applyRemote(*m); link.release(); }
+				};
 
 				// 等待对端的 CHARS（最多等待 10 秒），确保 remote.chars 已初始化
 				{
 					auto start = chrono::steady_clock::now();
-					bool gotChars = false;
-					while (!gotChars && chrono::steady_clock::now() - start < chrono::seconds(10) && netRunning) {
+					while (!gotChars && chrono::steady_clock::now() - start < chrono::seconds(10) && link.connected()) {
 						// 先快速抓取队列中的消息
-						auto msgs = dequeueAll();
-						for (auto &m : msgs) {
-							if (m.rfind("CHARS;", 0) == 0) {
-								vector<string> arr; boost::split(arr, m.substr(6), boost::is_any_of(","));
-								for (auto &id : arr) {
-									auto ch = characterDB.findCharacterById(id);
-									if (ch) { NChar nc; nc.ch = ch; nc.hp = ch->getHealth(); nc.energy = (ch->getEnergy()+1)/2; remote.chars.push_back(nc); }
-								}
-								gotChars = true;
-							} else if (m.rfind("DECKCODE;", 0) == 0) {
-								// 可选：记录对端牌组码或临时解析对端牌库（这里简化忽略）
-							}
-						}
-						if (!gotChars) {
-							unique_lock<mutex> lk(qMutex);
-							qCv.wait_for(lk, chrono::milliseconds(200));
-						}
+						drainInbound();
+						if (!gotChars) link.wait(chrono::milliseconds(200));
 					}
 					if (!gotChars) {
 						cout << "警告：未在超时内收到对手角色信息，继续游戏但无法选择对方前场目标。" << endl;
@@ -1520,86 +6311,60 @@ void GameManager::run() {
 						cout << "已接收对手角色信息，准备开始对战。" << endl;
 					}
 				}
-				
-				// 工具：应用对方 PLAY 到本地（简化伤害逻辑）
-				auto applyRemotePlay = [&](const string &m){
-					if (m.rfind("PLAY;",0)==0){
-						vector<string> p; boost::split(p,m,boost::is_any_of(";"));
-						if (p.size()>=4){
-							string cid = p[1]; int actor = stoi(p[2]); string target = p[3];
-							auto cardptr = cardDB.findCardById(cid);
-							if (!cardptr) return;
-							bool isPhysical = false; for (auto &e : cardptr->getElements()) if (e==+Element::Physical) isPhysical=true;
-							int baseD = max(1, cardptr->getCost());
-							int finalD = baseD;
-							// 不考虑元素匹配（远端 actor 元素未知），直接应用
-							bool dmgMagic = !isPhysical;
-							if (target=="b"){ local.baseHP -= finalD; cout << "\n[对方] 对你基地造成 " << finalD << " 点伤害\n"; }
-							else if (target=="t0"||target=="t1"){ int tidx = (target=="t0")?0:1; if (tidx < (int)local.chars.size()){ auto &tc = local.chars[tidx]; if (dmgMagic){ int et = min(tc.energy, finalD); tc.energy -= et; finalD -= et; } if (finalD>0) tc.hp -= finalD; cout << "\n[对方] 攻击了你的 " << tc.ch->getName() << "\n"; } }
-						}
-					} else if (m.rfind("EMOJI;",0)==0){
-						cout << "\n[对方表情] " << m.substr(6) << endl;
-					} else if (m.rfind("DECKCODE;",0)==0){
-						// ignore or store
-					} else if (m.rfind("CHARS;",0)==0){
-						vector<string> arr; boost::split(arr, m.substr(6), boost::is_any_of(","));
-						for (auto &id : arr){ auto ch = characterDB.findCharacterById(id); if (ch){ NChar nc; nc.ch = ch; nc.hp = ch->getHealth(); nc.energy = (ch->getEnergy()+1)/2; remote.chars.push_back(nc);} }
-					} else if (m=="ENDTURN"){ /* treat as turn end indicator */ }
-				};
 
 				// 简化的回合控制：主机先手
-				bool myTurn = isHost;
 				cout << "网络对战开始，主机先手。" << endl;
-				while(netRunning){
+				while(link.connected()){
 					// 先处理收到的消息
-					auto msgs = dequeueAll();
-					for (auto &mm : msgs) { if (!mm.empty()) applyRemotePlay(mm); }
+					drainInbound();
 					// 检查胜利
 					if (local.baseHP<=0 || remote.baseHP<=0){ if (local.baseHP<=0) cout << "你被击败。" << endl; else cout << "你获胜！" << endl; break; }
 					if (!myTurn){
 						// 等待对方动作: block a bit for new messages
-						unique_lock<mutex> lk(qMutex);
-						qCv.wait_for(lk, chrono::milliseconds(300));
+						link.wait(chrono::milliseconds(300));
 						continue;
 					}
 					// 我的回合：允许出牌/发表情/结束回合/退出
 					cout << "\n你的回合：p 出牌；/emoji 文本 发送表情；e 结束回合；q 退出: ";
 					string op; getline(cin, op);
-					if (op=="q"){ netRunning=false; break; }
-					if (op.rfind("/emoji",0)==0){ string em = op.size()>6?op.substr(7):"🙂"; sendLine(string("EMOJI;")+em+"\n"); cout << "[已发送表情] " << em << endl; continue; }
-					if (op=="e"){ sendLine(string("ENDTURN\n")); myTurn=false; continue; }
+					if (op=="q") break;
+					if (op.rfind("/emoji",0)==0){
+						string em = op.size()>6?op.substr(7):"🙂";
+						outgoing.type = +wire::MessageType::Emoji;
+						outgoing.text = em;
+						link.send(outgoing);
+						cout << "[已发送表情] " << em << endl;
+						continue;
+					}
+					if (op=="e"){ outgoing.type = +wire::MessageType::EndTurn; link.send(outgoing); myTurn=false; continue; }
 					if (op=="p"){
 						// 显示手牌
-						for (int i=0;i<(int)local.hand.size();++i) cout << "["<<i<<"]"<<local.hand[i]->getName()<<" ";
+						for (int i=0;i<(int)local.hand.size();++i) cout << "["<<i<<"]"<<cardDB.getCard(local.hand[i]).getName()<<" ";
 						cout << "\n选择手牌索引: ";
 						string hs; getline(cin, hs); int hi=-1; try{ hi=stoi(hs);}catch(...){hi=-1;}
 						if (hi<0 || hi>=(int)local.hand.size()){ cout << "无效索引\n"; continue; }
-						auto card = local.hand[hi];
+						const Card* card = &cardDB.getCard(local.hand[hi]);
 						cout << "选择角色索引(0或1): "; string as; getline(cin,as); int ai=0; try{ai=stoi(as);}catch(...){ai=0;}
 						if (ai<0 || ai>=(int)local.chars.size()){ cout << "无效角色\n"; continue; }
 						cout << "选择目标：t0/t1/b: "; string tgt; getline(cin,tgt);
+						if (tgt!="b" && tgt!="t0" && tgt!="t1"){ cout << "无效目标\n"; continue; }
 						// 本地应用
-						bool isPhysical=false; for (auto &e : card->getElements()) if (e==+Element::Physical) isPhysical=true;
+						bool isPhysical = card->hasElement(+Element::Physical);
 						int baseD = max(1, card->getCost()); int finalD = baseD;
 						bool dmgMagic = !isPhysical;
 						if (tgt=="b"){ remote.baseHP -= finalD; cout << "对对手基地造成 " << finalD << " 点伤害\n"; }
-						else if (tgt=="t0"||tgt=="t1"){ int tidx = (tgt=="t0")?0:1; if (tidx < (int)remote.chars.size()){ auto &tc = remote.chars[tidx]; if (dmgMagic){ int et=min(tc.energy,finalD); tc.energy -= et; finalD -= et; } if (finalD>0) tc.hp -= finalD; cout << "对对手前场造成伤害\n"; } }
-						// 发送 PLAY
-						string msg = string("PLAY;") + card->getId() + ";" + to_string(ai) + ";" + tgt + "\n";
-						sendLine(msg);
+						else { int tidx = (tgt=="t0")?0:1; if (tidx < (int)remote.chars.size()){ auto &tc = remote.chars[tidx]; if (dmgMagic){ int et=min(tc.energy,finalD); tc.energy -= et; finalD -= et; } if (finalD>0) tc.hp -= finalD; cout << "对对手前场造成伤害\n"; } }
+						// 发送 PLAY（定长行动记录，附卡牌句柄）
+						outgoing.type = +wire::MessageType::Play;
+						outgoing.action = wire::ActionRecord::from(Action::playCard(hi, ai, tgt=="b", tgt=="t1" ? 1 : 0), local.hand[hi]);
+						link.send(outgoing);
 						local.hand.erase(local.hand.begin()+hi);
 						continue;
 					}
 				} // net loop
 
-				// 清理
-				netRunning=false;
-				qCv.notify_one();
-				if (recvThread.joinable()) recvThread.join();
-#if defined(_WIN32) || defined(_WIN64)
-				closesocket(conn);
-				WSACleanup();
-#endif
+				// 清理：停止网络线程并关闭连接
+				link.stop();
 				cout << "退出联机。" << endl;
 			} break;
 
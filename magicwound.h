@@ -4,36 +4,147 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <map>
+#include <array>
+#include <type_traits>
 #include <algorithm>
 #include <random>
 #include <memory>
 #include <sstream>
 #include <iomanip>
+#include <functional>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
 
 // Boost 库头文件
-#include <boost/crc.hpp>
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/binary_from_base64.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
 #include <boost/random.hpp>
 #include <boost/algorithm/string.hpp>
 
 // Better Enums 头文件
 #include <enum.h>
 
-// 使用 Boost 的 CRC32
+// CRC32（IEEE 802.3，与 boost::crc_32_type 相同）：slicing-by-8 查表，
+// 支持 PCLMUL 时长数据改用无进位乘法折叠
 namespace crc32 {
+    const size_t CHECKSUM_LENGTH = 4;   // 旧版牌组代码的校验串：CRC 的前 4 位小写十六进制
+
     uint32_t calculate(const std::string& input);
+    uint32_t calculate(const void* data, size_t length);
+    void write_checksum(const void* data, size_t length, char out[CHECKSUM_LENGTH]);
+    bool verify_checksum(const void* data, size_t length, std::string_view checksum);
     std::string generate_checksum(const std::string& input);
 }
 
-// 使用 Boost 的 Base64
+// Base64（标准字母表，带 '=' 填充）：查表实现，支持 SSSE3 时每次处理 16 个字符
 namespace base64 {
+    inline size_t encodedLength(size_t length) { return (length + 2) / 3 * 4; }
+    inline size_t maxDecodedLength(size_t length) { return length / 4 * 3; }
+
+    // 写入 encodedLength(length) 个字符，返回写入的字符数
+    size_t encode(const void* data, size_t length, char* out);
+    // 严格解码：长度须为 4 的倍数，填充只能出现在末尾，且末尾多余位须为 0。
+    // 输入非法或 capacity 不足时返回 false；成功时 written 为写入的字节数
+    bool decode(const char* input, size_t length, uint8_t* out, size_t capacity, size_t& written);
+
     std::string encode(const std::string &input);
-    std::string decode(const std::string &input);
+    std::string decode(const std::string &input);   // 非法输入返回空串
 }
 
+// 二进制牌组代码（v2）：
+//   [魔数/版本][牌组类型][目录版本 varint][卡牌上限 varint][名称长度 varint][名称]
+//   [角色数][角色索引 varint...][卡牌段数 varint][(索引增量 varint, 张数 varint)...][CRC32 小端]
+namespace deckcode {
+    const uint8_t MAGIC_V2 = 0xA2;          // 高 4 位为魔数 0xA，低 4 位为版本号
+    const uint32_t CATALOG_VERSION = 1;     // 卡牌/角色目录只追加不重排，追加后递增
+    const size_t MAX_NAME_BYTES = 255;
+    const uint32_t MAX_DECK_CARDS = 128;    // 与对局中牌库的容量（MAX_PILE_CARDS）一致
+
+    size_t writeVarint(uint32_t value, uint8_t* out);   // 返回写入字节数（最多 5）
+    bool readVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value);
+}
+
+// 只读字符串索引：开放寻址（线性探测）平铺表，键为目录中已有字符串的视图，
+// 值为该字符串在目录中的位置。目录加载完成后构建一次，查询时不分配内存
+class FlatStringIndex {
+public:
+    static constexpr uint16_t NOT_FOUND = 0xFFFF;
+
+    // keys[i] 映射到 i；重复的键保留第一次出现的位置
+    void build(const std::vector<std::string_view>& keys);
+    uint16_t find(std::string_view key) const;
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint16_t value;   // NOT_FOUND 表示空槽
+    };
+    std::vector<Slot> slots;
+    std::vector<std::string_view> keys;
+    size_t mask = 0;
+
+    static uint32_t hash(std::string_view key);
+};
+
+// xoshiro256** 随机数生成器：32 字节状态、可按字节复制（可直接放进 GameState 随快照保存），
+// 由一个 64 位种子经 splitmix64 展开。洗牌与有界采样都在这里实现而不依赖标准库的分布，
+// 保证同一种子在任何编译器和平台上得到相同的序列
+class Rng {
+public:
+    typedef uint64_t result_type;
+
+    explicit Rng(uint64_t seed = 0) { this->seed(seed); }
+    void seed(uint64_t seed);
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+    result_type operator()() { return next(); }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~(result_type)0; }
+
+    // [0, bound) 上的均匀整数：乘法取高位，落入偏差区间时重抽（Lemire），无取模偏差；bound 为 0 时返回 0
+    uint32_t below(uint32_t bound) {
+        uint64_t m = (next() >> 32) * bound;
+        if ((uint32_t)m < bound) {
+            uint32_t threshold = (0u - bound) % bound;
+            while ((uint32_t)m < threshold) m = (next() >> 32) * bound;
+        }
+        return (uint32_t)(m >> 32);
+    }
+
+    // Fisher-Yates 洗牌，空区间安全
+    template <typename It>
+    void shuffle(It first, It last) {
+        for (auto i = last - first; i > 1; --i) std::swap(first[i - 1], first[below((uint32_t)i)]);
+    }
+
+    // 状态摘要，供置换表区分随机数状态不同的局面
+    uint64_t fingerprint() const { return s[0] ^ rotl(s[1], 16) ^ rotl(s[2], 32) ^ rotl(s[3], 48); }
+
+    // 拆分：返回沿用当前序列的子生成器，自身前进 2^128 步。各线程/各局各取一个子生成器，序列互不重叠
+    Rng split();
+
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    void jump();
+};
+
+// 卡牌句柄：卡牌在不可变卡牌库中的位置
+typedef uint16_t CardHandle;
+
 // 卡牌类型枚举
 BETTER_ENUM(CardType, int,
     Creature = 1,    // 生物
@@ -51,6 +162,46 @@ BETTER_ENUM(Element, int,
     Wind = 7         // 风
 )
 
+// 元素集合：Element 值 1~7 依次对应第 0~6 位，判断与求交都是一次位运算
+class ElementSet {
+private:
+    uint8_t bits;
+
+public:
+    static constexpr int MAX_ELEMENTS = 7;
+
+    // 按元素值从小到大遍历集合中的元素
+    class iterator {
+    private:
+        uint8_t rest;
+    public:
+        explicit iterator(uint8_t rest) : rest(rest) {}
+        Element operator*() const { return Element::_from_integral_unchecked(__builtin_ctz(rest) + 1); }
+        iterator& operator++() { rest &= rest - 1; return *this; }
+        bool operator!=(const iterator& other) const { return rest != other.rest; }
+    };
+
+    ElementSet() : bits(0) {}
+    ElementSet(std::initializer_list<Element> elements) : bits(0) {
+        for (Element e : elements) add(e);
+    }
+
+    static uint8_t bit(Element element) { return static_cast<uint8_t>(1u << (element._to_integral() - 1)); }
+    static ElementSet fromMask(uint8_t mask) { ElementSet set; set.bits = mask & 0x7F; return set; }
+
+    uint8_t mask() const { return bits; }
+    bool has(Element element) const { return (bits & bit(element)) != 0; }
+    bool intersects(ElementSet other) const { return (bits & other.bits) != 0; }
+    bool hasOtherThan(Element element) const { return (bits & ~bit(element)) != 0; }
+    bool empty() const { return bits == 0; }
+    int size() const { return __builtin_popcount(bits); }
+    void add(Element element) { bits |= bit(element); }
+    ElementSet& operator|=(ElementSet other) { bits |= other.bits; return *this; }
+
+    iterator begin() const { return iterator(bits); }
+    iterator end() const { return iterator(0); }
+};
+
 // 卡牌稀有度
 BETTER_ENUM(Rarity, int,
     Common = 1,
@@ -71,29 +222,33 @@ class Character {
 private:
     std::string id;
     std::string name;
-    std::vector<Element> elements;
+    ElementSet elements;
     int health;
     int energy;
     std::string ability;
     std::string description;
     std::string passive_ability;
     std::string passive_description;
+    uint16_t index = 0;    // 在角色库中的位置，用于二进制牌组代码
+
+    friend class CharacterDatabase;
 
 public:
     Character(const std::string& id, const std::string& name, 
-              const std::vector<Element>& elements, int health, int energy,
+              ElementSet elements, int health, int energy,
               const std::string& ability, const std::string& description,
               const std::string& passive_ability, const std::string& passive_description);
 
     std::string getId() const { return id; }
     std::string getName() const { return name; }
-    std::vector<Element> getElements() const { return elements; }
+    ElementSet getElements() const { return elements; }
     int getHealth() const { return health; }
     int getEnergy() const { return energy; }
     std::string getAbility() const { return ability; }
     std::string getDescription() const { return description; }
     std::string getPassiveAbility() const { return passive_ability; }
     std::string getPassiveDescription() const { return passive_description; }
+    uint16_t getIndex() const { return index; }
 
     bool hasElement(Element element) const;
     void display() const;
@@ -106,51 +261,110 @@ private:
     std::string id;
     std::string name;
     CardType type;
-    std::vector<Element> elements;
+    ElementSet elements;
     int cost;
     Rarity rarity;
     std::string description;
     int attack;
     int defense;
     int health;
+    CardHandle handle = 0;  // 在卡牌库中的位置，亦用于二进制牌组代码
+
+    friend class CardDatabase;
 
 public:
     std::string elementToString(Element element) const;
     std::string rarityToString(Rarity rarity) const;
     // 修改构造函数以正确初始化type
-    Card(const std::string& id, const std::string& name, const std::vector<Element>& elements, 
+    Card(const std::string& id, const std::string& name, ElementSet elements, 
          int cost, Rarity rarity, const std::string& description,
          int attack = 0, int defense = 0, int health = 0);
 
     std::string getId() const { return id; }
     std::string getName() const { return name; }
     CardType getType() const { return type; }
-    std::vector<Element> getElements() const { return elements; }
+    ElementSet getElements() const { return elements; }
     int getCost() const { return cost; }
     Rarity getRarity() const { return rarity; }
     std::string getDescription() const { return description; }
     int getAttack() const { return attack; }
     int getDefense() const { return defense; }
     int getHealth() const { return health; }
+    CardHandle getHandle() const { return handle; }
 
     bool hasElement(Element element) const;
     std::string serialize() const;
     void display() const;
 };
 
+class CardDatabase;
+class CharacterDatabase;
+
+// 牌组代码解析错误
+BETTER_ENUM(DeckCodeError, int,
+    None = 0,
+    Empty,               // 空代码
+    BadBase64,           // 不是合法的 Base64
+    BadChecksum,         // 校验和不匹配
+    Malformed,           // 字段缺失或格式错误
+    UnsupportedVersion,  // 代码来自更新的卡牌目录
+    BadDeckType,         // 未知的牌组类型
+    UnknownCharacter,    // 角色索引超出角色库
+    UnknownCard,         // 卡牌索引超出卡牌库
+    TooManyCards         // 角色或卡牌数量超出上限
+)
+
+// 牌组代码的解码结果：角色与卡牌均以目录中的位置表示，可直接复用以避免重复分配
+struct DecodedDeck {
+    DeckCodeError error = DeckCodeError::None;
+    bool legacy = false;                 // 来自旧版文本格式
+    std::string name;
+    DeckType deckType = DeckType::Standard;
+    int maxCardLimit = 20;
+    std::vector<uint16_t> characters;    // 角色库中的索引
+    std::vector<CardHandle> cards;
+
+    bool ok() const { return error == +DeckCodeError::None; }
+};
+
+// 牌组代码解析器：Base64 只解码一次到可复用的暂存区，旧版文本格式用 string_view 原地切分。
+// 每个线程各用一个实例
+class DeckCodeParser {
+public:
+    DeckCodeParser(const CardDatabase& cardDB, const CharacterDatabase& characterDB);
+
+    // 成功返回 true；失败时 out.error 给出原因
+    bool parse(std::string_view code, DecodedDeck& out);
+    static const char* describe(DeckCodeError error);
+
+private:
+    const CardDatabase& cardDB;
+    const CharacterDatabase& characterDB;
+    std::vector<uint8_t> scratch;
+
+    DeckCodeError parseBinary(const uint8_t* data, size_t length, DecodedDeck& out) const;
+    DeckCodeError parseLegacy(std::string_view text, DecodedDeck& out) const;
+};
+
 // 牌组类
 class Deck {
 private:
     std::string name;
     DeckType deckType;
-    std::vector<std::shared_ptr<Card>> cards;
+    std::vector<CardHandle> cards;
     std::vector<std::shared_ptr<Character>> characters;
-    std::vector<Element> deckElements;
-    std::string deckCode;
+    // 按元素值 - 1 / 卡牌类型值 - 1 索引的张数，增删卡牌时 O(1) 维护
+    std::array<int, ElementSet::MAX_ELEMENTS> elementCounts;
+    std::array<int, 2> typeCounts;
+    // 牌组代码在 getDeckCode() 时才按需生成；修改牌组只置脏标记
+    mutable std::string deckCode;
+    mutable bool deckCodeDirty;
     int maxCardLimit;  // 最大卡牌数量限制
 
-    void updateDeckElements();
-    void updateDeckCode();
+    void countCard(CardHandle card, int delta);
+    void recountCards();
+    void updateDeckCode() const;
+    size_t encodeBinary(uint8_t* out, size_t capacity) const;
     std::string elementToString(Element element) const;
     std::string cardTypeToString(CardType type) const;
     std::string deckTypeToString() const;
@@ -158,7 +372,7 @@ private:
 public:
     Deck(const std::string& name, DeckType type = +DeckType::Standard);
     
-    void addCard(const std::shared_ptr<Card>& card);
+    void addCard(CardHandle card);
     bool removeCard(const std::string& cardName);
     void addCharacter(const std::shared_ptr<Character>& character);
     bool removeCharacter(const std::string& characterName);
@@ -167,18 +381,28 @@ public:
     size_t getCharacterCount() const;
     std::string getName() const;
     DeckType getDeckType() const;
-    std::string getDeckCode() const;
+    const std::string& getDeckCode() const;
     int getMaxCardLimit() const { return maxCardLimit; }
-    void setMaxCardLimit(int limit) { maxCardLimit = limit; }
+    void setMaxCardLimit(int limit) { maxCardLimit = limit; deckCodeDirty = true; }
+    
+    const std::vector<CardHandle>& getCards() const { return cards; }
+    const std::vector<std::shared_ptr<Character>>& getCharacters() const { return characters; }
     
-    std::map<Element, int> getElementDistribution() const;
+    // 下标为元素值 - 1，值为含该元素的卡牌张数
+    const std::array<int, ElementSet::MAX_ELEMENTS>& getElementDistribution() const { return elementCounts; }
+    // 下标为卡牌类型值 - 1
+    const std::array<int, 2>& getTypeDistribution() const { return typeCounts; }
     void display() const;
-    void shuffle(); // 修改shuffle方法
+    void shuffle(Rng& rng);
     
     bool importFromDeckCode(const std::string& code, 
-                           const std::vector<std::shared_ptr<Card>>& allCards,
-                           const std::vector<std::shared_ptr<Character>>& allCharacters);
+                           const CardDatabase& cardDB,
+                           const CharacterDatabase& characterDB);
+    // 用解码结果整体替换牌组内容，牌组代码随之重新生成
+    void assign(const DecodedDeck& decoded, const CharacterDatabase& characterDB);
     static bool isValidDeckCode(const std::string& code);
+    // 牌组代码中的类型字段可能是数值或枚举名（如 "Standard"）
+    static DeckType parseDeckType(std::string_view field);
     
     bool isValid() const;
 };
@@ -187,39 +411,1185 @@ public:
 class CharacterDatabase {
 private:
     std::vector<std::shared_ptr<Character>> allCharacters;
+    FlatStringIndex idIndex;
+    FlatStringIndex nameIndex;
     void initializeCharacters();
+    void buildIndexes();
 
 public:
     CharacterDatabase();
+    // 全局只读角色库，首次调用时加载
+    static const CharacterDatabase& instance();
     const std::vector<std::shared_ptr<Character>>& getAllCharacters() const;
-    std::shared_ptr<Character> findCharacter(const std::string& name) const;
-    std::shared_ptr<Character> findCharacterById(const std::string& id) const;
+    std::shared_ptr<Character> findCharacter(std::string_view name) const;
+    std::shared_ptr<Character> findCharacterById(std::string_view id) const;
+    // 找不到时返回 FlatStringIndex::NOT_FOUND
+    uint16_t findIndexById(std::string_view id) const { return idIndex.find(id); }
     std::vector<std::shared_ptr<Character>> getCharactersByElement(Element element) const;
 };
 
+// 卡牌筛选条件，各条件之间为“与”关系；取默认值的条件不参与筛选
+struct CardQuery {
+    int type = 0;               // CardType 值，0 表示不限
+    int rarity = 0;             // Rarity 值，0 表示不限
+    ElementSet anyElements;     // 至少包含其中一个元素，空集表示不限
+    ElementSet allElements;     // 必须包含全部元素，空集表示不限
+    int minCost = 0;
+    int maxCost = 255;
+    int minAttack = 0;          // 生物属性下限，0 表示不限
+    int minDefense = 0;
+    int minHealth = 0;
+};
+
+// 筛选结果：按卡牌句柄排列的位图视图，可重复用于多次查询以避免分配
+class CardSelection {
+private:
+    std::vector<uint64_t> words;
+    size_t limit = 0;   // 卡牌库大小
+
+    friend class CardColumns;
+
+public:
+    // 按句柄升序遍历被选中的卡牌
+    class iterator {
+    private:
+        const uint64_t* words;
+        size_t wordCount;
+        size_t index;
+        uint64_t rest;
+        void skipEmpty() {
+            while (rest == 0) {
+                if (++index >= wordCount) { index = wordCount; return; }
+                rest = words[index];
+            }
+        }
+    public:
+        iterator(const uint64_t* words, size_t wordCount, size_t index)
+            : words(words), wordCount(wordCount), index(index), rest(index < wordCount ? words[index] : 0) { skipEmpty(); }
+        CardHandle operator*() const { return static_cast<CardHandle>(index * 64 + __builtin_ctzll(rest)); }
+        iterator& operator++() { rest &= rest - 1; skipEmpty(); return *this; }
+        bool operator!=(const iterator& other) const { return index != other.index || rest != other.rest; }
+    };
+
+    iterator begin() const { return iterator(words.data(), words.size(), 0); }
+    iterator end() const { return iterator(words.data(), words.size(), words.size()); }
+    bool contains(CardHandle handle) const { return handle < limit && (words[handle / 64] >> (handle % 64)) & 1; }
+    size_t count() const;
+};
+
+// 卡牌库的列式镜像：每个属性一列连续存放，末尾补齐到 SIMD 宽度，
+// 筛选时一次比较 16 张卡牌并直接写入结果位图
+class CardColumns {
+private:
+    size_t count = 0;
+    std::vector<uint8_t> cost;
+    std::vector<uint8_t> rarity;
+    std::vector<uint8_t> type;
+    std::vector<uint8_t> elements;
+    std::vector<int16_t> attack;
+    std::vector<int16_t> defense;
+    std::vector<int16_t> health;
+
+public:
+    static const size_t LANES = 16;
+
+    void build(const std::vector<std::shared_ptr<Card>>& cards);
+    void select(const CardQuery& query, CardSelection& out) const;
+    size_t size() const { return count; }
+};
+
 // 卡牌数据库类
 class CardDatabase {
 private:
     std::vector<std::shared_ptr<Card>> allCards;
+    FlatStringIndex idIndex;
+    FlatStringIndex nameIndex;
+    CardColumns columns;
     void initializeCards();
+    void buildIndexes();
 
 public:
     CardDatabase();
+    // 全局只读卡牌库，首次调用时加载；句柄在整个进程内有效
+    static const CardDatabase& instance();
     const std::vector<std::shared_ptr<Card>>& getAllCards() const;
-    std::shared_ptr<Card> findCard(const std::string& name) const;
-    std::shared_ptr<Card> findCardById(const std::string& id) const;
+    const Card& getCard(CardHandle handle) const { return *allCards[handle]; }
+    size_t getCardCount() const { return allCards.size(); }
+    std::shared_ptr<Card> findCard(std::string_view name) const;
+    std::shared_ptr<Card> findCardById(std::string_view id) const;
+    // 找不到时返回 FlatStringIndex::NOT_FOUND
+    CardHandle findHandleById(std::string_view id) const { return idIndex.find(id); }
     std::vector<std::shared_ptr<Card>> getCardsByType(CardType type) const;
     std::vector<std::shared_ptr<Card>> getCardsByElement(Element element) const;
     std::vector<std::shared_ptr<Card>> getCardsByRarity(Rarity rarity) const;
+    // 组合条件筛选，结果写入可复用的 out
+    void select(const CardQuery& query, CardSelection& out) const { columns.select(query, out); }
+    CardSelection select(const CardQuery& query) const;
+};
+
+// 对局中角色的实时状态
+struct PlayerCharState {
+    const Character* ch;
+    int curHP;
+    int curEnergy;
+};
+
+// 容量固定、元素内联存放的顺序容器，整体可按字节复制。已满时 push_back 不插入并返回 false，由调用方按规则处理
+template <typename T, size_t N>
+class FixedVector {
+    static_assert(std::is_trivially_copyable<T>::value, "FixedVector 只能存放可按字节复制的类型");
+    static_assert(N <= 0xFFFF, "FixedVector 容量过大");
+
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    static constexpr size_t capacity() { return N; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T& back() { return items[count - 1]; }
+    const T& back() const { return items[count - 1]; }
+    iterator begin() { return items; }
+    iterator end() { return items + count; }
+    const_iterator begin() const { return items; }
+    const_iterator end() const { return items + count; }
+
+    void clear() { count = 0; }
+    bool push_back(const T& value) {
+        if (count >= N) return false;
+        items[count++] = value;
+        return true;
+    }
+    void pop_back() { --count; }
+    iterator erase(iterator pos) {
+        std::copy(pos + 1, end(), pos);
+        --count;
+        return pos;
+    }
+    // 超出容量的部分被截断
+    template <typename It>
+    void assign(It first, It last) {
+        count = 0;
+        for (; first != last && count < N; ++first) items[count++] = *first;
+    }
+
+private:
+    uint16_t count = 0;
+    T items[N];
+};
+
+// 对局中牌库/手牌的容量；牌组代码可解码的卡牌数不超过该容量，开局时整副牌组都能放入牌库。
+// 对局中手牌已满时不再抽牌或获得牌，牌库已满时不再移入牌
+const size_t MAX_PILE_CARDS = 128;
+static_assert(deckcode::MAX_DECK_CARDS <= MAX_PILE_CARDS, "牌组代码的卡牌上限不能超过对局牌库容量");
+// 每个玩家同时生效的持续效果数，以及记录的减费牌数
+const size_t MAX_LASTING_EFFECTS = 4;
+const size_t MAX_DISCOUNTED_CARDS = 16;
+
+// 对局中单个玩家的状态。不含任何指向堆的成员（玩家名保存在 MatchEngine 中），
+// 因此整个 GameState 可以按字节复制，快照即一次 memcpy
+struct PlayerState {
+    int baseHP = 50;
+    int baseMana = 30;
+    FixedVector<PlayerCharState, 3> chars; // 0,1 前场；2 后场（替补）
+    FixedVector<CardHandle, MAX_PILE_CARDS> deck;
+    FixedVector<CardHandle, MAX_PILE_CARDS> hand;
+    // 持续效果：该玩家打出、要到其下个回合开始才结束的牌，届时触发各自的 TurnStart 效果后清空
+    FixedVector<CardHandle, MAX_LASTING_EFFECTS> lasting;
+    int playsLeft = -1;     // 还能打出的牌数，-1 表示不限（时空限速）
+    // 打出时魔力消耗减少（2）的牌，每张打出时消耗一项（瓶装记忆）
+    FixedVector<CardHandle, MAX_DISCOUNTED_CARDS> discounted;
+};
+
+// 完整的对局状态
+struct GameState {
+    PlayerState players[2];
+    int turn = 1;
+    int active = 0;         // 0 -> 玩家1, 1 -> 玩家2
+    int winner = 0;         // 0 未分胜负, 1 玩家1 获胜, 2 玩家2 获胜
+    bool finished = false;
+    Rng rng;                // 对局内的全部随机性（洗牌、随机效果）都取自这里，随快照一起保存
+};
+static_assert(std::is_trivially_copyable<GameState>::value, "GameState 必须可按字节复制以支持快照");
+
+// 行动类型
+BETTER_ENUM(ActionType, int,
+    PlayCard = 1,    // 出牌
+    EndTurn = 2,     // 结束回合
+    Quit = 3         // 退出对局
+)
+
+// 行动结果
+BETTER_ENUM(ActionResult, int,
+    Ok = 0,
+    GameOver = 1,         // 对局已结束
+    EmptyHand = 2,        // 手牌为空
+    InvalidHandIndex = 3, // 无效手牌索引
+    InvalidActor = 4,     // 无效角色索引
+    PhysicalOnly = 5,     // 普通人只能使用物理牌
+    InvalidTarget = 6,    // 无效目标指示
+    EmptyTargetSlot = 7,  // 目标前场位置没有角色
+    PlayLimit = 8         // 已达到本轮可打出的牌数上限
+)
+
+// 玩家行动：出牌时指定手牌、出手的前场角色与目标（对方前场 t0/t1 或基地）
+struct Action {
+    ActionType type = +ActionType::EndTurn;
+    int handIndex = -1;
+    int actorIndex = -1;
+    bool targetIsBase = false;
+    int targetIndex = -1;
+
+    static Action playCard(int handIndex, int actorIndex, bool targetIsBase, int targetIndex);
+    static Action endTurn();
+    static Action quit();
+};
+
+// 回放的紧凑行动流：0x00 结束回合；0x01 退出；出牌为 0x80 | 角色 << 2 | 目标（0 基地，1/2 对方前场 0/1），
+// 其后 1 字节手牌下标
+namespace replay {
+    void encodeAction(const Action& action, std::vector<uint8_t>& out);
+    bool decodeAction(const uint8_t*& p, const uint8_t* end, Action& out);
+}
+
+// 对局开始前的玩家配置
+struct PlayerSetup {
+    std::string name;
+    std::vector<CardHandle> deck;
+    std::vector<std::shared_ptr<Character>> characters;
+};
+
+// 卡牌效果的触发时机
+BETTER_ENUM(EffectTrigger, uint8_t,
+    OnPlay = 0,     // 打出后、伤害结算前；可修改 damage 与 magic
+    OnDamage = 1,   // 持有者的前场角色受到伤害后
+    OnDeath = 2,    // 持有者的前场角色被击败时（替补上阵前）
+    TurnStart = 3   // 打出者的下个回合开始（抽牌之后）
+)
+// 除 OnPlay 外的触发时机只对 OnPlay 中登记为持续效果的牌（PlayerState::lasting）派发
+
+// 卡牌效果读写对局的唯一入口，所有状态都在 GameState 中，效果本身不保存任何状态。
+// 非 OnPlay 时没有出手角色（-1）；OnDamage/OnDeath 的 target 为受伤角色下标、damage 为实际伤害，TurnStart 没有目标
+struct EffectContext {
+    GameState& state;
+    PlayerState& owner;     // 打出或持有该牌的玩家
+    PlayerState& opponent;
+    const Card& card;
+    int actor = -1;
+    bool targetIsBase = false;
+    int target = -1;        // 对方前场下标，目标为基地时为 -1
+    int damage = 0;
+    bool magic = false;
+    std::ostream* log;
+
+    EffectContext(GameState& state, PlayerState& owner, PlayerState& opponent, const Card& card, std::ostream* log)
+        : state(state), owner(owner), opponent(opponent), card(card), log(log) {}
+
+    template <typename... Args>
+    void logLine(const Args&... args) const {
+        if (log) { ((*log << args), ...); *log << std::endl; }
+    }
+    void draw(PlayerState& player, int n) const;
+    // 把该牌登记为 owner 的持续效果；同名牌只登记一次，登记已满时返回 false
+    bool linger() const;
+};
+
+typedef void (*CardEffect)(EffectContext& ctx);
+
+// 卡牌效果表：按卡牌句柄平铺，每张牌每个触发时机一个函数指针，进程内只构建一次
+class CardEffects {
+public:
+    static const size_t TRIGGER_COUNT = 4;
+
+    static const CardEffects& instance();
+    CardEffect find(CardHandle card, EffectTrigger trigger) const {
+        return card < table.size() ? table[card][trigger._to_integral()] : nullptr;
+    }
+
+private:
+    std::vector<std::array<CardEffect, TRIGGER_COUNT>> table;
+
+    CardEffects();
+};
+
+class MatchEngine;
+
+// 玩家接口：控制台、AI 或脚本均可实现
+class Player {
+public:
+    virtual ~Player() = default;
+    // self 为该玩家在 GameState::players 中的下标
+    virtual Action chooseAction(const MatchEngine& engine, int self) = 0;
+    // 行动被引擎拒绝时回调
+    virtual void onRejected(const Action&, ActionResult) {}
+};
+
+// 对局引擎：不依赖控制台输入，可由任意 Player 驱动
+class MatchEngine {
+public:
+    // log 为空时不输出任何对局信息
+    MatchEngine(const PlayerSetup& first, const PlayerSetup& second,
+                uint64_t seed, std::ostream* log = nullptr);
+    MatchEngine(const MatchEngine&) = delete;
+    MatchEngine& operator=(const MatchEngine&) = delete;
+
+    // 用新的双方配置与种子重新开局，复用已分配的内存（对象池中的引擎每局调用一次）
+    void start(const PlayerSetup& first, const PlayerSetup& second, uint64_t seed);
+
+    const GameState& getState() const { return state; }
+    const PlayerState& getPlayer(int index) const { return state.players[index]; }
+    const std::string& getPlayerName(int index) const { return names[index]; }
+    int getActive() const { return state.active; }
+    int getTurn() const { return state.turn; }
+    int getWinner() const { return state.winner; }
+    bool isFinished() const { return state.finished; }
+
+    ActionResult applyAction(const Action& action);
+    void legalActions(std::vector<Action>& out) const;
+    // 驱动对局直到结束；maxTurns > 0 时超过回合数判为平局。返回胜者（0 为未分胜负）
+    int play(Player& first, Player& second, int maxTurns = 0);
+
+    // 快照与恢复都只是 GameState 的一次拷贝；随机数状态在 GameState 中，一并回退
+    GameState snapshot() const { return state; }
+    void restore(const GameState& snapshot) { state = snapshot; }
+    // history[i] 为第 i + 1 回合开始时（抽牌之后）的状态
+    const std::vector<GameState>& getHistory() const { return history; }
+    // 回到第 turn 回合开始时的状态并丢弃其后的历史；该回合不存在时返回 false
+    bool restoreTurn(int turn);
+    // 换成给定状态并重新播种，清空历史（保留容量）；供搜索 AI 反复复用同一引擎做推演
+    void reset(const GameState& s, uint64_t seed);
+    // 关闭后回合开始时不再记录历史并释放已有历史，推演时省去每回合一次的状态拷贝
+    void setRecordHistory(bool enabled) {
+        recordHistory = enabled;
+        if (!enabled) std::vector<GameState>().swap(history);
+    }
+    // 设置后每个被接受的行动都以回放格式追加到 out；传 nullptr 停止记录
+    void setActionLog(std::vector<uint8_t>* out) { actionLog = out; }
+
+    static bool isMage(const Character& character);
+
+private:
+    const CardDatabase& catalog;
+    const CardEffects& effects;
+    GameState state;
+    std::vector<GameState> history;
+    bool recordHistory = true;
+    std::vector<uint8_t>* actionLog = nullptr;
+    std::string names[2];
+    std::ostream* log;
+
+    template <typename... Args>
+    void logLine(const Args&... args) const {
+        if (log) { ((*log << args), ...); *log << std::endl; }
+    }
+
+    const std::string& nameOf(const PlayerState& p) const { return names[&p == &state.players[0] ? 0 : 1]; }
+    void beginTurn();
+    ActionResult playCard(const Action& action);
+    void drawCards(PlayerState& p, int n);
+    void triggerLasting(PlayerState& owner, EffectTrigger trigger, int target, int damage);
+    void tryReplaceDead(PlayerState& p, int deadIndex);
+    void applyDamageToChar(PlayerState& owner, int idx, int dmg, bool isMagic);
+    void applyDamageToBase(PlayerState& owner, int dmg);
+    int checkWinner() const;
+    void finish(int winner);
+};
+
+// 控制台玩家：通过标准输入选择行动
+class ConsolePlayer : public Player {
+public:
+    Action chooseAction(const MatchEngine& engine, int self) override;
+    void onRejected(const Action& action, ActionResult result) override;
+};
+
+// 随机 AI：在合法出牌中均匀随机选择，无牌可出时结束回合
+class RandomPlayer : public Player {
+private:
+    Rng rng;
+    std::vector<Action> actions;
+
+public:
+    explicit RandomPlayer(uint64_t seed) : rng(seed) {}
+    Action chooseAction(const MatchEngine& engine, int self) override;
+};
+
+// 工作窃取线程池：每个工作线程拥有自己的任务队列，空闲时从其他队列尾部窃取
+class ThreadPool {
+public:
+    typedef std::function<void(unsigned int)> Task; // 参数为执行该任务的工作线程编号
+
+    explicit ThreadPool(unsigned int threads = 0); // 0 表示使用全部核心
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(Task task);
+    void wait();    // 等待所有已提交任务完成
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+private:
+    struct WorkQueue {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned int> nextQueue{0};
+    std::atomic<size_t> pending{0};   // 未完成的任务
+    std::atomic<size_t> queued{0};    // 尚在队列中的任务
+    std::mutex stateMutex;
+    std::condition_variable workCv;
+    std::condition_variable doneCv;
+    bool stopping = false;
+
+    bool tryPop(unsigned int self, Task& task);
+    void workerLoop(unsigned int index);
+};
+
+// 跨线程唤醒信号：等待方先 prepare() 取得票据并声明自己将要睡眠，再次确认条件不满足后 wait()；
+// 通知方只在确有等待者时才进入内核。Linux 上直接用 futex 睡在 epoch 上，其他平台退回条件变量
+class WaitSignal {
+public:
+    WaitSignal() = default;
+    WaitSignal(const WaitSignal&) = delete;
+    WaitSignal& operator=(const WaitSignal&) = delete;
+
+    uint32_t prepare();
+    void cancel();
+    void wait(uint32_t ticket, std::chrono::milliseconds timeout); // 票据过期、被通知或超时后返回
+    void notify();
+
+private:
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<uint32_t> waiters{0};
+#if !defined(__linux__)
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+#endif
+};
+
+// 有界单生产者单消费者环形队列：槽位在构造时一次分配并反复复用（字符串等成员的容量随之保留），
+// 入队出队只有一次 acquire/release 原子操作，不加锁也不分配内存。
+// 生产者用 prepare() 取得空槽原地写入后 commit() 发布；消费者用 front() 读取队首，处理完 pop() 归还槽位
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // 生产者：队列已满时返回 nullptr
+    T* prepare() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == slots.size()) {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == slots.size()) return nullptr;
+        }
+        return &slots[t & mask];
+    }
+    void commit() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        signal.notify();
+    }
+    bool push(const T& value) {
+        T* slot = prepare();
+        if (!slot) return false;
+        *slot = value; // 赋值复用槽位已有的容量
+        commit();
+        return true;
+    }
+
+    // 消费者：队列为空时返回 nullptr
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache) return nullptr;
+        }
+        return &slots[h & mask];
+    }
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // 消费者：阻塞到队列非空、超时或 wake()，返回此时队列是否有数据（偶有提前返回，调用方需循环复查）
+    bool wait(std::chrono::milliseconds timeout) {
+        if (front()) return true;
+        uint32_t ticket = signal.prepare();
+        if (front()) { signal.cancel(); return true; }
+        signal.wait(ticket, timeout);
+        return front() != nullptr;
+    }
+    // 任意线程：唤醒正在 wait() 的消费者（例如连接关闭时）
+    void wake() { signal.notify(); }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+    // 生产者与消费者各自写的下标放在不同缓存行，避免伪共享；cache 为本端对另一端下标的最近观测
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tailCache = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t headCache = 0;
+    alignas(64) WaitSignal signal;
+};
+
+// 蒙特卡洛树搜索 AI（信息集 MCTS）：每次迭代先对隐藏信息做一次确定化采样
+// （对手手牌与牌库重新分配、己方牌库重新洗牌），再沿树按 UCB 选择、扩展一个节点、
+// 随机推演并回传。各线程在自己的节点区内独立建树（根并行），时间到后按行动合并根节点访问次数。
+// 节点区、推演引擎和行动缓冲在构造时一次分配，搜索过程中不再分配内存
+class MctsPlayer : public Player {
+public:
+    // budgetMs 为每步思考时间；threads 为 0 时使用全部核心
+    explicit MctsPlayer(int budgetMs = 100, unsigned int threads = 0, uint64_t seed = 1);
+    ~MctsPlayer();
+    MctsPlayer(const MctsPlayer&) = delete;
+    MctsPlayer& operator=(const MctsPlayer&) = delete;
+
+    Action chooseAction(const MatchEngine& engine, int self) override;
+    // 上一步所有线程合计的迭代次数
+    long long getLastIterations() const { return lastIterations; }
+
+private:
+    struct Node;
+    struct Arena;
+
+    int budgetMs;
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Arena>> arenas;
+    std::vector<Action> rootActions;
+    std::vector<std::pair<uint32_t, unsigned long long>> rootVisits;
+    long long lastIterations = 0;
+
+    static void search(Arena& arena, const GameState& root, int self,
+                       std::chrono::steady_clock::time_point deadline);
+    static void iterate(Arena& arena, const GameState& root, int self);
+};
+
+// 残局求解结果，value 以局面中当前行动方为视角
+struct SolveResult {
+    int value = 0;                 // 1 必胜，-1 必败，0 在回合期限内无法分出胜负
+    Action best;                   // 最佳行动
+    int turns = 0;                 // 完成搜索的回合期限（迭代加深）
+    unsigned long long nodes = 0;
+    double seconds = 0;
+    unsigned int threads = 0;
+};
+
+// 残局精确求解器：假设双方手牌、牌库顺序与对局随机数状态均已知，按对局规则做 alpha-beta 搜索，
+// 证明回合期限内的必胜或必败。局面以 Zobrist 键索引到固定大小的置换表，表由所有线程共享且无锁
+// （每项保存 键^数据 与 数据，读到被并发写坏的项时校验失败即视为未命中）。
+// 多线程采用 Lazy SMP：各线程以不同的走法顺序搜索同一局面，通过置换表共享结果
+class EndgameSolver {
+public:
+    // tableMB 为置换表大小（向下取整到 2 的幂项）；threads 为 0 时使用全部核心
+    explicit EndgameSolver(size_t tableMB = 64, unsigned int threads = 0);
+    ~EndgameSolver();
+    EndgameSolver(const EndgameSolver&) = delete;
+    EndgameSolver& operator=(const EndgameSolver&) = delete;
+
+    // 搜索从 position 起 maxTurns 个回合内的结果；置换表跨调用保留
+    SolveResult solve(const GameState& position, int maxTurns);
+    void clear();
+    unsigned int getThreadCount() const { return pool.size(); }
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check;  // 键 ^ 数据
+        std::atomic<uint64_t> data;
+    };
+    struct Worker;
+
+    std::unique_ptr<Entry[]> table;
+    size_t mask = 0;
+    size_t cardCount = 0;
+    std::vector<uint64_t> zobrist;  // [玩家][手牌/牌库][位置][卡牌句柄]
+    ThreadPool pool;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stop{false};
+
+    uint64_t hash(const GameState& s) const;
+    bool probe(uint64_t key, uint64_t& data) const;
+    void store(uint64_t key, uint64_t data);
+    int search(Worker& w, int ply, int alpha, int beta, int turnLimit);
+    void iterate(Worker& w, const GameState& root, int maxTurns, bool main);
+};
+
+// 本地对局结束后回放追加到的文件
+const char* const REPLAY_FILE = "replays.mwr";
+
+// 回放中的一方：牌组代码决定牌库，角色为角色库中的下标（按出场顺序）
+struct ReplaySide {
+    std::string name;
+    std::string deckCode;
+    std::vector<uint16_t> characters;
+};
+
+// 一局对局的回放。回放文件只追加，由若干条记录依次拼接而成，每条记录为
+//   ["MWR2"][正文长度 varint][正文][正文 CRC32 小端]（卡牌规则变化时递增版本，旧版本的回放不再读取）
+// 正文 = [种子 u32][2 × (名称长度 varint, 名称, 代码长度 varint, 牌组代码, 角色数 u8, 角色下标 varint...)]
+//        [胜者 u8][回合数 varint][行动流长度 varint][行动流]
+struct Replay {
+    uint32_t seed = 0;
+    ReplaySide sides[2];
+    int winner = 0;                 // 记录时的结果，回放时用于比对
+    int turns = 0;
+    std::vector<uint8_t> actions;
+
+    void appendTo(std::string& out) const;
+    bool appendToFile(const std::string& path) const;
+    // 从 p 读取一条记录并前移 p（复用 out 已有的缓冲）；格式或校验错误时返回 false
+    static bool read(const uint8_t*& p, const uint8_t* end, Replay& out);
+};
+
+// 重新执行的结果
+struct ReplayOutcome {
+    int winner = 0;
+    int turns = 0;
+    size_t actions = 0;
+    bool matchesRecord = false;     // 胜者与回合数均与记录一致
+};
+
+// 按记录的种子、牌组与行动流确定性地重新执行对局；复用解析缓冲，适合批量回放
+class ReplayRunner {
+public:
+    ReplayRunner();
+    // 牌组代码、角色下标或行动无法执行时返回 false
+    bool run(const Replay& replay, ReplayOutcome& out, std::ostream* log = nullptr);
+
+private:
+    DeckCodeParser parser;
+    DecodedDeck decoded;
+    PlayerSetup setups[2];
+};
+
+// 自对弈模拟结果
+struct SimulationReport {
+    long long games = 0;
+    long long winsA = 0;
+    long long winsB = 0;
+    long long draws = 0;
+    double winRateA = 0;     // 平局记半胜
+    double winRateLow = 0;   // 95% 置信区间（Wilson）
+    double winRateHigh = 0;
+    double avgTurns = 0;
+    double turnsMargin = 0;  // 平均回合数的 95% 置信半宽
+    double seconds = 0;
+    unsigned int threads = 0;
+
+    void print(std::ostream& out) const;
+};
+
+// 多线程自对弈模拟器：两套配置轮流先手对战 N 局
+class Simulator {
+public:
+    explicit Simulator(unsigned int threads = 0) : pool(threads) {}
+
+    SimulationReport run(const PlayerSetup& a, const PlayerSetup& b, long long games,
+                         uint64_t seed, int maxTurns = 200);
+    unsigned int getThreadCount() const { return pool.size(); }
+
+private:
+    ThreadPool pool;
+};
+
+// 牌组搜索配置：固定角色与牌组类型，对卡牌做单卡替换的爬山搜索
+struct OptimizerConfig {
+    std::vector<std::shared_ptr<Character>> characters;
+    DeckType deckType = DeckType::Standard;  // 标准牌组不搜索趣味稀有度的卡牌
+    int deckSize = 20;
+    int maxCopies = 2;         // 同名卡牌上限，避免收敛到单卡堆叠
+    int iterations = 2000;     // 尝试的候选牌组数
+    int batchGames = 32;       // 每批对每个对手的对局数
+    int maxGames = 256;        // 每个牌组对每个对手最多模拟的对局数
+    int maxTurns = 200;
+    uint64_t seed = 1;
+};
+
+struct OptimizerResult {
+    std::vector<CardHandle> cards;
+    double winRate = 0;        // 对整个对手池的平均胜率（平局记半胜）
+    int candidates = 0;
+    int accepted = 0;
+    int rejectedEarly = 0;     // 未跑满对局即被淘汰的候选
+    long long cacheHits = 0;
+    long long games = 0;
+    double seconds = 0;
+};
+
+// 模拟驱动的牌组优化器。同一局号对所有候选使用相同种子（配对比较），
+// 已模拟的结果按牌组多重集哈希缓存，候选只在必要时追加对局
+class DeckOptimizer {
+public:
+    DeckOptimizer(const std::vector<PlayerSetup>& opponents, unsigned int threads = 0);
+
+    OptimizerResult run(const OptimizerConfig& config, std::ostream* progress = nullptr);
+    unsigned int getThreadCount() const { return pool.size(); }
+
+private:
+    struct Evaluation {
+        std::vector<int> games;      // 对每个对手已模拟的局数（局号 0..games-1）
+        std::vector<double> wins;
+        long long totalGames = 0;
+        double totalWins = 0;
+
+        double mean() const { return totalGames ? totalWins / totalGames : 0.0; }
+        double upperBound() const;   // 胜率的 95% Wilson 上界
+    };
+
+    std::vector<PlayerSetup> opponents;
+    ThreadPool pool;
+    std::unordered_map<uint64_t, Evaluation> cache;
+    long long gamesPlayed = 0;
+
+    static uint64_t cardKey(CardHandle card);
+    void extend(const OptimizerConfig& config, const std::vector<CardHandle>& cards, Evaluation& eval, int target);
+};
+
+// 只读内存映射文件，打开失败时 isOpen() 为 false
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+
+private:
+    const char* ptr = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// 可移植的非阻塞网络层：RAII 套接字、收发缓冲与事件循环
+// （Linux 用 epoll，macOS/BSD 用 kqueue，Windows 与其他平台用 WSAPoll/poll）
+namespace net {
+#ifdef _WIN32
+    typedef uintptr_t socket_t;
+    const socket_t INVALID_HANDLE = ~(socket_t)0;
+#else
+    typedef int socket_t;
+    const socket_t INVALID_HANDLE = -1;
+#endif
+
+    // 最近一次套接字调用的错误描述
+    std::string lastError();
+
+    // 套接字句柄的唯一所有者，析构时关闭。Windows 下首次创建套接字时自动完成 WSAStartup
+    class Socket {
+    public:
+        static const long WOULD_BLOCK = -1;  // receive/send：暂时无法读写
+        static const long FAILED = -2;       // receive/send：连接出错
+
+        Socket() = default;
+        explicit Socket(socket_t handle) : handle(handle) {}
+        ~Socket() { close(); }
+        Socket(Socket&& other) noexcept : handle(other.release()) {}
+        Socket& operator=(Socket&& other) noexcept;
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+
+        // 监听 0.0.0.0:port 的非阻塞套接字；port 为 0 时由系统分配（见 localPort）。
+        // reusePort 开启 SO_REUSEPORT，让多个事件循环各自监听同一端口
+        static Socket listenTcp(uint16_t port, int backlog, bool reusePort = false, std::string* error = nullptr);
+        // 阻塞连接，成功后切换为非阻塞并关闭 Nagle
+        static Socket connectTcp(const std::string& host, uint16_t port, std::string* error = nullptr);
+
+        bool valid() const { return handle != INVALID_HANDLE; }
+        socket_t get() const { return handle; }
+        socket_t release() { socket_t h = handle; handle = INVALID_HANDLE; return h; }
+        void close();
+
+        // 非阻塞接受一个连接；没有待接受的连接时返回无效套接字
+        Socket accept() const;
+        bool setNonBlocking(bool enabled);
+        bool setNoDelay(bool enabled);
+        uint16_t localPort() const;
+
+        // 返回读取/写入的字节数，0 表示对端已关闭（仅 receive），或 WOULD_BLOCK / FAILED
+        long receive(void* buffer, size_t length);
+        long send(const void* data, size_t length);
+
+    private:
+        socket_t handle = INVALID_HANDLE;
+    };
+
+    // 接收缓冲：容量固定、构造时一次分配。fill 读到 EAGAIN 或缓冲满为止，
+    // 未收完的消息留在缓冲中等待后续数据，取出的行直接指向缓冲内部
+    class RecvBuffer {
+    public:
+        explicit RecvBuffer(size_t capacity = 16384) : buffer(capacity) {}
+
+        // 对端关闭或出错时返回 false
+        bool fill(Socket& socket);
+        // 取出一条完整的行（去掉行尾的 \r\n），line 在下一次 fill 前有效
+        bool nextLine(std::string_view& line);
+
+        const char* data() const { return buffer.data() + begin; }
+        size_t size() const { return end - begin; }
+        void consume(size_t n);
+        // 缓冲已满且没有可消费的完整消息：单条消息超过容量
+        bool full() const { return begin == 0 && end == buffer.size(); }
+        void clear() { begin = end = 0; }
+        size_t capacity() const { return buffer.size(); }
+
+    private:
+        std::vector<char> buffer;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // 发送缓冲：写不完的部分留到套接字可写时继续，清空后保留容量
+    class SendBuffer {
+    public:
+        void append(const void* data, size_t length);
+        void append(std::string_view text) { append(text.data(), text.size()); }
+        // 写到 EAGAIN 或写完为止；出错时返回 false
+        bool flush(Socket& socket);
+        bool empty() const { return sent == buffer.size(); }
+        size_t pending() const { return buffer.size() - sent; }
+        size_t capacity() const { return buffer.capacity(); }
+        // 丢弃未发送的数据；keepCapacity 以上的容量归还给系统
+        void clear(size_t keepCapacity = 0);
+
+    private:
+        std::vector<char> buffer;
+        size_t sent = 0;
+    };
+
+    // 只读的共享数据块：编码一次后由多个连接的发送队列各持一个引用
+    typedef std::shared_ptr<const std::string> SharedChunk;
+
+    // 共享块的发送队列：只保存引用和写到的位置，直接从块中写出而不复制数据，块写完即释放引用
+    class ChunkQueue {
+    public:
+        void push(SharedChunk chunk);
+        // 写到 EAGAIN 或写完为止；出错时返回 false
+        bool flush(Socket& socket);
+        bool empty() const { return head == chunks.size(); }
+        size_t pending() const { return bytes; }
+        void clear();
+
+    private:
+        std::vector<SharedChunk> chunks;
+        size_t head = 0;    // 下一个要写的块
+        size_t offset = 0;  // 该块中已写出的字节
+        size_t bytes = 0;   // 尚未写出的字节
+    };
+
+    // 单线程事件循环（水平触发）。回调中可以增删任意注册；wakeup 可从其他线程调用
+    class EventLoop {
+    public:
+        static const int READABLE = 1;
+        static const int WRITABLE = 2;
+        typedef std::function<void(int events)> Handler;
+
+        EventLoop();
+        ~EventLoop();
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        bool isOpen() const;
+        bool add(socket_t fd, int events, Handler handler);
+        bool modify(socket_t fd, int events);
+        void remove(socket_t fd);
+        // 等待并分发事件；timeoutMs < 0 表示一直等待。返回分发的事件数，出错时返回 -1
+        int poll(int timeoutMs);
+        void wakeup();
+
+    private:
+        struct Registration {
+            socket_t fd;
+            int events;
+            Handler handler;
+            bool active;
+        };
+        struct Backend;
+
+        std::unique_ptr<Backend> backend;
+        std::unordered_map<socket_t, std::unique_ptr<Registration>> registrations;
+        std::vector<std::unique_ptr<Registration>> retired; // 本轮分发结束后释放
+    };
+}
+
+// 二进制联机协议（局域网对战与对战服务器共用）。连接建立后双方各先发送一次 4 字节前导
+// "MWP" + 协议版本，之后每条消息为一帧：[u16 负载长度][u8 类型][负载]，多字节整数均为小端。
+// 行动以 6 字节定长记录传输；卡牌句柄依赖只追加的卡牌目录，跨版本保持不变。
+// 旧的按行文本协议作为兼容选项保留，两种格式都解码为同一个 Message，上层逻辑与格式无关
+namespace wire {
+    const uint8_t VERSION = 1;
+    const size_t PREAMBLE_SIZE = 4;
+    const size_t HEADER_SIZE = 3;
+    const size_t MAX_PAYLOAD = 1024;
+
+    BETTER_ENUM(MessageType, uint8_t,
+        // 局域网对战
+        Name = 1,        // 文本：名称
+        Seed = 2,        // u64：本局种子
+        DeckCode = 3,    // 文本：牌组代码
+        Characters = 4,  // 文本：逗号分隔的角色 ID
+        Play = 5,        // 行动记录
+        EndTurn = 6,
+        Emoji = 7,       // 文本
+        // 对战服务器
+        Hello = 16,      // u8 名称长度、名称、牌组代码
+        Wait = 17,
+        Match = 18,      // u8 座位、对手名称
+        Turn = 19,       // u16 回合、若干行动记录（当前可出的牌）
+        Opponent = 20,   // 行动记录
+        Reject = 21,     // 文本：原因
+        Result = 22,     // u8 胜者、u16 回合数
+        Error = 23,      // 文本：原因
+        Quit = 24,
+        // 观战（仅二进制）
+        Watch = 25,
+        Snapshot = 26,   // u16 回合、u8 行动方、两个 u8 长度加名称、双方全部视图数值（i16）
+        Delta = 27       // 行动记录（含卡牌句柄）、u16 回合、u8 行动方、若干 (u8 键, i16 值)
+    )
+
+    BETTER_ENUM(DecodeStatus, uint8_t,
+        Ok,
+        Incomplete,      // 数据未收全，缓冲保持不变
+        Malformed
+    )
+
+    // 定长行动记录。服务器协议中 hand 为手牌下标；局域网对战双方手牌互不可见，改用 card 传卡牌句柄
+    struct ActionRecord {
+        static const size_t SIZE = 6;
+        static const CardHandle NO_CARD = 0xFFFF;
+
+        uint8_t type = ActionType::EndTurn;
+        uint8_t hand = 0;
+        uint8_t actor = 0;
+        uint8_t target = 0;      // 0 基地，1/2 对方前场角色
+        CardHandle card = NO_CARD;
+
+        static ActionRecord from(const Action& action, CardHandle card = NO_CARD);
+        Action toAction() const;
+    };
+
+    // 观战视图：观众可见的对局数值，手牌与牌库只给张数。各字段的下标如下，
+    // 之后每个角色位依次为 角色库下标（空位为 -1）、生命、能量
+    const uint8_t VIEW_BASE_HP = 0;
+    const uint8_t VIEW_BASE_MANA = 1;
+    const uint8_t VIEW_HAND = 2;
+    const uint8_t VIEW_DECK = 3;
+    const uint8_t VIEW_CHARS = 4;
+    const uint8_t VIEW_CHAR_FIRST = 5;
+    const uint8_t VIEW_FIELDS = VIEW_CHAR_FIRST + 3 * 3;
+
+    // 增量中的一项：键的最高位为座位，低 7 位为字段下标
+    struct ViewChange {
+        uint8_t key;
+        int16_t value;
+    };
+
+    struct SpectatorView {
+        uint16_t turn = 0;
+        uint8_t active = 0;
+        int16_t values[2][VIEW_FIELDS] = {};
+
+        static SpectatorView of(const GameState& state);
+        // 追加从 before 到当前视图的变化项
+        void diff(const SpectatorView& before, std::vector<ViewChange>& out) const;
+        bool apply(const ViewChange& change); // 键无效时返回 false
+    };
+
+    // 解码后的消息；各字段按类型取用，重复使用同一对象时字符串与数组的容量得以保留
+    struct Message {
+        MessageType type = +MessageType::Quit;
+        ActionRecord action;             // Play / Opponent
+        uint64_t value = 0;              // Seed 的种子；Match 的座位；Turn 的回合；Result 的胜者
+        uint32_t turns = 0;              // Result 的回合数
+        std::string text;                // 名称、表情、原因；Characters 为角色 ID 列表
+        std::string deckCode;            // DeckCode / Hello
+        std::vector<ActionRecord> moves; // Turn
+        std::string names[2];            // Snapshot
+        SpectatorView view;              // Snapshot 的全部数值；Delta 只用其中的回合与行动方
+        std::vector<ViewChange> changes; // Delta
+    };
+
+    void appendPreamble(std::string& out);
+    // Incomplete 表示前导还没收全；不是前导或版本不符时为 Malformed
+    DecodeStatus readPreamble(net::RecvBuffer& in);
+    void appendFrame(const Message& message, std::string& out);
+    // 直接从接收缓冲解出一帧并消费；不会在缓冲容量内收全的帧视为 Malformed
+    DecodeStatus nextFrame(net::RecvBuffer& in, Message& out);
+
+    // 兼容的文本协议：每条消息一行，分号分隔（格式见 appendText 的实现）
+    void appendText(const Message& message, std::string& out);
+    bool parseText(std::string_view line, Message& out);
+}
+
+// 局域网对战的一条连接。网络线程用事件循环收发，直接从接收缓冲解码消息，不完整的帧或行留在缓冲中
+// 等待后续数据；与游戏线程之间收发各用一条单生产者单消费者队列交接消息：网络线程把帧解码进接收
+// 队列的槽位，游戏线程把要发的消息写进发送队列的槽位，双方都不加锁
+class LanLink {
+public:
+    explicit LanLink(bool textProtocol, size_t bufferSize = 4096);
+    ~LanLink() { stop(); }
+    LanLink(const LanLink&) = delete;
+    LanLink& operator=(const LanLink&) = delete;
+
+    // 在 listener 上等待一个连接；timeoutMs < 0 表示一直等待，超时或出错时返回无效套接字
+    static net::Socket acceptPeer(const net::Socket& listener, int timeoutMs, std::string* error = nullptr);
+
+    // 接管已连接的套接字并启动网络线程（二进制协议先发送前导）
+    bool start(net::Socket socket, std::string* error = nullptr);
+    // 停止网络线程并关闭连接，可重复调用
+    void stop();
+    // 对端关闭、出错或发来无法解析的数据后为 false
+    bool connected() const { return running; }
+    // 对端使用的协议与本端不同（前导不符）
+    bool protocolMismatch() const { return mismatch; }
+
+    // 发送队列满时等网络线程腾出槽位（两人对战中几乎不会发生）；连接断开后直接丢弃
+    void send(const wire::Message& message);
+    // 游戏线程：取队首消息，处理完后调用 release 归还槽位
+    const wire::Message* front() { return inboundQ.front(); }
+    void release();
+    // 等待新消息，可能提前返回；连接断开时被唤醒
+    void wait(std::chrono::milliseconds timeout) { inboundQ.wait(timeout); }
+
+private:
+    const bool textProtocol;
+    net::Socket conn;
+    net::EventLoop loop;
+    net::RecvBuffer inbox;
+    net::SendBuffer outbox;
+    std::string encoded;  // 网络线程的编码缓冲，反复复用
+    bool peerPreamble;
+    SpscQueue<wire::Message> inboundQ;
+    SpscQueue<wire::Message> outboundQ;
+    std::atomic<bool> running{ false };
+    std::atomic<bool> mismatch{ false };
+    std::atomic<bool> inboundStalled{ false }; // 接收队列已满：网络线程暂停读取，游戏线程取走消息后唤醒它
+    std::thread netThread;
+
+    bool decodeIncoming();
+    void closeConnection();
+    void runNetwork();
+};
+
+BETTER_ENUM(SessionPhase, uint8_t,
+    Idle,       // 已连接，尚未提交牌组
+    Waiting,    // 在匹配队列中
+    Playing,
+    Spectating  // 观战中，或在等待下一局开始
+)
+
+// 专用对战服务器。每个核心一个分片：各自的监听套接字（SO_REUSEPORT，由内核分配连接）、
+// 事件循环、匹配队列与会话/对局对象池，分片之间不共享可变状态。对局由服务器上的 MatchEngine
+// 权威执行，客户端只提交行动。等待超过 MATCH_WAIT_MS 仍无对手时改为与服务器 AI 对局。
+// 每轮事件处理中发给同一会话的消息先写入其发送缓冲，处理完后一次写出。
+//
+// 使用 wire 协议（括号内为兼容的文本格式，仅在 allowText 时接受，按连接首字节区分）：
+//   客户端 Hello（HELLO;<名称>;<牌组代码>）  加入匹配，对局结束后可再次发送
+//          Play（PLAY;<手牌>;<角色>;<目标>）  目标 0 为基地，1/2 为对方前场角色
+//          EndTurn（ENDTURN）、Quit（QUIT）
+//   服务器 Wait（WAIT）                      已进入匹配队列
+//          Match（MATCH;<座位>;<对手名称>）   座位 1 先手
+//          Turn（TURN;<回合>;<手牌:角色:目标,...>）轮到你，附当前可出的牌
+//          Opponent（OPP;PLAY;... 或 OPP;ENDTURN）对手的行动
+//          Reject（REJECT;<原因>）            行动被拒绝
+//          Result（RESULT;<胜者>;<回合数>）    对局结束，胜者为座位号，0 为平局
+//          Error（ERROR;<原因>）              随后断开连接
+// 观战（只用二进制协议，文本客户端的 WATCH 会被拒绝）：
+//   客户端 Watch                             观看本分片最近开始的对局，没有进行中的对局时先回 Wait
+//   服务器 Snapshot                          观战开始时的完整视图
+//          Delta                             之后每个行动一帧，只含变化的数值；对局结束时收到 Result，可再次 Watch
+// 增量只在对局有观众时编码，每轮事件处理中的增量合成一个共享块，全部观众的发送队列引用同一块数据；
+// 同一状态下加入的观众共享同一个快照块。观众只能观看与自己同一分片的对局
+class GameServer {
+public:
+    static constexpr int MATCH_WAIT_MS = 3000;
+    static constexpr int MAX_TURNS = 200;
+
+    struct Stats {
+        unsigned long long connections = 0;
+        unsigned long long activeSessions = 0;
+        unsigned long long matchesStarted = 0;
+        unsigned long long matchesFinished = 0;
+        unsigned long long botMatches = 0;
+        unsigned long long actions = 0;
+        unsigned long long rejected = 0;
+        unsigned long long spectators = 0;     // 当前观众数
+        unsigned long long broadcastBytes = 0; // 观战数据的编码字节数（每块只计一次）
+        unsigned long long fanoutBytes = 0;    // 分发给观众的字节数（按观众计）
+    };
+
+    // threads 为 0 时每个核心一个分片；不支持 SO_REUSEPORT 的平台只用一个分片。
+    // allowText 为兼容开关，同时接受旧的文本协议客户端
+    explicit GameServer(uint16_t port, unsigned int threads = 0, bool allowText = false);
+    ~GameServer();
+    GameServer(const GameServer&) = delete;
+    GameServer& operator=(const GameServer&) = delete;
+
+    bool start(std::string* error = nullptr);
+    void stop();
+    Stats getStats() const;
+    unsigned int getShardCount() const { return (unsigned int)shards.size(); }
+    // 每个会话与每局对局对象的固定内存（不含随对局增长的部分）
+    static size_t sessionBytes();
+    static size_t matchBytes();
+
+private:
+    struct Session;
+    struct Match;
+    struct Shard;
+
+    uint16_t port;
+    bool allowText;
+    unsigned int threadCount;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{ false };
+
+    static void runShard(Shard& shard, const std::atomic<bool>& running);
 };
 
 // 游戏管理器类
 class GameManager {
 private:
-    CardDatabase cardDB;
-    CharacterDatabase characterDB;
+    const CardDatabase& cardDB = CardDatabase::instance();
+    const CharacterDatabase& characterDB = CharacterDatabase::instance();
     std::vector<Deck> decks;
 
+    void playLocalMatch();
+    void buildDeckFromDeckCode(const std::string& deckCode,
+                               std::vector<CardHandle>& outDeck) const;
+    bool loadPlayerSetup(const std::string& deckCode, const std::string& name, PlayerSetup& out) const;
+    int runSimulation(const std::vector<std::string>& args);
+    int runValidation(const std::vector<std::string>& args);
+    int runOptimizer(const std::vector<std::string>& args);
+    int runSolver(const std::vector<std::string>& args);
+    int runRecord(const std::vector<std::string>& args);
+    int runReplay(const std::vector<std::string>& args);
+    int runServer(const std::vector<std::string>& args);
+    int runLoadTest(const std::vector<std::string>& args);
+    int runWatch(const std::vector<std::string>& args);
+    int runLanTest(const std::vector<std::string>& args);
+
 public:
     void displayAllCards() const;
     void displayAllCharacters() const;
@@ -230,6 +1600,8 @@ public:
     void importDeckFromCode();
     void showMenu() const;
     void run();
+    // 非交互命令行模式，返回进程退出码
+    int runCommand(const std::vector<std::string>& args);
 };
 
 #endif // CARD_GAME_H
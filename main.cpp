@@ -15,8 +15,12 @@ public:
         HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
         SetConsoleOutputCP(65001);
 #else
-        // Linux/macOS设置
-        std::locale::global(std::locale("en_US.UTF-8"));
+        // Linux/macOS设置（未安装 en_US.UTF-8 时退回 C.UTF-8）
+        try {
+            std::locale::global(std::locale("en_US.UTF-8"));
+        } catch (const std::runtime_error&) {
+            try { std::locale::global(std::locale("C.UTF-8")); } catch (const std::runtime_error&) {}
+        }
         std::cout.imbue(std::locale());
         std::wcout.imbue(std::locale());
 #endif
@@ -30,8 +34,8 @@ public:
 // 全局UTF-8控制台设置
 UTF8Console utf8_console;
 
-int main() {
+int main(int argc, char* argv[]) {
     GameManager game;
-    game.run();
-    return 0;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    return game.runCommand(args);
 }